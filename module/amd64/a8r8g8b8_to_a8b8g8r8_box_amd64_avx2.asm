@@ -0,0 +1,115 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to ABGR
+;amd64 AVX2
+;
+
+%include "common.asm"
+
+PREPARE_RODATA
+cshuf times 2 db 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+; s8 and d8 do not need to be aligned
+;int
+;a8r8g8b8_to_a8b8g8r8_box_amd64_avx2(const char *s8, int src_stride,
+;                                    char *d8, int dst_stride,
+;                                    int width, int height);
+PROC a8r8g8b8_to_a8b8g8r8_box_amd64_avx2
+    push rbx
+    push rbp
+
+    vmovdqu ymm4, [lsym(cshuf)]
+
+    movsxd rsi, esi      ; src_stride
+    movsxd rcx, ecx      ; dst_stride
+    movsxd r8, r8d       ; width
+    mov r10, rdi         ; src
+    mov r11, rdx         ; dst
+    test r9d, r9d        ; height
+    jle done_loop_y
+
+loop_y:
+    mov rdx, r8          ; width
+    mov rbx, r10         ; src
+    mov rbp, r11         ; dst
+
+; A R G B A R G B A R G B A R G B to
+; A B G R A B G R A B G R A B G R
+
+loop_x16:
+    cmp rdx, 16
+    jl done_loop_x16
+    vmovdqu ymm0, [rbx]
+    vmovdqu ymm1, [rbx + 32]
+    lea rbx, [rbx + 64]
+    vpshufb ymm0, ymm0, ymm4
+    vpshufb ymm1, ymm1, ymm4
+    vmovdqu [rbp], ymm0
+    vmovdqu [rbp + 32], ymm1
+    lea rbp, [rbp + 64]
+    sub rdx, 16
+    jmp loop_x16
+done_loop_x16:
+
+loop_x8:
+    cmp rdx, 8
+    jl done_loop_x8
+    vmovdqu ymm0, [rbx]
+    lea rbx, [rbx + 32]
+    vpshufb ymm0, ymm0, ymm4
+    vmovdqu [rbp], ymm0
+    lea rbp, [rbp + 32]
+    sub rdx, 8
+    jmp loop_x8
+done_loop_x8:
+
+loop_x:
+    cmp rdx, 1
+    jl done_loop_x
+    mov eax, [rbx]
+    lea rbx, [rbx + 4]
+    mov edi, eax         ; a and g
+    and edi, 0xFF00FF00
+    bswap eax            ; b g r a
+    ror eax, 8           ; a b g r
+    and eax, 0x00FF00FF  ; b and r
+    or eax, edi
+    mov [rbp], eax
+    lea rbp, [rbp + 4]
+    dec rdx
+    jmp loop_x
+done_loop_x:
+
+    add r10, rsi         ; src_stride
+    add r11, rcx         ; dst_stride
+
+    dec r9d              ; height
+    jnz loop_y
+done_loop_y:
+
+    vzeroupper
+    mov eax, 0           ; return value
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
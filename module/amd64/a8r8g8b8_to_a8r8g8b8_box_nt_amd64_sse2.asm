@@ -0,0 +1,125 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to ARGB copy with non temporal stores
+;amd64 SSE2
+;
+; for copies into shared memory that the X server does not read back,
+; the stores bypass the cache so the copy does not evict the X server's
+; working set, the source is prefetched ahead with prefetchnta
+;
+; notes
+;   s8 and d8 do not need to be aligned, d8 should be 4 byte aligned
+;   width and height can be anything >= 0
+
+%include "common.asm"
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_a8r8g8b8_box_nt_amd64_sse2(const char *s8, int src_stride,
+;                                       char *d8, int dst_stride,
+;                                       int width, int height);
+PROC a8r8g8b8_to_a8r8g8b8_box_nt_amd64_sse2
+    push rbx
+
+    movsxd rsi, esi            ; src_stride
+    movsxd rcx, ecx            ; dst_stride
+    test r8d, r8d
+    jle done_row_loop1
+    test r9d, r9d
+    jle done_row_loop1
+
+row_loop1:
+    mov r10, rdi               ; s8
+    mov r11, rdx               ; d8
+    mov eax, r8d               ; pixels left in line
+
+head_loop1:
+    ; single pixels until d8 is 16 byte aligned
+    test r11, 15
+    jz done_head_loop1
+    mov ebx, [r10]
+    movnti [r11], ebx
+    lea r10, [r10 + 4]
+    lea r11, [r11 + 4]
+    dec eax
+    jnz head_loop1
+    jmp done_tail_loop1
+
+done_head_loop1:
+    cmp eax, 16
+    jb done_loop1
+
+loop1:
+    ; 16 pixels, 64 bytes, one cache line at a time
+    prefetchnta [r10 + 512]
+    movdqu xmm0, [r10]
+    movdqu xmm1, [r10 + 16]
+    movdqu xmm2, [r10 + 32]
+    movdqu xmm3, [r10 + 48]
+    movntdq [r11], xmm0
+    movntdq [r11 + 16], xmm1
+    movntdq [r11 + 32], xmm2
+    movntdq [r11 + 48], xmm3
+    lea r10, [r10 + 64]
+    lea r11, [r11 + 64]
+    sub eax, 16
+    cmp eax, 16
+    jae loop1
+
+done_loop1:
+    cmp eax, 4
+    jb tail_loop1
+
+loop2:
+    ; 4 pixels, 16 bytes
+    movdqu xmm0, [r10]
+    movntdq [r11], xmm0
+    lea r10, [r10 + 16]
+    lea r11, [r11 + 16]
+    sub eax, 4
+    cmp eax, 4
+    jae loop2
+
+tail_loop1:
+    test eax, eax
+    jz done_tail_loop1
+    mov ebx, [r10]
+    movnti [r11], ebx
+    lea r10, [r10 + 4]
+    lea r11, [r11 + 4]
+    dec eax
+    jmp tail_loop1
+
+done_tail_loop1:
+    ; next line
+    add rdi, rsi
+    add rdx, rcx
+    dec r9d
+    jnz row_loop1
+
+    sfence                     ; order the non temporal stores
+
+done_row_loop1:
+    mov rax, 0                 ; return value
+    pop rbx
+    ret
+END_OF_FILE
@@ -0,0 +1,262 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to AVC444 main and auxiliary NV12 views
+;amd64 AVX2
+;
+; main view, d8_y and d8_uv, is the same as a8r8g8b8_to_nv12_box
+; auxiliary view, from each pair of lines
+;   d8_aux_u gets u of the second line, d8_aux_v gets v of the second line
+;   d8_aux_uv gets u and v of the odd pixels of the first line
+; all planes use dst_stride, each call does 2 lines of d8_y and 1 line of
+; the others for each 2 lines of s8
+;
+; notes
+;   s8 does not need to be aligned
+;   width should be multiple of 8 and > 0
+;   height should be even and > 0
+;   output is bit exact with the SSE2 and C versions
+
+%include "common.asm"
+
+PREPARE_RODATA
+    cd255  times 8 dd 255
+    cd2    times 8 dd 2
+    cdhi   times 8 dd 0xFFFF0000
+
+    cw255  times 16 dw 255
+    cw16   times 16 dw 16
+    cw128  times 16 dw 128
+    cw66   times 16 dw 66
+    cw129  times 16 dw 129
+    cw25   times 16 dw 25
+    cw38   times 16 dw 38
+    cw74   times 16 dw 74
+    cw112  times 16 dw 112
+    cw94   times 16 dw 94
+    cw18   times 16 dw 18
+    cw1    times 16 dw 1
+
+; one line of 16 pixels, %1 and %2 are the two 8 pixel source addresses
+; out, ymm5 = 16 y words, %3 = 16 u words, %4 = 16 v words
+%macro RGB_TO_YUV16 4
+    vmovdqu ymm0, %1
+    vmovdqu ymm1, %2
+
+    vpand ymm2, ymm0, ymm15        ; blue
+    vpand ymm3, ymm1, ymm15        ; blue
+    vpackssdw ymm2, ymm2, ymm3
+    vpermq ymm2, ymm2, 0xD8        ; ymm2 = 16 blues
+    vpsrld ymm3, ymm0, 8           ; green
+    vpand ymm3, ymm3, ymm15
+    vpsrld ymm4, ymm1, 8           ; green
+    vpand ymm4, ymm4, ymm15
+    vpackssdw ymm3, ymm3, ymm4
+    vpermq ymm3, ymm3, 0xD8        ; ymm3 = 16 greens
+    vpsrld ymm4, ymm0, 16          ; red
+    vpand ymm4, ymm4, ymm15
+    vpsrld ymm5, ymm1, 16          ; red
+    vpand ymm5, ymm5, ymm15
+    vpackssdw ymm4, ymm4, ymm5
+    vpermq ymm4, ymm4, 0xD8        ; ymm4 = 16 reds
+
+    ; _Y = (( 66 * _R + 129 * _G +  25 * _B + 128) >> 8) +  16;
+    vpmullw ymm5, ymm2, [lsym(cw25)]
+    vpmullw ymm6, ymm3, [lsym(cw129)]
+    vpaddw ymm5, ymm5, ymm6
+    vpmullw ymm6, ymm4, [lsym(cw66)]
+    vpaddw ymm5, ymm5, ymm6
+    vpaddw ymm5, ymm5, [lsym(cw128)]
+    vpsrlw ymm5, ymm5, 8
+    vpaddw ymm5, ymm5, [lsym(cw16)]
+
+    ; _U = ((-38 * _R -  74 * _G + 112 * _B + 128) >> 8) + 128;
+    vpmullw %3, ymm2, [lsym(cw112)]
+    vpmullw ymm6, ymm3, [lsym(cw74)]
+    vpsubw %3, %3, ymm6
+    vpmullw ymm6, ymm4, [lsym(cw38)]
+    vpsubw %3, %3, ymm6
+    vpaddw %3, %3, [lsym(cw128)]
+    vpsraw %3, %3, 8
+    vpaddw %3, %3, [lsym(cw128)]
+    vpmaxsw %3, %3, ymm14          ; clamp 0 to 255
+    vpminsw %3, %3, [lsym(cw255)]
+
+    ; _V = ((112 * _R -  94 * _G -  18 * _B + 128) >> 8) + 128;
+    vpmullw %4, ymm4, [lsym(cw112)]
+    vpmullw ymm6, ymm3, [lsym(cw94)]
+    vpsubw %4, %4, ymm6
+    vpmullw ymm6, ymm2, [lsym(cw18)]
+    vpsubw %4, %4, ymm6
+    vpaddw %4, %4, [lsym(cw128)]
+    vpsraw %4, %4, 8
+    vpaddw %4, %4, [lsym(cw128)]
+    vpmaxsw %4, %4, ymm14          ; clamp 0 to 255
+    vpminsw %4, %4, [lsym(cw255)]
+
+    vpackuswb ymm5, ymm5, ymm14
+    vpermq ymm5, ymm5, 0x08        ; xmm5 = 16 y bytes
+%endmacro
+
+; auxiliary view
+; in, ymm8, ymm9 first line u, v, ymm10, ymm11 second line u, v
+; out, xmm12 = 16 u bytes, xmm13 = 16 v bytes, xmm6 = uvuvuvuvuvuvuvuv
+%macro AUX_VIEW 0
+    vpackuswb ymm12, ymm10, ymm14
+    vpermq ymm12, ymm12, 0x08      ; second line u
+    vpackuswb ymm13, ymm11, ymm14
+    vpermq ymm13, ymm13, 0x08      ; second line v
+    vpsrld ymm6, ymm8, 16          ; odd u in low words
+    vpand ymm7, ymm9, [lsym(cdhi)] ; odd v in high words
+    vpor ymm6, ymm6, ymm7
+    vpackuswb ymm6, ymm6, ymm6
+    vpermq ymm6, ymm6, 0x08
+%endmacro
+
+; uv add and divide(average) of two lines
+; in, ymm8, ymm9 first line u, v, ymm10, ymm11 second line u, v
+; out, xmm8 = uvuvuvuvuvuvuvuv
+%macro UV_AVERAGE 0
+    vpaddw ymm8, ymm8, ymm10
+    vpmaddwd ymm8, ymm8, [lsym(cw1)]   ; add pairs
+    vpaddd ymm8, ymm8, [lsym(cd2)]     ; add 2
+    vpsrld ymm8, ymm8, 2               ; div 4
+    vpaddw ymm9, ymm9, ymm11
+    vpmaddwd ymm9, ymm9, [lsym(cw1)]   ; add pairs
+    vpaddd ymm9, ymm9, [lsym(cd2)]     ; add 2
+    vpsrld ymm9, ymm9, 2               ; div 4
+    vpslld ymm9, ymm9, 16
+    vpor ymm8, ymm8, ymm9
+    vpackuswb ymm8, ymm8, ymm8
+    vpermq ymm8, ymm8, 0x08
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_avc444_box_amd64_avx2(const char *s8, int src_stride,
+;                                  char *d8_y, char *d8_uv,
+;                                  char *d8_aux_u, char *d8_aux_v,
+;                                  char *d8_aux_uv, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_avc444_box_amd64_avx2
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+
+    movsxd rsi, esi            ; src_stride
+    mov r10, [rsp + 56]        ; d8_aux_uv
+    movsxd r11, dword [rsp + 64] ; dst_stride
+    shr dword [rsp + 80], 1    ; height, doing 2 lines at a time
+    jz done_row_loop1
+
+    vmovdqu ymm15, [lsym(cd255)]
+    vpxor ymm14, ymm14, ymm14
+
+    mov rbx, rdi               ; s8
+    mov rbp, rdx               ; d8_y
+    mov r12, rcx               ; d8_uv
+
+row_loop1:
+    mov rax, rbx               ; s8
+    mov r13, rbp               ; d8_y
+    mov r14, r12               ; d8_uv
+    mov rdi, r8                ; d8_aux_u
+    mov rdx, r9                ; d8_aux_v
+    mov rcx, r10               ; d8_aux_uv
+
+    mov r15d, [rsp + 72]       ; width
+    shr r15d, 4                ; doing 16 pixels at a time
+    jz done_loop1
+
+loop1:
+    ; first line
+    RGB_TO_YUV16 [rax], [rax + 32], ymm8, ymm9
+    vmovdqu [r13], xmm5        ; out 16 bytes yyyyyyyyyyyyyyyy
+
+    ; second line
+    RGB_TO_YUV16 [rax + rsi], [rax + rsi + 32], ymm10, ymm11
+    vmovdqu [r13 + r11], xmm5  ; out 16 bytes yyyyyyyyyyyyyyyy
+
+    AUX_VIEW
+    vmovdqu [rdi], xmm12       ; out 16 bytes uuuuuuuuuuuuuuuu
+    vmovdqu [rdx], xmm13       ; out 16 bytes vvvvvvvvvvvvvvvv
+    vmovdqu [rcx], xmm6        ; out 16 bytes uvuvuvuvuvuvuvuv
+
+    UV_AVERAGE
+    vmovdqu [r14], xmm8        ; out 16 bytes uvuvuvuvuvuvuvuv
+
+    ; move right
+    lea rax, [rax + 64]
+    lea r13, [r13 + 16]
+    lea r14, [r14 + 16]
+    lea rdi, [rdi + 16]
+    lea rdx, [rdx + 16]
+    lea rcx, [rcx + 16]
+
+    dec r15d
+    jnz loop1
+
+done_loop1:
+    test dword [rsp + 72], 8   ; 8 pixels left over
+    jz done_loop2
+
+    ; first line
+    RGB_TO_YUV16 [rax], [rax], ymm8, ymm9
+    vmovq [r13], xmm5          ; out 8 bytes yyyyyyyy
+
+    ; second line
+    RGB_TO_YUV16 [rax + rsi], [rax + rsi], ymm10, ymm11
+    vmovq [r13 + r11], xmm5    ; out 8 bytes yyyyyyyy
+
+    AUX_VIEW
+    vmovq [rdi], xmm12         ; out 8 bytes uuuuuuuu
+    vmovq [rdx], xmm13         ; out 8 bytes vvvvvvvv
+    vmovq [rcx], xmm6          ; out 8 bytes uvuvuvuv
+
+    UV_AVERAGE
+    vmovq [r14], xmm8          ; out 8 bytes uvuvuvuv
+
+done_loop2:
+    ; update s8 and the destinations
+    lea rbx, [rbx + rsi * 2]
+    lea rbp, [rbp + r11 * 2]
+    add r12, r11
+    add r8, r11
+    add r9, r11
+    add r10, r11
+
+    dec dword [rsp + 80]
+    jnz row_loop1
+
+done_row_loop1:
+    vzeroupper
+    mov rax, 0                 ; return value
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
@@ -0,0 +1,237 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to AVC444 main and auxiliary NV12 views
+;amd64 SSE2
+;
+; main view, d8_y and d8_uv, is the same as a8r8g8b8_to_nv12_box
+; auxiliary view, from each pair of lines
+;   d8_aux_u gets u of the second line, d8_aux_v gets v of the second line
+;   d8_aux_uv gets u and v of the odd pixels of the first line
+; all planes use dst_stride, each call does 2 lines of d8_y and 1 line of
+; the others for each 2 lines of s8
+;
+; notes
+;   s8 does not need to be aligned
+;   width should be multiple of 8 and > 0
+;   height should be even and > 0
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+    cd255  times 4 dd 255
+    cd2    times 4 dd 2
+    cdhi   times 4 dd 0xFFFF0000
+
+    cw16   times 8 dw 16
+    cw128  times 8 dw 128
+    cw66   times 8 dw 66
+    cw129  times 8 dw 129
+    cw25   times 8 dw 25
+    cw38   times 8 dw 38
+    cw74   times 8 dw 74
+    cw112  times 8 dw 112
+    cw94   times 8 dw 94
+    cw18   times 8 dw 18
+    cw1    times 8 dw 1
+
+; one line of 8 pixels at address %1
+; out, xmm4 = 8 y bytes, %2 = 8 u words, %3 = 8 v words, clamped
+%macro RGB_TO_YUV8 3
+    movdqu xmm0, [%1]          ; 4 pixels, 16 bytes
+    movdqa xmm1, xmm0          ; blue
+    pand xmm1, xmm15
+    movdqa xmm2, xmm0          ; green
+    psrld xmm2, 8
+    pand xmm2, xmm15
+    movdqa xmm3, xmm0          ; red
+    psrld xmm3, 16
+    pand xmm3, xmm15
+
+    movdqu xmm0, [%1 + 16]     ; 4 pixels, 16 bytes
+    movdqa xmm4, xmm0          ; blue
+    pand xmm4, xmm15
+    movdqa xmm5, xmm0          ; green
+    psrld xmm5, 8
+    pand xmm5, xmm15
+    movdqa xmm6, xmm0          ; red
+    psrld xmm6, 16
+    pand xmm6, xmm15
+
+    packssdw xmm1, xmm4        ; xmm1 = 8 blues
+    packssdw xmm2, xmm5        ; xmm2 = 8 greens
+    packssdw xmm3, xmm6        ; xmm3 = 8 reds
+
+    ; _U = ((-38 * _R -  74 * _G + 112 * _B + 128) >> 8) + 128;
+    movdqa %2, xmm1
+    pmullw %2, [lsym(cw112)]
+    movdqa xmm5, xmm2
+    pmullw xmm5, [lsym(cw74)]
+    psubw %2, xmm5
+    movdqa xmm5, xmm3
+    pmullw xmm5, [lsym(cw38)]
+    psubw %2, xmm5
+    paddw %2, [lsym(cw128)]
+    psraw %2, 8
+    paddw %2, [lsym(cw128)]
+    packuswb %2, xmm14         ; clamp 0 to 255
+    punpcklbw %2, xmm14
+
+    ; _V = ((112 * _R -  94 * _G -  18 * _B + 128) >> 8) + 128;
+    movdqa %3, xmm3
+    pmullw %3, [lsym(cw112)]
+    movdqa xmm5, xmm2
+    pmullw xmm5, [lsym(cw94)]
+    psubw %3, xmm5
+    movdqa xmm5, xmm1
+    pmullw xmm5, [lsym(cw18)]
+    psubw %3, xmm5
+    paddw %3, [lsym(cw128)]
+    psraw %3, 8
+    paddw %3, [lsym(cw128)]
+    packuswb %3, xmm14         ; clamp 0 to 255
+    punpcklbw %3, xmm14
+
+    ; _Y = (( 66 * _R + 129 * _G +  25 * _B + 128) >> 8) +  16;
+    pmullw xmm1, [lsym(cw25)]
+    pmullw xmm2, [lsym(cw129)]
+    pmullw xmm3, [lsym(cw66)]
+    movdqa xmm4, xmm1
+    paddw xmm4, xmm2
+    paddw xmm4, xmm3
+    paddw xmm4, [lsym(cw128)]
+    psrlw xmm4, 8
+    paddw xmm4, [lsym(cw16)]
+    packuswb xmm4, xmm14
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_avc444_box_amd64_sse2(const char *s8, int src_stride,
+;                                  char *d8_y, char *d8_uv,
+;                                  char *d8_aux_u, char *d8_aux_v,
+;                                  char *d8_aux_uv, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_avc444_box_amd64_sse2
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+
+    movsxd rsi, esi            ; src_stride
+    mov r10, [rsp + 56]        ; d8_aux_uv
+    movsxd r11, dword [rsp + 64] ; dst_stride
+    shr dword [rsp + 80], 1    ; height, doing 2 lines at a time
+    jz done_row_loop1
+
+    movdqu xmm15, [lsym(cd255)]
+    pxor xmm14, xmm14
+
+    mov rbx, rdi               ; s8
+    mov rbp, rdx               ; d8_y
+    mov r12, rcx               ; d8_uv
+
+row_loop1:
+    mov rax, rbx               ; s8
+    mov r13, rbp               ; d8_y
+    mov r14, r12               ; d8_uv
+    mov rdi, r8                ; d8_aux_u
+    mov rdx, r9                ; d8_aux_v
+    mov rcx, r10               ; d8_aux_uv
+
+    mov r15d, [rsp + 72]       ; width
+    shr r15d, 3                ; doing 8 pixels at a time
+    jz done_loop1
+
+loop1:
+    ; first line
+    RGB_TO_YUV8 rax, xmm8, xmm9
+    movq [r13], xmm4           ; out 8 bytes yyyyyyyy
+
+    ; second line
+    RGB_TO_YUV8 rax + rsi, xmm10, xmm11
+    movq [r13 + r11], xmm4     ; out 8 bytes yyyyyyyy
+
+    ; auxiliary view
+    movdqa xmm12, xmm10
+    packuswb xmm12, xmm14
+    movq [rdi], xmm12          ; out 8 bytes uuuuuuuu
+    movdqa xmm13, xmm11
+    packuswb xmm13, xmm14
+    movq [rdx], xmm13          ; out 8 bytes vvvvvvvv
+    movdqa xmm12, xmm8
+    psrld xmm12, 16            ; odd u in low words
+    movdqa xmm13, xmm9
+    pand xmm13, [lsym(cdhi)]   ; odd v in high words
+    por xmm12, xmm13
+    packuswb xmm12, xmm14
+    movq [rcx], xmm12          ; out 8 bytes uvuvuvuv
+
+    ; uv add and divide(average)
+    paddw xmm8, xmm10
+    pmaddwd xmm8, [lsym(cw1)]  ; add pairs
+    paddd xmm8, [lsym(cd2)]    ; add 2
+    psrld xmm8, 2              ; div 4
+    paddw xmm9, xmm11
+    pmaddwd xmm9, [lsym(cw1)]  ; add pairs
+    paddd xmm9, [lsym(cd2)]    ; add 2
+    psrld xmm9, 2              ; div 4
+    pslld xmm9, 16
+    por xmm8, xmm9
+    packuswb xmm8, xmm14
+    movq [r14], xmm8           ; out 8 bytes uvuvuvuv
+
+    ; move right
+    lea rax, [rax + 32]
+    lea r13, [r13 + 8]
+    lea r14, [r14 + 8]
+    lea rdi, [rdi + 8]
+    lea rdx, [rdx + 8]
+    lea rcx, [rcx + 8]
+
+    dec r15d
+    jnz loop1
+
+done_loop1:
+    ; update s8 and the destinations
+    lea rbx, [rbx + rsi * 2]
+    lea rbp, [rbp + r11 * 2]
+    add r12, r11
+    add r8, r11
+    add r9, r11
+    add r10, r11
+
+    dec dword [rsp + 80]
+    jnz row_loop1
+
+done_row_loop1:
+    mov rax, 0                 ; return value
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
@@ -0,0 +1,239 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to NV12
+;amd64 AVX-512BW
+;
+; notes
+;   s8 does not need to be aligned
+;   width should be multiple of 8 and > 0
+;   height should be even and > 0
+;   output is bit exact with the SSE2 and C versions
+
+%include "common.asm"
+
+PREPARE_RODATA
+    cq_perm dq 0, 2, 4, 6, 1, 3, 5, 7
+
+    cd255  times 16 dd 255
+    cd2    times 16 dd 2
+
+    cw255  times 32 dw 255
+    cw16   times 32 dw 16
+    cw128  times 32 dw 128
+    cw66   times 32 dw 66
+    cw129  times 32 dw 129
+    cw25   times 32 dw 25
+    cw38   times 32 dw 38
+    cw74   times 32 dw 74
+    cw112  times 32 dw 112
+    cw94   times 32 dw 94
+    cw18   times 32 dw 18
+    cw1    times 32 dw 1
+
+; one line of 32 pixels in zmm0 and zmm1
+; out, ymm5 = 32 y bytes, %1 = 32 u words, %2 = 32 v words
+%macro RGB_TO_YUV32 2
+    vpandd zmm2, zmm0, zmm15       ; blue
+    vpandd zmm3, zmm1, zmm15       ; blue
+    vpackssdw zmm2, zmm2, zmm3
+    vpermq zmm2, zmm13, zmm2       ; zmm2 = 32 blues
+    vpsrld zmm3, zmm0, 8           ; green
+    vpandd zmm3, zmm3, zmm15
+    vpsrld zmm4, zmm1, 8           ; green
+    vpandd zmm4, zmm4, zmm15
+    vpackssdw zmm3, zmm3, zmm4
+    vpermq zmm3, zmm13, zmm3       ; zmm3 = 32 greens
+    vpsrld zmm4, zmm0, 16          ; red
+    vpandd zmm4, zmm4, zmm15
+    vpsrld zmm5, zmm1, 16          ; red
+    vpandd zmm5, zmm5, zmm15
+    vpackssdw zmm4, zmm4, zmm5
+    vpermq zmm4, zmm13, zmm4       ; zmm4 = 32 reds
+
+    ; _Y = (( 66 * _R + 129 * _G +  25 * _B + 128) >> 8) +  16;
+    vpmullw zmm5, zmm2, [lsym(cw25)]
+    vpmullw zmm6, zmm3, [lsym(cw129)]
+    vpaddw zmm5, zmm5, zmm6
+    vpmullw zmm6, zmm4, [lsym(cw66)]
+    vpaddw zmm5, zmm5, zmm6
+    vpaddw zmm5, zmm5, [lsym(cw128)]
+    vpsrlw zmm5, zmm5, 8
+    vpaddw zmm5, zmm5, [lsym(cw16)]
+    vpmovuswb ymm5, zmm5           ; ymm5 = 32 y bytes
+
+    ; _U = ((-38 * _R -  74 * _G + 112 * _B + 128) >> 8) + 128;
+    vpmullw %1, zmm2, [lsym(cw112)]
+    vpmullw zmm6, zmm3, [lsym(cw74)]
+    vpsubw %1, %1, zmm6
+    vpmullw zmm6, zmm4, [lsym(cw38)]
+    vpsubw %1, %1, zmm6
+    vpaddw %1, %1, [lsym(cw128)]
+    vpsraw %1, %1, 8
+    vpaddw %1, %1, [lsym(cw128)]
+    vpmaxsw %1, %1, zmm14          ; clamp 0 to 255
+    vpminsw %1, %1, [lsym(cw255)]
+
+    ; _V = ((112 * _R -  94 * _G -  18 * _B + 128) >> 8) + 128;
+    vpmullw %2, zmm4, [lsym(cw112)]
+    vpmullw zmm6, zmm3, [lsym(cw94)]
+    vpsubw %2, %2, zmm6
+    vpmullw zmm6, zmm2, [lsym(cw18)]
+    vpsubw %2, %2, zmm6
+    vpaddw %2, %2, [lsym(cw128)]
+    vpsraw %2, %2, 8
+    vpaddw %2, %2, [lsym(cw128)]
+    vpmaxsw %2, %2, zmm14          ; clamp 0 to 255
+    vpminsw %2, %2, [lsym(cw255)]
+%endmacro
+
+; uv add and divide(average) of two lines
+; in, zmm8, zmm9 first line u, v, zmm10, zmm11 second line u, v
+; out, ymm8 = 32 bytes uvuv...
+%macro UV_AVERAGE 0
+    vpaddw zmm8, zmm8, zmm10
+    vpmaddwd zmm8, zmm8, [lsym(cw1)]   ; add pairs
+    vpaddd zmm8, zmm8, [lsym(cd2)]     ; add 2
+    vpsrld zmm8, zmm8, 2               ; div 4
+    vpaddw zmm9, zmm9, zmm11
+    vpmaddwd zmm9, zmm9, [lsym(cw1)]   ; add pairs
+    vpaddd zmm9, zmm9, [lsym(cd2)]     ; add 2
+    vpsrld zmm9, zmm9, 2               ; div 4
+    vpslld zmm9, zmm9, 16
+    vpord zmm8, zmm8, zmm9
+    vpmovwb ymm8, zmm8
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_nv12_box_amd64_avx512(const char *s8, int src_stride,
+;                                  char *d8_y, int dst_stride_y,
+;                                  char *d8_uv, int dst_stride_uv,
+;                                  int width, int height);
+PROC a8r8g8b8_to_nv12_box_amd64_avx512
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+
+    movsxd rsi, esi            ; src_stride
+    movsxd rcx, ecx            ; dst_stride_y
+    movsxd r9, r9d             ; dst_stride_uv
+    mov r10d, [rsp + 56]       ; width
+    mov r11d, [rsp + 64]       ; height
+    shr r11d, 1                ; doing 2 lines at a time
+    jz done_row_loop1
+
+    vmovdqu64 zmm13, [lsym(cq_perm)]
+    vmovdqu64 zmm15, [lsym(cd255)]
+    vpxord zmm14, zmm14, zmm14
+
+    ; masks for the pixels left over after the 32 pixel loop
+    push rcx
+    mov ecx, r10d
+    and ecx, 24                ; 8, 16 or 24 pixels left over
+    mov eax, 1
+    shl eax, cl
+    dec eax
+    kmovd k3, eax              ; k3 = y and uv bytes
+    kmovw k1, eax              ; k1 = first 16 pixels
+    shr eax, 16
+    kmovw k2, eax              ; k2 = second 16 pixels
+    pop rcx
+
+    mov rbx, rdi               ; s8
+    mov rbp, rdx               ; d8_y
+    mov r12, r8                ; d8_uv
+
+row_loop1:
+    mov rax, rbx               ; s8
+    mov r13, rbp               ; d8_y
+    mov r14, r12               ; d8_uv
+
+    mov r15d, r10d             ; width
+    shr r15d, 5                ; doing 32 pixels at a time
+    jz done_loop1
+
+loop1:
+    ; first line
+    vmovdqu64 zmm0, [rax]
+    vmovdqu64 zmm1, [rax + 64]
+    RGB_TO_YUV32 zmm8, zmm9
+    vmovdqu [r13], ymm5        ; out 32 bytes y
+
+    ; second line
+    vmovdqu64 zmm0, [rax + rsi]
+    vmovdqu64 zmm1, [rax + rsi + 64]
+    RGB_TO_YUV32 zmm10, zmm11
+    vmovdqu [r13 + rcx], ymm5  ; out 32 bytes y
+
+    UV_AVERAGE
+    vmovdqu [r14], ymm8        ; out 32 bytes uv
+
+    ; move right
+    lea rax, [rax + 128]
+    lea r13, [r13 + 32]
+    lea r14, [r14 + 32]
+
+    dec r15d
+    jnz loop1
+
+done_loop1:
+    test r10d, 24              ; pixels left over
+    jz done_loop2
+
+    ; first line
+    vmovdqu32 zmm0{k1}{z}, [rax]
+    vmovdqu32 zmm1{k2}{z}, [rax + 64]
+    RGB_TO_YUV32 zmm8, zmm9
+    vmovdqu8 [r13]{k3}, ymm5
+
+    ; second line
+    vmovdqu32 zmm0{k1}{z}, [rax + rsi]
+    vmovdqu32 zmm1{k2}{z}, [rax + rsi + 64]
+    RGB_TO_YUV32 zmm10, zmm11
+    vmovdqu8 [r13 + rcx]{k3}, ymm5
+
+    UV_AVERAGE
+    vmovdqu8 [r14]{k3}, ymm8
+
+done_loop2:
+    ; update s8, d8_y and d8_uv
+    lea rbx, [rbx + rsi * 2]
+    lea rbp, [rbp + rcx * 2]
+    add r12, r9
+
+    dec r11d
+    jnz row_loop1
+
+done_row_loop1:
+    vzeroupper
+    mov rax, 0                 ; return value
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
@@ -0,0 +1,116 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to 8 bit BGR233
+;amd64 SSE2
+;
+; notes
+;   d = (r >> 5) | ((g >> 5) << 3) | ((b >> 6) << 6)
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+cdr times 4 dd 0x00000007
+cdg times 4 dd 0x00000038
+cdb times 4 dd 0x000000C0
+
+; in, %1 = 4 pixels
+; out, %1 = 4 dwords, ready for packssdw
+; %2 and %3 are temps
+%macro RGB233_4 3
+    movdqa %2, %1
+    psrld %2, 21
+    pand %2, [lsym(cdr)]       ; r
+    movdqa %3, %1
+    psrld %3, 10
+    pand %3, [lsym(cdg)]       ; g
+    por %2, %3
+    pand %1, [lsym(cdb)]       ; b
+    por %1, %2
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_r3g3b2_box_amd64_sse2(const char *s8, int src_stride,
+;                                  char *d8, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_r3g3b2_box_amd64_sse2
+    push rbx
+
+    movsxd rsi, esi            ; src_stride
+    movsxd rcx, ecx            ; dst_stride
+    test r9d, r9d              ; height
+    jle done_loop_y
+
+loop_y:
+    mov r10, rdi               ; s8
+    mov r11, rdx               ; d8
+    mov eax, r8d               ; width
+
+loop_x16:
+    cmp eax, 16
+    jl done_loop_x16
+
+    movdqu xmm0, [r10]         ; 4 pixels
+    RGB233_4 xmm0, xmm4, xmm5
+    movdqu xmm1, [r10 + 16]    ; 4 pixels
+    RGB233_4 xmm1, xmm4, xmm5
+    movdqu xmm2, [r10 + 32]    ; 4 pixels
+    RGB233_4 xmm2, xmm4, xmm5
+    movdqu xmm3, [r10 + 48]    ; 4 pixels
+    RGB233_4 xmm3, xmm4, xmm5
+    lea r10, [r10 + 64]
+    packssdw xmm0, xmm1
+    packssdw xmm2, xmm3
+    packuswb xmm0, xmm2
+    movdqu [r11], xmm0         ; 16 pixels
+    lea r11, [r11 + 16]
+
+    sub eax, 16
+    jmp loop_x16
+done_loop_x16:
+
+loop_x1:
+    cmp eax, 1
+    jl done_loop_x1
+
+    movd xmm0, [r10]           ; 1 pixel
+    RGB233_4 xmm0, xmm4, xmm5
+    lea r10, [r10 + 4]
+    movd ebx, xmm0
+    mov [r11], bl
+    lea r11, [r11 + 1]
+
+    dec eax
+    jmp loop_x1
+done_loop_x1:
+
+    add rdi, rsi               ; s8 += src_stride
+    add rdx, rcx               ; d8 += dst_stride
+    dec r9d
+    jnz loop_y
+
+done_loop_y:
+    mov eax, 0                 ; return value
+    pop rbx
+    ret
+END_OF_FILE
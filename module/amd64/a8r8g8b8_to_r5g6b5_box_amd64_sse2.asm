@@ -0,0 +1,114 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to RGB565
+;amd64 SSE2
+;
+; notes
+;   d = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+;   the words are sign extended before packssdw so it does not saturate
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+cdr times 4 dd 0x0000F800
+cdg times 4 dd 0x000007E0
+cdb times 4 dd 0x0000001F
+
+; in, %1 = 4 pixels
+; out, %1 = 4 dwords, sign extended
+; %2 and %3 are temps
+%macro RGB565_4 3
+    movdqa %2, %1
+    psrld %2, 8
+    pand %2, [lsym(cdr)]       ; r
+    movdqa %3, %1
+    psrld %3, 5
+    pand %3, [lsym(cdg)]       ; g
+    por %2, %3
+    psrld %1, 3
+    pand %1, [lsym(cdb)]       ; b
+    por %1, %2
+    pslld %1, 16
+    psrad %1, 16
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_r5g6b5_box_amd64_sse2(const char *s8, int src_stride,
+;                                  char *d8, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_r5g6b5_box_amd64_sse2
+    push rbx
+
+    movsxd rsi, esi            ; src_stride
+    movsxd rcx, ecx            ; dst_stride
+    test r9d, r9d              ; height
+    jle done_loop_y
+
+loop_y:
+    mov r10, rdi               ; s8
+    mov r11, rdx               ; d8
+    mov eax, r8d               ; width
+
+loop_x8:
+    cmp eax, 8
+    jl done_loop_x8
+
+    movdqu xmm0, [r10]         ; 4 pixels
+    RGB565_4 xmm0, xmm4, xmm5
+    movdqu xmm1, [r10 + 16]    ; 4 pixels
+    RGB565_4 xmm1, xmm4, xmm5
+    lea r10, [r10 + 32]
+    packssdw xmm0, xmm1
+    movdqu [r11], xmm0         ; 8 pixels
+    lea r11, [r11 + 16]
+
+    sub eax, 8
+    jmp loop_x8
+done_loop_x8:
+
+loop_x1:
+    cmp eax, 1
+    jl done_loop_x1
+
+    movd xmm0, [r10]           ; 1 pixel
+    RGB565_4 xmm0, xmm4, xmm5
+    lea r10, [r10 + 4]
+    movd ebx, xmm0
+    mov [r11], bx
+    lea r11, [r11 + 2]
+
+    dec eax
+    jmp loop_x1
+done_loop_x1:
+
+    add rdi, rsi               ; s8 += src_stride
+    add rdx, rcx               ; d8 += dst_stride
+    dec r9d
+    jnz loop_y
+
+done_loop_y:
+    mov eax, 0                 ; return value
+    pop rbx
+    ret
+END_OF_FILE
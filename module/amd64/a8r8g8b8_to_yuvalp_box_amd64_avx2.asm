@@ -0,0 +1,194 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to 64x64 linear planar YUVA, RFX tile
+;amd64 AVX2
+;
+; same math as the SSE2 version, 16 pixels at a time
+;
+; notes
+;   d8 is in the Y plane, U, V and A planes follow, each 64 * 64 bytes
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+cd255 times 8 dd 255
+cd128 times 8 dd 128
+cdrb times 8 dd 0x00FF00FF
+cwy_br times 8 dw 7471, 19595
+cwy_g times 8 dw -27066, 0
+cwu_br times 8 dw -32729, -11071
+cwu_g times 8 dw -21736, 0
+cwv_br times 8 dw -5327, 32756
+cwv_g times 8 dw -27429, 0
+
+%define PLANE 4096
+
+; in, %1 = 8 or 4 pixels
+; out, %1 = y, %2 = u, %3 = v, %4 = a, dwords, not clamped
+; %5, %6, %7 are temps, same size as %1
+%macro YUVA8 7
+    vpsrld %4, %1, 24                   ; a
+    vpand %5, %1, [lsym(cd255)]         ; b
+    vpsrld %6, %1, 8
+    vpand %6, %6, [lsym(cd255)]         ; g
+    vpand %1, %1, [lsym(cdrb)]          ; b in low word, r in high word
+
+    ; u
+    vpmaddwd %2, %1, [lsym(cwu_br)]
+    vpmaddwd %7, %6, [lsym(cwu_g)]
+    vpaddd %2, %2, %7
+    vpsrad %2, %2, 16
+    vpaddd %2, %2, %5
+    vpaddd %2, %2, [lsym(cd128)]
+
+    ; v
+    vpmaddwd %3, %1, [lsym(cwv_br)]
+    vpmaddwd %7, %6, [lsym(cwv_g)]
+    vpaddd %3, %3, %7
+    vpsrad %3, %3, 16
+    vpaddd %3, %3, [lsym(cd128)]
+
+    ; y
+    vpmaddwd %1, %1, [lsym(cwy_br)]
+    vpmaddwd %7, %6, [lsym(cwy_g)]
+    vpaddd %1, %1, %7
+    vpsrad %1, %1, 16
+    vpaddd %1, %1, %6
+%endmacro
+
+; in, %1 and %2 = 8 dwords each, %4 = low half of %1
+; out, %3 = 16 bytes, clamped
+%macro PACK16 4
+    vpackssdw %1, %1, %2
+    vpermq %1, %1, 0xD8
+    vextracti128 %3, %1, 1
+    vpackuswb %3, %4, %3
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_yuvalp_box_amd64_avx2(const char *s8, int src_stride,
+;                                  char *d8, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_yuvalp_box_amd64_avx2
+    push rbx
+
+    movsxd rsi, esi            ; src_stride
+    movsxd rcx, ecx            ; dst_stride
+    test r9d, r9d              ; height
+    jle done_loop_y
+
+loop_y:
+    mov r10, rdi               ; s8
+    mov r11, rdx               ; d8
+    mov eax, r8d               ; width
+
+loop_x16:
+    cmp eax, 16
+    jl done_loop_x16
+
+    vmovdqu ymm0, [r10]        ; 8 pixels
+    YUVA8 ymm0, ymm1, ymm2, ymm3, ymm8, ymm9, ymm10
+    vmovdqu ymm4, [r10 + 32]   ; 8 pixels
+    YUVA8 ymm4, ymm5, ymm6, ymm7, ymm8, ymm9, ymm10
+    lea r10, [r10 + 64]
+
+    PACK16 ymm0, ymm4, xmm8, xmm0
+    vmovdqu [r11], xmm8        ; 16 y
+    PACK16 ymm1, ymm5, xmm8, xmm1
+    vmovdqu [r11 + PLANE], xmm8 ; 16 u
+    PACK16 ymm2, ymm6, xmm8, xmm2
+    vmovdqu [r11 + PLANE * 2], xmm8 ; 16 v
+    PACK16 ymm3, ymm7, xmm8, xmm3
+    vmovdqu [r11 + PLANE * 3], xmm8 ; 16 a
+    lea r11, [r11 + 16]
+
+    sub eax, 16
+    jmp loop_x16
+done_loop_x16:
+
+loop_x4:
+    cmp eax, 4
+    jl done_loop_x4
+
+    vmovdqu xmm0, [r10]        ; 4 pixels
+    YUVA8 xmm0, xmm1, xmm2, xmm3, xmm8, xmm9, xmm10
+    lea r10, [r10 + 16]
+
+    vpackssdw xmm0, xmm0, xmm0
+    vpackuswb xmm0, xmm0, xmm0
+    vmovd [r11], xmm0          ; 4 y
+    vpackssdw xmm1, xmm1, xmm1
+    vpackuswb xmm1, xmm1, xmm1
+    vmovd [r11 + PLANE], xmm1  ; 4 u
+    vpackssdw xmm2, xmm2, xmm2
+    vpackuswb xmm2, xmm2, xmm2
+    vmovd [r11 + PLANE * 2], xmm2 ; 4 v
+    vpackssdw xmm3, xmm3, xmm3
+    vpackuswb xmm3, xmm3, xmm3
+    vmovd [r11 + PLANE * 3], xmm3 ; 4 a
+    lea r11, [r11 + 4]
+
+    sub eax, 4
+    jmp loop_x4
+done_loop_x4:
+
+loop_x1:
+    cmp eax, 1
+    jl done_loop_x1
+
+    vmovd xmm0, [r10]          ; 1 pixel
+    YUVA8 xmm0, xmm1, xmm2, xmm3, xmm8, xmm9, xmm10
+    lea r10, [r10 + 4]
+
+    vpackssdw xmm0, xmm0, xmm0
+    vpackuswb xmm0, xmm0, xmm0
+    vmovd ebx, xmm0
+    mov [r11], bl              ; y
+    vpackssdw xmm1, xmm1, xmm1
+    vpackuswb xmm1, xmm1, xmm1
+    vmovd ebx, xmm1
+    mov [r11 + PLANE], bl      ; u
+    vpackssdw xmm2, xmm2, xmm2
+    vpackuswb xmm2, xmm2, xmm2
+    vmovd ebx, xmm2
+    mov [r11 + PLANE * 2], bl  ; v
+    vmovd ebx, xmm3
+    mov [r11 + PLANE * 3], bl  ; a
+    lea r11, [r11 + 1]
+
+    dec eax
+    jmp loop_x1
+done_loop_x1:
+
+    add rdi, rsi               ; s8 += src_stride
+    add rdx, rcx               ; d8 += dst_stride
+    dec r9d
+    jnz loop_y
+
+done_loop_y:
+    vzeroupper
+    mov eax, 0                 ; return value
+    pop rbx
+    ret
+END_OF_FILE
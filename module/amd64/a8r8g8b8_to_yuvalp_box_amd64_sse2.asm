@@ -0,0 +1,175 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to 64x64 linear planar YUVA, RFX tile
+;amd64 SSE2
+;
+; y = (r *  19595 + g *  38470 + b *   7471) >> 16
+; u = (r * -11071 + g * -21736 + b *  32807) >> 16 + 128
+; v = (r *  32756 + g * -27429 + b *  -5327) >> 16 + 128
+; 38470 and 32807 do not fit in a signed word so
+; g * 38470 = g * -27066 + (g << 16) and
+; b * 32807 = b * -32729 + (b << 16), the << 16 part is added after the shift
+;
+; notes
+;   d8 is in the Y plane, U, V and A planes follow, each 64 * 64 bytes
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+cd255 times 4 dd 255
+cd128 times 4 dd 128
+cdrb times 4 dd 0x00FF00FF
+cwy_br times 4 dw 7471, 19595
+cwy_g times 4 dw -27066, 0
+cwu_br times 4 dw -32729, -11071
+cwu_g times 4 dw -21736, 0
+cwv_br times 4 dw -5327, 32756
+cwv_g times 4 dw -27429, 0
+
+%define PLANE 4096
+
+; in, %1 = 4 pixels
+; out, %1 = y, %2 = u, %3 = v, %4 = a, 4 dwords each, not clamped
+; uses xmm8, xmm9, xmm10
+%macro YUVA4 4
+    movdqa %4, %1
+    psrld %4, 24               ; a
+    movdqa xmm8, %1
+    pand xmm8, [lsym(cd255)]   ; b
+    movdqa xmm9, %1
+    psrld xmm9, 8
+    pand xmm9, [lsym(cd255)]   ; g
+    pand %1, [lsym(cdrb)]      ; b in low word, r in high word
+
+    ; u
+    movdqa %2, %1
+    pmaddwd %2, [lsym(cwu_br)]
+    movdqa xmm10, xmm9
+    pmaddwd xmm10, [lsym(cwu_g)]
+    paddd %2, xmm10
+    psrad %2, 16
+    paddd %2, xmm8
+    paddd %2, [lsym(cd128)]
+
+    ; v
+    movdqa %3, %1
+    pmaddwd %3, [lsym(cwv_br)]
+    movdqa xmm10, xmm9
+    pmaddwd xmm10, [lsym(cwv_g)]
+    paddd %3, xmm10
+    psrad %3, 16
+    paddd %3, [lsym(cd128)]
+
+    ; y
+    pmaddwd %1, [lsym(cwy_br)]
+    movdqa xmm10, xmm9
+    pmaddwd xmm10, [lsym(cwy_g)]
+    paddd %1, xmm10
+    psrad %1, 16
+    paddd %1, xmm9
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_yuvalp_box_amd64_sse2(const char *s8, int src_stride,
+;                                  char *d8, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_yuvalp_box_amd64_sse2
+    push rbx
+
+    movsxd rsi, esi            ; src_stride
+    movsxd rcx, ecx            ; dst_stride
+    test r9d, r9d              ; height
+    jle done_loop_y
+
+loop_y:
+    mov r10, rdi               ; s8
+    mov r11, rdx               ; d8
+    mov eax, r8d               ; width
+
+loop_x8:
+    cmp eax, 8
+    jl done_loop_x8
+
+    movdqu xmm0, [r10]         ; 4 pixels
+    YUVA4 xmm0, xmm1, xmm2, xmm3
+    movdqu xmm4, [r10 + 16]    ; 4 pixels
+    YUVA4 xmm4, xmm5, xmm6, xmm7
+    lea r10, [r10 + 32]
+
+    packssdw xmm0, xmm4
+    packuswb xmm0, xmm0
+    movq [r11], xmm0           ; 8 y
+    packssdw xmm1, xmm5
+    packuswb xmm1, xmm1
+    movq [r11 + PLANE], xmm1   ; 8 u
+    packssdw xmm2, xmm6
+    packuswb xmm2, xmm2
+    movq [r11 + PLANE * 2], xmm2 ; 8 v
+    packssdw xmm3, xmm7
+    packuswb xmm3, xmm3
+    movq [r11 + PLANE * 3], xmm3 ; 8 a
+    lea r11, [r11 + 8]
+
+    sub eax, 8
+    jmp loop_x8
+done_loop_x8:
+
+loop_x1:
+    cmp eax, 1
+    jl done_loop_x1
+
+    movd xmm0, [r10]           ; 1 pixel
+    YUVA4 xmm0, xmm1, xmm2, xmm3
+    lea r10, [r10 + 4]
+
+    packssdw xmm0, xmm0
+    packuswb xmm0, xmm0
+    movd ebx, xmm0
+    mov [r11], bl              ; y
+    packssdw xmm1, xmm1
+    packuswb xmm1, xmm1
+    movd ebx, xmm1
+    mov [r11 + PLANE], bl      ; u
+    packssdw xmm2, xmm2
+    packuswb xmm2, xmm2
+    movd ebx, xmm2
+    mov [r11 + PLANE * 2], bl  ; v
+    movd ebx, xmm3
+    mov [r11 + PLANE * 3], bl  ; a
+    lea r11, [r11 + 1]
+
+    dec eax
+    jmp loop_x1
+done_loop_x1:
+
+    add rdi, rsi               ; s8 += src_stride
+    add rdx, rcx               ; d8 += dst_stride
+    dec r9d
+    jnz loop_y
+
+done_loop_y:
+    mov eax, 0                 ; return value
+    pop rbx
+    ret
+END_OF_FILE
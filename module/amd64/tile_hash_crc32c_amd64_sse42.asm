@@ -0,0 +1,92 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;64 bit tile hash from four hardware CRC32C streams
+;amd64 SSE4.2
+;
+; notes
+;   crc32 has a latency of 3 and a throughput of 1 so four independent
+;   streams keep the unit busy
+;   crc is linear, streams 1 and 3 add in streams 0 and 2 each round so
+;   the high 32 bits are not a function of the low 32 bits for repeating
+;   data like solid fills
+;   hash is the running hash, pass 0 to start, the return can be passed
+;   back in to hash more data
+
+%include "common.asm"
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;uint64_t
+;tile_hash_crc32c_amd64_sse42(uint64_t hash, const void *data,
+;                             int data_bytes);
+PROC tile_hash_crc32c_amd64_sse42
+    not rdi
+    mov eax, edi               ; stream 0
+    shr rdi, 32
+    mov ecx, edi               ; stream 1
+    mov r8d, eax               ; stream 2
+    not r8d
+    mov r9d, ecx               ; stream 3
+    not r9d
+    movsxd rdx, edx            ; data_bytes
+
+loop_x32:
+    cmp rdx, 32
+    jl done_loop_x32
+    crc32 rax, qword [rsi]
+    crc32 rcx, qword [rsi + 8]
+    crc32 r8, qword [rsi + 16]
+    crc32 r9, qword [rsi + 24]
+    add ecx, eax
+    add r9d, r8d
+    lea rsi, [rsi + 32]
+    sub rdx, 32
+    jmp loop_x32
+done_loop_x32:
+
+    ; fold stream 3 into 0 and 2 into 1, 2 into 0 would cancel for
+    ; repeating data
+    crc32 eax, r9d
+    crc32 ecx, r8d
+
+loop_x8:
+    cmp rdx, 8
+    jl done_loop_x8
+    crc32 rax, qword [rsi]
+    lea rsi, [rsi + 8]
+    sub rdx, 8
+    jmp loop_x8
+done_loop_x8:
+
+loop_x1:
+    cmp rdx, 1
+    jl done_loop_x1
+    crc32 eax, byte [rsi]
+    lea rsi, [rsi + 1]
+    dec rdx
+    jmp loop_x1
+done_loop_x1:
+
+    shl rcx, 32
+    or rax, rcx
+    not rax                    ; return value
+    ret
+END_OF_FILE
@@ -0,0 +1,137 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;UYVY to RGB32
+;amd64 AVX2
+;
+; same math as the SSE2 version, 16 pixels at a time
+
+%include "common.asm"
+
+PREPARE_RODATA
+c128 times 16 dw 128
+c4669 times 16 dw 4669
+c1616 times 16 dw 1616
+c2378 times 16 dw 2378
+c9324 times 16 dw 9324
+
+; in, ymm0 = 16 y words, ymm1, ymm2 = 16 (uv - 128) << 4 words
+; out, ymm3 = 8 argb pixels, ymm4 = 8 argb pixels
+%macro YUV_TO_RGB16 0
+    ; r = y + hiword(4669 * (v << 4))
+    vpmulhw ymm4, ymm1, [lsym(c4669)]
+    vpaddw ymm3, ymm0, ymm4
+
+    ; g = y - hiword(1616 * (u << 4)) - hiword(2378 * (v << 4))
+    vpmulhw ymm5, ymm2, [lsym(c1616)]
+    vpmulhw ymm6, ymm1, [lsym(c2378)]
+    vpsubw ymm4, ymm0, ymm5
+    vpsubw ymm4, ymm4, ymm6
+
+    ; b = y + hiword(9324 * (u << 4))
+    vpmulhw ymm6, ymm2, [lsym(c9324)]
+    vpaddw ymm5, ymm0, ymm6
+
+    vpackuswb ymm3, ymm3, ymm3     ; b
+    vpackuswb ymm4, ymm4, ymm4     ; g
+    vpunpcklbw ymm3, ymm3, ymm4    ; gb
+    vpackuswb ymm5, ymm5, ymm5     ; r
+    vpunpcklbw ymm5, ymm5, ymm15   ; ar
+
+    vpunpcklwd ymm4, ymm3, ymm5    ; argb, pixels 0 - 3 and 8 - 11
+    vpunpckhwd ymm5, ymm3, ymm5    ; argb, pixels 4 - 7 and 12 - 15
+    vperm2i128 ymm3, ymm4, ymm5, 0x20 ; pixels 0 - 7
+    vperm2i128 ymm4, ymm4, ymm5, 0x31 ; pixels 8 - 15
+%endmacro
+
+; in, ymm0 = 16 pixels, uyvy
+; out, ymm0 = y words, ymm1 = u words, ymm2 = v words
+%macro SPLIT_YUV16 0
+    ; hi                                           lo
+    ; y7 v3 y6 u3 y5 v2 y4 u2 y3 v1 y2 u1 y1 v0 y0 u0
+
+    ; 00 y7 00 y6 00 y5 00 y4 00 y3 00 y2 00 y1 00 y0
+    ; 00 u3 00 u3 00 u2 00 u2 00 u1 00 u1 00 u0 00 u0
+    ; 00 v3 00 v3 00 v2 00 v2 00 v1 00 v1 00 v0 00 v0
+
+    ; u
+    vpslld ymm1, ymm0, 24
+    vpsrld ymm1, ymm1, 24
+    vpslld ymm3, ymm1, 16
+    vpor ymm1, ymm1, ymm3
+    vpsubw ymm1, ymm1, ymm7
+    vpsllw ymm1, ymm1, 4
+
+    ; v
+    vpslld ymm2, ymm0, 8
+    vpsrld ymm2, ymm2, 24
+    vpslld ymm3, ymm2, 16
+    vpor ymm2, ymm2, ymm3
+    vpsubw ymm2, ymm2, ymm7
+    vpsllw ymm2, ymm2, 4
+
+    ; y
+    vpsrlw ymm0, ymm0, 8
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;uyvy_to_rgb32_amd64_avx2(unsigned char *yuvs, int width, int height, int *rgbs)
+
+PROC uyvy_to_rgb32_amd64_avx2
+    movsxd rax, esi
+    movsxd rdx, edx
+    imul rax, rdx               ; rax = width * height
+    mov rsi, rdi
+    mov rdi, rcx
+
+    vmovdqu ymm7, [lsym(c128)]
+    vpxor ymm15, ymm15, ymm15
+
+loop1:
+    cmp rax, 16
+    jl done_loop1
+
+    vmovdqu ymm0, [rsi]         ; 16 pixels at a time
+    lea rsi, [rsi + 32]
+    SPLIT_YUV16
+    YUV_TO_RGB16
+    vmovdqu [rdi], ymm3         ; 8 pixels
+    vmovdqu [rdi + 32], ymm4    ; 8 pixels
+    lea rdi, [rdi + 64]
+
+    sub rax, 16
+    jmp loop1
+
+done_loop1:
+    cmp rax, 8
+    jl done_loop2
+
+    vmovdqu xmm0, [rsi]         ; 8 pixels
+    SPLIT_YUV16
+    YUV_TO_RGB16
+    vmovdqu [rdi], ymm3         ; 8 pixels
+
+done_loop2:
+    vzeroupper
+    mov rax, 0
+    ret
+END_OF_FILE
@@ -0,0 +1,180 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;YV12 to RGB32
+;amd64 AVX2
+;
+; same math as the SSE2 version, 16 pixels at a time
+; width should be multiple of 8 and > 0
+; height should be even and > 0
+
+%include "common.asm"
+
+PREPARE_RODATA
+c128 times 16 dw 128
+c4669 times 16 dw 4669
+c1616 times 16 dw 1616
+c2378 times 16 dw 2378
+c9324 times 16 dw 9324
+
+; in, ymm0 = 16 y words, ymm1, ymm2 = 16 (uv - 128) << 4 words
+; out, ymm3 = 8 argb pixels, ymm4 = 8 argb pixels
+%macro YUV_TO_RGB16 0
+    ; r = y + hiword(4669 * (v << 4))
+    vpmulhw ymm4, ymm2, [lsym(c4669)]
+    vpaddw ymm3, ymm0, ymm4
+
+    ; g = y - hiword(1616 * (u << 4)) - hiword(2378 * (v << 4))
+    vpmulhw ymm5, ymm1, [lsym(c1616)]
+    vpmulhw ymm6, ymm2, [lsym(c2378)]
+    vpsubw ymm4, ymm0, ymm5
+    vpsubw ymm4, ymm4, ymm6
+
+    ; b = y + hiword(9324 * (u << 4))
+    vpmulhw ymm6, ymm1, [lsym(c9324)]
+    vpaddw ymm5, ymm0, ymm6
+
+    vpackuswb ymm3, ymm3, ymm3     ; b
+    vpackuswb ymm4, ymm4, ymm4     ; g
+    vpunpcklbw ymm3, ymm3, ymm4    ; gb
+    vpackuswb ymm5, ymm5, ymm5     ; r
+    vpunpcklbw ymm5, ymm5, ymm15   ; ar
+
+    vpunpcklwd ymm4, ymm3, ymm5    ; argb, pixels 0 - 3 and 8 - 11
+    vpunpckhwd ymm5, ymm3, ymm5    ; argb, pixels 4 - 7 and 12 - 15
+    vperm2i128 ymm3, ymm4, ymm5, 0x20 ; pixels 0 - 7
+    vperm2i128 ymm4, ymm4, ymm5, 0x31 ; pixels 8 - 15
+%endmacro
+
+; in, %2 = 8 u or v bytes
+; out, %1 = 16 (uv - 128) << 4 words
+%macro UV_EXPAND 2
+    vpunpcklbw %2, %2, %2
+    vpmovzxbw %1, %2
+    vpsubw %1, %1, [lsym(c128)]
+    vpsllw %1, %1, 4
+%endmacro
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;yv12_to_rgb32_amd64_avx2(unsigned char *yuvs, int width, int height, int *rgbs)
+
+PROC yv12_to_rgb32_amd64_avx2
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+
+    movsxd r8, esi              ; width
+    mov r9d, edx
+    shr r9d, 1                  ; height, doing 2 lines at a time
+    jz done_loop_y
+
+    mov rax, r8
+    imul rax, rdx               ; rax = width * height
+    mov r10, rdi                ; y
+    lea r11, [rdi + rax]        ; u = y + width * height
+    shr rax, 2
+    lea r12, [r11 + rax]        ; v = u + (width * height / 4)
+    mov r13, rcx                ; rgbs
+    lea r14, [r8 * 4]           ; rgbs stride
+
+    vpxor ymm15, ymm15, ymm15
+
+loop_y:
+    mov rax, r10                ; y
+    mov rbx, r11                ; u
+    mov rbp, r12                ; v
+    mov rdi, r13                ; rgbs
+
+    mov ecx, r8d
+    shr ecx, 4                  ; doing 16 pixels at a time
+    jz done_loop_x
+
+loop_x:
+    vmovq xmm1, [rbx]           ; u, 8 at a time
+    lea rbx, [rbx + 8]
+    UV_EXPAND ymm1, xmm1
+    vmovq xmm2, [rbp]           ; v, 8 at a time
+    lea rbp, [rbp + 8]
+    UV_EXPAND ymm2, xmm2
+
+    ; y1
+    vpmovzxbw ymm0, [rax]       ; 16 at a time
+    YUV_TO_RGB16
+    vmovdqu [rdi], ymm3
+    vmovdqu [rdi + 32], ymm4
+
+    ; y2
+    vpmovzxbw ymm0, [rax + r8]  ; 16 at a time
+    YUV_TO_RGB16
+    vmovdqu [rdi + r14], ymm3
+    vmovdqu [rdi + r14 + 32], ymm4
+
+    lea rax, [rax + 16]
+    lea rdi, [rdi + 64]
+    dec ecx
+    jnz loop_x
+
+done_loop_x:
+    test r8d, 8                 ; 8 pixels left over
+    jz done_loop_x8
+
+    vmovd xmm1, [rbx]           ; u, 4 at a time
+    UV_EXPAND ymm1, xmm1
+    vmovd xmm2, [rbp]           ; v, 4 at a time
+    UV_EXPAND ymm2, xmm2
+
+    ; y1
+    vmovq xmm0, [rax]           ; 8 at a time
+    vpmovzxbw ymm0, xmm0
+    YUV_TO_RGB16
+    vmovdqu [rdi], ymm3
+
+    ; y2
+    vmovq xmm0, [rax + r8]      ; 8 at a time
+    vpmovzxbw ymm0, xmm0
+    YUV_TO_RGB16
+    vmovdqu [rdi + r14], ymm3
+
+done_loop_x8:
+    ; next 2 lines
+    lea r10, [r10 + r8 * 2]     ; y
+    mov rax, r8
+    shr rax, 1
+    add r11, rax                ; u
+    add r12, rax                ; v
+    lea r13, [r13 + r14 * 2]    ; rgbs
+
+    dec r9d
+    jnz loop_y
+
+done_loop_y:
+    vzeroupper
+    mov rax, 0
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
@@ -71,6 +71,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define XRDP_RFX_ALIGN 64
 #define XRDP_H264_ALIGN 16
 
+/* AVC444 capture_format, until xrdp_client_info.h has one
+   four planes, stride is the width, height aligned to 16
+     main y, height lines
+     main uv, height / 2 lines, same as XRDP_nv12
+     auxiliary y, height lines, in groups of 16, 8 lines of u then 8
+                  lines of v of the odd lines
+     auxiliary uv, height / 2 lines, u and v of the odd pixels of the
+                   even lines */
+#ifndef XRDP_nv12_avc444
+#define XRDP_nv12_avc444 0x34343441 /* 'A444' */
+#endif
+
 #define XRDP_CD_NODRAW 0
 #define XRDP_CD_NOCLIP 1
 #define XRDP_CD_CLIP   2
@@ -204,6 +216,15 @@ typedef int (*copy_box_dst2_proc)(const uint8_t *s8, int src_stride,
                                   uint8_t *d8_y, int dst_stride_y,
                                   uint8_t *d8_uv, int dst_stride_uv,
                                   int width, int height);
+/* main and auxiliary AVC444 views, see a8r8g8b8_to_avc444_box */
+typedef int (*copy_box_avc444_proc)(const uint8_t *s8, int src_stride,
+                                    uint8_t *d8_y, uint8_t *d8_uv,
+                                    uint8_t *d8_aux_u, uint8_t *d8_aux_v,
+                                    uint8_t *d8_aux_uv, int dst_stride,
+                                    int width, int height);
+/* pass 0 to start, the return can be passed back in to hash more data */
+typedef uint64_t (*tile_hash_proc)(uint64_t hash, const void *data,
+                                   int data_bytes);
 
 /* move this to common header */
 struct _rdpRec
@@ -219,6 +240,11 @@ struct _rdpRec
     int Bpp_mask;
     uint8_t *pfbMemory_alloc;
     uint8_t *pfbMemory;
+    /* with FramebufferShared, pfbMemory is a memfd mapping */
+    int fb_shared; /* from xorg.conf FramebufferShared */
+    int pfbMemory_fd; /* -1 when pfbMemory is not shared */
+    int pfbMemory_bytes;
+    int fb_generation; /* bumped each time pfbMemory moves */
     ScreenPtr pScreen;
     rdpDevPrivateKey privateKeyRecGC;
     rdpDevPrivateKey privateKeyRecPixmap;
@@ -234,6 +260,7 @@ struct _rdpRec
     TrapezoidsProcPtr Trapezoids;
     CreateScreenResourcesProcPtr CreateScreenResources;
     TrianglesProcPtr Triangles;
+    AddTrapsProcPtr AddTraps;
     CompositeRectsProcPtr CompositeRects;
 
     /* keyboard and mouse */
@@ -296,7 +323,38 @@ struct _rdpRec
     OsTimerPtr xv_timer;
 
     copy_box_proc a8r8g8b8_to_a8b8g8r8_box;
+    /* plain copy with non temporal stores, NULL if there is none */
+    copy_box_proc a8r8g8b8_to_a8r8g8b8_box_nt;
     copy_box_dst2_proc a8r8g8b8_to_nv12_box;
+    copy_box_avc444_proc a8r8g8b8_to_avc444_box;
+    /* d8 is the Y plane of a 64x64 RFX tile, U, V and A planes follow */
+    copy_box_proc a8r8g8b8_to_yuvalp_box;
+    copy_box_proc a8r8g8b8_to_r5g6b5_box;
+    copy_box_proc a8r8g8b8_to_a1r5g5b5_box;
+    copy_box_proc a8r8g8b8_to_r3g3b2_box;
+    tile_hash_proc tile_hash;
+    int simd_level_max; /* RDP_SIMD_*, from xorg.conf SIMDLevel */
+    int simd_level; /* RDP_SIMD_*, what rdpSimdInit assigned */
+
+    /* capture threads */
+    int capture_threads; /* from xorg.conf CaptureThreads, 0 is auto */
+    int capture_numa; /* from xorg.conf CaptureNUMA */
+    struct rdp_workers *capture_workers; /* NULL when single threaded */
+    int capture_async; /* from xorg.conf CaptureAsync */
+    /* capture buffers for each client, and frames in flight, from
+       xorg.conf CaptureFrames */
+    int capture_frames;
+    /* limits of the frame pacing, from xorg.conf FrameRateMin and
+       FrameRateMax */
+    int frame_rate_min;
+    int frame_rate_max;
+    /* seconds between pacing stats in the log, 0 is off, from xorg.conf
+       StatsInterval */
+    int stats_interval_s;
+    /* copies of at least this many bytes use
+       a8r8g8b8_to_a8r8g8b8_box_nt, 0 never, from xorg.conf CaptureNTBytes
+       or measured by rdpSimdTuneNT, -1 until then */
+    int capture_nt_bytes;
 
     /* multimon */
     struct monitor_info minfo[16]; /* client monitor data */
@@ -304,6 +362,9 @@ struct _rdpRec
     int monitorCount;
     /* glamor */
     Bool glamor;
+    /* glamor draws, damage comes from the Damage extension and the GC and
+       picture wrappers are not installed, else only from the wrappers */
+    Bool damage_ext;
     PixmapPtr screenSwPixmap;
     void *xvPutImage;
     /* dri */
@@ -45,6 +45,7 @@ capture
 #include "rdpReg.h"
 #include "rdpMisc.h"
 #include "rdpCapture.h"
+#include "rdpWorkers.h"
 
 #if defined(XORGXRDP_GLAMOR)
 #include "rdpEgl.h"
@@ -55,6 +56,77 @@ capture
 #define LLOGLN(_level, _args) \
     do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
 
+/* rows in each item when rects are split over the worker threads,
+   even so nv12 chroma rows are not shared */
+#define RDP_CAPTURE_BAND_HEIGHT 64
+/* smaller captures are done on the X server thread alone */
+#define RDP_CAPTURE_MIN_THREAD_PIXELS (256 * 256)
+#define RDP_CAPTURE_MIN_THREAD_TILES 8
+
+/* all the rdpCopyBox_a8r8g8b8_to_* functions that use one dst */
+typedef int (*copy_boxes_proc)(rdpClientCon *clientCon,
+                               const uint8_t *src, int src_stride,
+                               int srcx, int srcy,
+                               uint8_t *dst, int dst_stride,
+                               int dstx, int dsty,
+                               BoxPtr rects, int num_rects);
+
+/* rdpCapture0 and rdpCapture3 */
+struct rdp_copy_job
+{
+    rdpClientCon *clientCon;
+    copy_boxes_proc copy_boxes;
+    const uint8_t *src;
+    int src_stride;
+    uint8_t *dst;
+    int dst_stride;
+    BoxPtr bands;
+};
+
+/* rdpCapture2, one per 64x64 tile */
+struct rdp_tile_job
+{
+    BoxRec rect;
+    RegionRec reg; /* dirty part of rect */
+    int rcode;
+    uint64_t *hash; /* in clientCon->rfx_tile_hashes */
+    int changed;
+};
+
+/* rdpCapture3, one item per macroblock row */
+struct rdp_mb_job
+{
+    rdpClientCon *clientCon;
+    copy_boxes_proc copy_boxes;
+    const uint8_t *src;
+    int src_stride;
+    uint8_t *dst;
+    int dst_stride;
+    BoxRec mon; /* monitor in screen coordinates */
+    int mb_cols;
+    int row_pass; /* -1 all rows, else only rows of this parity */
+    uint8_t *mb_state; /* RDP_MB_*, one for each macroblock */
+    uint64_t *hashes; /* in clientCon->mb_hashes */
+};
+
+#define RDP_MB_SIZE 16
+#define RDP_MB_CLEAN 0
+#define RDP_MB_DIRTY 1
+#define RDP_MB_CHANGED 2
+/* with more runs of changed macroblocks than this, rdpCapture3 sends one
+   span per macroblock row */
+#define RDP_MAX_MB_RECTS 1024
+
+struct rdp_tiles_job
+{
+    rdpClientCon *clientCon;
+    const uint8_t *src;
+    int src_stride;
+    uint8_t *dst;
+    int dst_stride;
+    struct rdp_tile_job *tiles;
+};
+
 #define RGB_SPLIT(A, R, G, B, pixel) \
     A = (pixel >> 24) & UCHAR_MAX; \
     R = (pixel >> 16) & UCHAR_MAX; \
@@ -75,6 +147,7 @@ rdpCopyBox_a8r8g8b8_to_a8r8g8b8(rdpClientCon *clientCon,
     int jndex;
     int bytes;
     int height;
+    int nt_bytes;
     BoxPtr box;
 
     for (index = 0; index < num_rects; index++)
@@ -87,6 +160,16 @@ rdpCopyBox_a8r8g8b8_to_a8r8g8b8(rdpClientCon *clientCon,
         bytes = box->x2 - box->x1;
         bytes *= 4;
         height = box->y2 - box->y1;
+        nt_bytes = clientCon->dev->capture_nt_bytes;
+        if ((nt_bytes > 0) && (bytes * height >= nt_bytes))
+        {
+            /* big copies bypass the cache, the X server does not read
+               the shared memory back */
+            clientCon->dev->a8r8g8b8_to_a8r8g8b8_box_nt(s8, src_stride,
+                                                        d8, dst_stride,
+                                                        bytes / 4, height);
+            continue;
+        }
         for (jndex = 0; jndex < height; jndex++)
         {
             g_memcpy(d8, s8, bytes);
@@ -108,8 +191,8 @@ rdpFillBox_yuvalp(int ax, int ay,
 }
 
 /******************************************************************************/
-/* copy rects with no error checking
- * convert ARGB32 to 64x64 linear planar YUVA */
+/* convert ARGB32 to 64x64 linear planar YUVA
+ * d8 is in the Y plane, U, V and A planes follow, each 64 * 64 bytes */
 /* http://msdn.microsoft.com/en-us/library/ff635643.aspx
  * 0.299   -0.168935    0.499813
  * 0.587   -0.331665   -0.418531
@@ -120,24 +203,18 @@ rdpFillBox_yuvalp(int ax, int ay,
 /* 19595  38470   7471
   -11071 -21736  32807
    32756 -27429  -5327 */
-static int
-rdpCopyBox_a8r8g8b8_to_yuvalp(int ax, int ay,
-                              const uint8_t *src, int src_stride,
-                              uint8_t *dst, int dst_stride,
-                              BoxPtr rects, int num_rects)
+int
+a8r8g8b8_to_yuvalp_box(const uint8_t *s8, int src_stride,
+                       uint8_t *d8, int dst_stride,
+                       int width, int height)
 {
-    const uint8_t *s8;
-    uint8_t *d8;
     uint8_t *yptr;
     uint8_t *uptr;
     uint8_t *vptr;
     uint8_t *aptr;
     const uint32_t *s32;
-    int index;
     int jndex;
     int kndex;
-    int width;
-    int height;
     uint32_t pixel;
     uint8_t a;
     int r;
@@ -146,8 +223,57 @@ rdpCopyBox_a8r8g8b8_to_yuvalp(int ax, int ay,
     int y;
     int u;
     int v;
+
+    for (jndex = 0; jndex < height; jndex++)
+    {
+        s32 = (const uint32_t *) s8;
+        yptr = d8;
+        uptr = yptr + 64 * 64;
+        vptr = uptr + 64 * 64;
+        aptr = vptr + 64 * 64;
+        kndex = 0;
+        while (kndex < width)
+        {
+            pixel = *(s32++);
+            RGB_SPLIT(a, r, g, b, pixel);
+            y = (r *  19595 + g *  38470 + b *   7471) >> 16;
+            u = (r * -11071 + g * -21736 + b *  32807) >> 16;
+            v = (r *  32756 + g * -27429 + b *  -5327) >> 16;
+            u = u + 128;
+            v = v + 128;
+            y = RDPCLAMP(y, 0, UCHAR_MAX);
+            u = RDPCLAMP(u, 0, UCHAR_MAX);
+            v = RDPCLAMP(v, 0, UCHAR_MAX);
+            *(yptr++) = y;
+            *(uptr++) = u;
+            *(vptr++) = v;
+            *(aptr++) = a;
+            kndex++;
+        }
+        d8 += dst_stride;
+        s8 += src_stride;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* copy rects with no error checking
+ * convert ARGB32 to 64x64 linear planar YUVA */
+static int
+rdpCopyBox_a8r8g8b8_to_yuvalp(rdpClientCon *clientCon, int ax, int ay,
+                              const uint8_t *src, int src_stride,
+                              uint8_t *dst, int dst_stride,
+                              BoxPtr rects, int num_rects)
+{
+    const uint8_t *s8;
+    uint8_t *d8;
+    int index;
+    int width;
+    int height;
     BoxPtr box;
+    copy_box_proc copy_box;
 
+    copy_box = clientCon->dev->a8r8g8b8_to_yuvalp_box;
     dst = dst + (ay << 8) * (dst_stride >> 8) + (ax << 8);
     for (index = 0; index < num_rects; index++)
     {
@@ -158,37 +284,39 @@ rdpCopyBox_a8r8g8b8_to_yuvalp(int ax, int ay,
         d8 += box->x1 - ax;
         width = box->x2 - box->x1;
         height = box->y2 - box->y1;
+        copy_box(s8, src_stride, d8, 64, width, height);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* hash the source pixels of rects, no error checking */
+static uint64_t
+rdpHashBox_a8r8g8b8(tile_hash_proc tile_hash, uint64_t hash,
+                    const uint8_t *src, int src_stride,
+                    BoxPtr rects, int num_rects)
+{
+    const uint8_t *s8;
+    int index;
+    int jndex;
+    int width;
+    int height;
+    BoxPtr box;
+
+    for (index = 0; index < num_rects; index++)
+    {
+        box = rects + index;
+        s8 = src + box->y1 * src_stride;
+        s8 += box->x1 * 4;
+        width = box->x2 - box->x1;
+        height = box->y2 - box->y1;
         for (jndex = 0; jndex < height; jndex++)
         {
-            s32 = (const uint32_t *) s8;
-            yptr = d8;
-            uptr = yptr + 64 * 64;
-            vptr = uptr + 64 * 64;
-            aptr = vptr + 64 * 64;
-            kndex = 0;
-            while (kndex < width)
-            {
-                pixel = *(s32++);
-                RGB_SPLIT(a, r, g, b, pixel);
-                y = (r *  19595 + g *  38470 + b *   7471) >> 16;
-                u = (r * -11071 + g * -21736 + b *  32807) >> 16;
-                v = (r *  32756 + g * -27429 + b *  -5327) >> 16;
-                u = u + 128;
-                v = v + 128;
-                y = RDPCLAMP(y, 0, UCHAR_MAX);
-                u = RDPCLAMP(u, 0, UCHAR_MAX);
-                v = RDPCLAMP(v, 0, UCHAR_MAX);
-                *(yptr++) = y;
-                *(uptr++) = u;
-                *(vptr++) = v;
-                *(aptr++) = a;
-                kndex++;
-            }
-            d8 += 64;
+            hash = tile_hash(hash, s8, width * 4);
             s8 += src_stride;
         }
     }
-    return 0;
+    return hash;
 }
 
 /******************************************************************************/
@@ -300,7 +428,7 @@ rdpCopyBox_a8r8g8b8_to_r5g6b5(rdpClientCon *clientCon,
     BoxPtr box;
     copy_box_proc copy_box;
 
-    copy_box = a8r8g8b8_to_r5g6b5_box; /* TODO, simd */
+    copy_box = clientCon->dev->a8r8g8b8_to_r5g6b5_box;
     for (index = 0; index < num_rects; index++)
     {
         box = rects + index;
@@ -362,7 +490,7 @@ rdpCopyBox_a8r8g8b8_to_a1r5g5b5(rdpClientCon *clientCon,
     BoxPtr box;
     copy_box_proc copy_box;
 
-    copy_box = a8r8g8b8_to_a1r5g5b5_box; /* TODO, simd */
+    copy_box = clientCon->dev->a8r8g8b8_to_a1r5g5b5_box;
     for (index = 0; index < num_rects; index++)
     {
         box = rects + index;
@@ -424,7 +552,7 @@ rdpCopyBox_a8r8g8b8_to_r3g3b2(rdpClientCon *clientCon,
     BoxPtr box;
     copy_box_proc copy_box;
 
-    copy_box = a8r8g8b8_to_r3g3b2_box; /* TODO, simd */
+    copy_box = clientCon->dev->a8r8g8b8_to_r3g3b2_box;
     for (index = 0; index < num_rects; index++)
     {
         box = rects + index;
@@ -551,6 +679,7 @@ rdpCopyBox_a8r8g8b8_to_nv12(rdpClientCon *clientCon,
     uint8_t *d8_uv;
     int index;
     int width;
+    int simd_width;
     int height;
     BoxPtr box;
 
@@ -565,14 +694,267 @@ rdpCopyBox_a8r8g8b8_to_nv12(rdpClientCon *clientCon,
         d8_uv += (box->x1 - dstx) * 1;
         width = box->x2 - box->x1;
         height = box->y2 - box->y1;
-        clientCon->dev->a8r8g8b8_to_nv12_box(s8, src_stride,
-                                             d8_y, dst_stride_y,
-                                             d8_uv, dst_stride_uv,
-                                             width, height);
+        /* the simd versions do 8 pixels at a time, macroblocks at the
+           right edge of a monitor can be narrower */
+        simd_width = width & ~7;
+        if (simd_width > 0)
+        {
+            clientCon->dev->a8r8g8b8_to_nv12_box(s8, src_stride,
+                                                 d8_y, dst_stride_y,
+                                                 d8_uv, dst_stride_uv,
+                                                 simd_width, height);
+        }
+        if (width > simd_width)
+        {
+            a8r8g8b8_to_nv12_box(s8 + simd_width * 4, src_stride,
+                                 d8_y + simd_width, dst_stride_y,
+                                 d8_uv + simd_width, dst_stride_uv,
+                                 width - simd_width, height);
+        }
     }
     return 0;
 }
 
+/******************************************************************************/
+/* copy_boxes_proc for the capture buffer, uv plane follows the y plane */
+static int
+rdpCopyBox_a8r8g8b8_to_nv12_cap(rdpClientCon *clientCon,
+                                const uint8_t *src, int src_stride, int srcx, int srcy,
+                                uint8_t *dst, int dst_stride, int dstx, int dsty,
+                                BoxPtr rects, int num_rects)
+{
+    uint8_t *dst_uv;
+
+    dst_uv = dst + clientCon->cap_width * clientCon->cap_height;
+    return rdpCopyBox_a8r8g8b8_to_nv12(clientCon,
+                                       src, src_stride, srcx, srcy,
+                                       dst, dst_stride,
+                                       dst_uv, dst_stride,
+                                       dstx, dsty,
+                                       rects, num_rects);
+}
+
+/******************************************************************************/
+/* AVC444, main view is the same as a8r8g8b8_to_nv12_box, the auxiliary
+   view gets, for each pair of lines, u and v of the second line in
+   d8_aux_u and d8_aux_v and u and v of the odd pixels of the first line
+   in d8_aux_uv */
+int
+a8r8g8b8_to_avc444_box(const uint8_t *s8, int src_stride,
+                       uint8_t *d8_y, uint8_t *d8_uv,
+                       uint8_t *d8_aux_u, uint8_t *d8_aux_v,
+                       uint8_t *d8_aux_uv, int dst_stride,
+                       int width, int height)
+{
+    int index;
+    int jndex;
+    int kndex;
+    int R;
+    int G;
+    int B;
+    int Y[4];
+    int U[4];
+    int V[4];
+    int pixel;
+    const uint32_t *s32a;
+    const uint32_t *s32b;
+    uint8_t *d8ya;
+    uint8_t *d8yb;
+    uint8_t *d8uv;
+    uint8_t *d8au;
+    uint8_t *d8av;
+    uint8_t *d8auv;
+
+    for (jndex = 0; jndex < height; jndex += 2)
+    {
+        s32a = (const uint32_t *) (s8 + src_stride * jndex);
+        s32b = (const uint32_t *) (s8 + src_stride * (jndex + 1));
+        d8ya = d8_y + dst_stride * jndex;
+        d8yb = d8_y + dst_stride * (jndex + 1);
+        d8uv = d8_uv + dst_stride * (jndex / 2);
+        d8au = d8_aux_u + dst_stride * (jndex / 2);
+        d8av = d8_aux_v + dst_stride * (jndex / 2);
+        d8auv = d8_aux_uv + dst_stride * (jndex / 2);
+        for (index = 0; index < width; index += 2)
+        {
+            /* 0, 1 first line, 2, 3 second line */
+            for (kndex = 0; kndex < 4; kndex++)
+            {
+                pixel = kndex < 2 ? s32a[index + kndex] :
+                        s32b[index + kndex - 2];
+                R = (pixel >> 16) & 0xff;
+                G = (pixel >>  8) & 0xff;
+                B = (pixel >>  0) & 0xff;
+                Y[kndex] = (( 66 * R + 129 * G +  25 * B + 128) >> 8) +  16;
+                U[kndex] = ((-38 * R -  74 * G + 112 * B + 128) >> 8) + 128;
+                V[kndex] = ((112 * R -  94 * G -  18 * B + 128) >> 8) + 128;
+                Y[kndex] = RDPCLAMP(Y[kndex], 0, 255);
+                U[kndex] = RDPCLAMP(U[kndex], 0, 255);
+                V[kndex] = RDPCLAMP(V[kndex], 0, 255);
+            }
+            d8ya[index] = Y[0];
+            d8ya[index + 1] = Y[1];
+            d8yb[index] = Y[2];
+            d8yb[index + 1] = Y[3];
+            d8uv[index] = (U[0] + U[1] + U[2] + U[3] + 2) / 4;
+            d8uv[index + 1] = (V[0] + V[1] + V[2] + V[3] + 2) / 4;
+            d8au[index] = U[2];
+            d8au[index + 1] = U[3];
+            d8av[index] = V[2];
+            d8av[index + 1] = V[3];
+            d8auv[index] = U[1];
+            d8auv[index + 1] = V[1];
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* copy_boxes_proc for the AVC444 capture buffer, see XRDP_nv12_avc444
+   the u and v lines of the auxiliary y plane are 8 apart, a call to the
+   simd version covers at most one 16 line group so they are linear */
+static int
+rdpCopyBox_a8r8g8b8_to_avc444_cap(rdpClientCon *clientCon,
+                                  const uint8_t *src, int src_stride, int srcx, int srcy,
+                                  uint8_t *dst, int dst_stride, int dstx, int dsty,
+                                  BoxPtr rects, int num_rects)
+{
+    const uint8_t *s8;
+    uint8_t *dst_uv;
+    uint8_t *dst_aux_y;
+    uint8_t *dst_aux_uv;
+    uint8_t *d8_y;
+    uint8_t *d8_uv;
+    uint8_t *d8_aux_u;
+    uint8_t *d8_aux_v;
+    uint8_t *d8_aux_uv;
+    int plane_bytes;
+    int index;
+    int x;
+    int y;
+    int y2;
+    int pair;
+    int aux_line;
+    int width;
+    int simd_width;
+    int height;
+    BoxPtr box;
+
+    plane_bytes = dst_stride * clientCon->cap_height;
+    dst_uv = dst + plane_bytes;
+    dst_aux_y = dst_uv + plane_bytes / 2;
+    dst_aux_uv = dst_aux_y + plane_bytes;
+    for (index = 0; index < num_rects; index++)
+    {
+        box = rects + index;
+        x = box->x1 - dstx;
+        width = box->x2 - box->x1;
+        simd_width = width & ~7;
+        for (y = box->y1 - dsty; y < box->y2 - dsty; y = y2)
+        {
+            y2 = RDPMIN((y & ~15) + 16, box->y2 - dsty);
+            height = y2 - y;
+            pair = y / 2;
+            aux_line = (pair & ~7) * 2 + (pair & 7);
+            s8 = src + (y + dsty - srcy) * src_stride;
+            s8 += (box->x1 - srcx) * 4;
+            d8_y = dst + y * dst_stride + x;
+            d8_uv = dst_uv + pair * dst_stride + x;
+            d8_aux_u = dst_aux_y + aux_line * dst_stride + x;
+            d8_aux_v = d8_aux_u + 8 * dst_stride;
+            d8_aux_uv = dst_aux_uv + pair * dst_stride + x;
+            if (simd_width > 0)
+            {
+                clientCon->dev->a8r8g8b8_to_avc444_box(s8, src_stride,
+                                                       d8_y, d8_uv,
+                                                       d8_aux_u, d8_aux_v,
+                                                       d8_aux_uv, dst_stride,
+                                                       simd_width, height);
+            }
+            if (width > simd_width)
+            {
+                a8r8g8b8_to_avc444_box(s8 + simd_width * 4, src_stride,
+                                       d8_y + simd_width,
+                                       d8_uv + simd_width,
+                                       d8_aux_u + simd_width,
+                                       d8_aux_v + simd_width,
+                                       d8_aux_uv + simd_width, dst_stride,
+                                       width - simd_width, height);
+            }
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+static void
+rdpCaptureCopyBand(void *arg, int index)
+{
+    struct rdp_copy_job *job;
+
+    job = (struct rdp_copy_job *) arg;
+    job->copy_boxes(job->clientCon,
+                    job->src, job->src_stride, 0, 0,
+                    job->dst, job->dst_stride, 0, 0,
+                    job->bands + index, 1);
+}
+
+/******************************************************************************/
+/* copy rects, big ones are split in bands over the worker threads
+   the rects must not overlap, bands of different rects can run together */
+static int
+rdpCaptureCopyBoxes(rdpClientCon *clientCon, copy_boxes_proc copy_boxes,
+                    const uint8_t *src, int src_stride,
+                    uint8_t *dst, int dst_stride,
+                    BoxPtr rects, int num_rects)
+{
+    struct rdp_copy_job job;
+    struct rdp_workers *workers;
+    BoxPtr band;
+    int num_pixels;
+    int num_bands;
+    int index;
+    int y;
+
+    workers = clientCon->dev->capture_workers;
+    num_pixels = 0;
+    num_bands = 0;
+    for (index = 0; index < num_rects; index++)
+    {
+        num_pixels += (rects[index].x2 - rects[index].x1) *
+                      (rects[index].y2 - rects[index].y1);
+        num_bands += (rects[index].y2 - rects[index].y1 +
+                      RDP_CAPTURE_BAND_HEIGHT - 1) / RDP_CAPTURE_BAND_HEIGHT;
+    }
+    if ((workers == NULL) || (num_pixels < RDP_CAPTURE_MIN_THREAD_PIXELS))
+    {
+        return copy_boxes(clientCon, src, src_stride, 0, 0,
+                          dst, dst_stride, 0, 0, rects, num_rects);
+    }
+    job.clientCon = clientCon;
+    job.copy_boxes = copy_boxes;
+    job.src = src;
+    job.src_stride = src_stride;
+    job.dst = dst;
+    job.dst_stride = dst_stride;
+    job.bands = rdpArenaNew(clientCon->cap_arena, BoxRec, num_bands);
+    band = job.bands;
+    for (index = 0; index < num_rects; index++)
+    {
+        for (y = rects[index].y1; y < rects[index].y2;
+             y += RDP_CAPTURE_BAND_HEIGHT)
+        {
+            band->x1 = rects[index].x1;
+            band->y1 = y;
+            band->x2 = rects[index].x2;
+            band->y2 = RDPMIN(y + RDP_CAPTURE_BAND_HEIGHT, rects[index].y2);
+            band++;
+        }
+    }
+    rdpWorkersRun(workers, rdpCaptureCopyBand, &job, num_bands);
+    return 0;
+}
+
 /******************************************************************************/
 static Bool
 isShmStatusActive(enum shared_memory_status status) {
@@ -587,7 +969,7 @@ isShmStatusActive(enum shared_memory_status status) {
 }
 
 /******************************************************************************/
-static Bool
+static int
 rdpCapture0(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
             int *num_out_rects, struct image_data *id)
 {
@@ -595,35 +977,30 @@ rdpCapture0(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     BoxRec rect;
     int num_rects;
     int i;
-    Bool rv;
     const uint8_t *src;
     uint8_t *dst;
     int src_stride;
     int dst_stride;
     int dst_format;
+    copy_boxes_proc copy_boxes;
 
     LLOGLN(10, ("rdpCapture0:"));
 
     if (!isShmStatusActive(clientCon->shmemstatus)) {
-        LLOGLN(0, ("rdpCapture0: WARNING -- Shared memory is not configured."
-                   " Aborting capture!"));
-        return FALSE;
+        return RDP_CAPTURE_NO_SHMEM;
     }
 
-    rv = TRUE;
-
-
     num_rects = REGION_NUM_RECTS(in_reg);
     psrc_rects = REGION_RECTS(in_reg);
 
     if (num_rects < 1)
     {
-        return FALSE;
+        return RDP_CAPTURE_EMPTY;
     }
 
     *num_out_rects = num_rects;
 
-    *out_rects = g_new(BoxRec, num_rects);
+    *out_rects = rdpArenaNew(clientCon->cap_arena, BoxRec, num_rects);
     for (i = 0; i < num_rects; i++)
     {
         rect = psrc_rects[i];
@@ -636,77 +1013,59 @@ rdpCapture0(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     src_stride = id->lineBytes;
     dst_stride = clientCon->cap_stride_bytes;
 
+    if (dst == src)
+    {
+        /* shared framebuffer, xrdp reads the pixels where they are */
+        return RDP_CAPTURE_OK;
+    }
+    if (dst == NULL)
+    {
+        return RDP_CAPTURE_NO_SHMEM;
+    }
     if (dst_format == XRDP_a8r8g8b8)
     {
-        rdpCopyBox_a8r8g8b8_to_a8r8g8b8(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        psrc_rects, num_rects);
+        copy_boxes = rdpCopyBox_a8r8g8b8_to_a8r8g8b8;
     }
     else if (dst_format == XRDP_a8b8g8r8)
     {
-        rdpCopyBox_a8r8g8b8_to_a8b8g8r8(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        psrc_rects, num_rects);
+        copy_boxes = rdpCopyBox_a8r8g8b8_to_a8b8g8r8;
     }
     else if (dst_format == XRDP_r5g6b5)
     {
-        rdpCopyBox_a8r8g8b8_to_r5g6b5(clientCon,
-                                      src, src_stride, 0, 0,
-                                      dst, dst_stride, 0, 0,
-                                      psrc_rects, num_rects);
+        copy_boxes = rdpCopyBox_a8r8g8b8_to_r5g6b5;
     }
     else if (dst_format == XRDP_a1r5g5b5)
     {
-        rdpCopyBox_a8r8g8b8_to_a1r5g5b5(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        psrc_rects, num_rects);
+        copy_boxes = rdpCopyBox_a8r8g8b8_to_a1r5g5b5;
     }
     else if (dst_format == XRDP_r3g3b2)
     {
-        rdpCopyBox_a8r8g8b8_to_r3g3b2(clientCon,
-                                      src, src_stride, 0, 0,
-                                      dst, dst_stride, 0, 0,
-                                      psrc_rects, num_rects);
+        copy_boxes = rdpCopyBox_a8r8g8b8_to_r3g3b2;
     }
     else
     {
-        LLOGLN(0, ("rdpCapture0: unimplemented color conversion"));
+        return RDP_CAPTURE_NO_CONVERSION;
     }
-    return rv;
+    rdpCaptureCopyBoxes(clientCon, copy_boxes, src, src_stride,
+                        dst, dst_stride, psrc_rects, num_rects);
+    return RDP_CAPTURE_OK;
 }
 
 /******************************************************************************/
 /* make out_rects always multiple of 16 width and height */
-static Bool
+static int
 rdpCapture1(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
             int *num_out_rects, struct image_data *id)
 {
     BoxPtr psrc_rects;
     BoxRec rect;
     BoxRec srect;
-    const uint8_t *src_rect;
-    uint8_t *dst_rect;
     int num_rects;
-    int src_bytespp;
-    int dst_bytespp;
     int width;
     int height;
-    int src_offset;
-    int dst_offset;
     int index;
-    int jndex;
-    int kndex;
-    int red;
-    int green;
-    int blue;
     int ex;
     int ey;
-    Bool rv;
-    const uint32_t *s32;
-    uint32_t *d32;
     const uint8_t *src;
     uint8_t *dst;
     int src_stride;
@@ -716,19 +1075,15 @@ rdpCapture1(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     LLOGLN(10, ("rdpCapture1:"));
 
     if (!isShmStatusActive(clientCon->shmemstatus)) {
-        LLOGLN(0, ("rdpCapture1: WARNING -- Shared memory is not configured."
-               " Aborting capture!"));
-        return FALSE;
+        return RDP_CAPTURE_NO_SHMEM;
     }
 
-    rv = TRUE;
-
     num_rects = REGION_NUM_RECTS(in_reg);
     psrc_rects = REGION_RECTS(in_reg);
 
     if (num_rects < 1)
     {
-        return FALSE;
+        return RDP_CAPTURE_EMPTY;
     }
 
     srect.x1 = clientCon->cap_left;
@@ -738,7 +1093,7 @@ rdpCapture1(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
 
     *num_out_rects = num_rects;
 
-    *out_rects = g_new(BoxRec, num_rects * 4);
+    *out_rects = rdpArenaNew(clientCon->cap_arena, BoxRec, num_rects * 4);
     index = 0;
     while (index < num_rects)
     {
@@ -783,114 +1138,127 @@ rdpCapture1(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     src_stride = id->lineBytes;
     dst_stride = clientCon->cap_stride_bytes;
 
-    if (dst_format == XRDP_a8b8g8r8)
+    if (dst_format != XRDP_a8b8g8r8)
     {
-        src_bytespp = 4;
-        dst_bytespp = 4;
-
-        for (index = 0; index < num_rects; index++)
-        {
-            /* get rect to copy */
-            rect = (*out_rects)[index];
-
-            /* get rect dimensions */
-            width = rect.x2 - rect.x1;
-            height = rect.y2 - rect.y1;
-
-            /* point to start of each rect in respective memory */
-            src_offset = rect.y1 * src_stride + rect.x1 * src_bytespp;
-            dst_offset = rect.y1 * dst_stride + rect.x1 * dst_bytespp;
-            src_rect = src + src_offset;
-            dst_rect = dst + dst_offset;
+        return RDP_CAPTURE_NO_CONVERSION;
+    }
+    rdpCopyBox_a8r8g8b8_to_a8b8g8r8(clientCon,
+                                    src, src_stride, 0, 0,
+                                    dst, dst_stride, 0, 0,
+                                    *out_rects, num_rects);
+    return RDP_CAPTURE_OK;
+}
 
-            /* copy one line at a time */
-            for (jndex = 0; jndex < height; jndex++)
-            {
-                s32 = (const uint32_t *) src_rect;
-                d32 = (uint32_t *) dst_rect;
-                for (kndex = 0; kndex < width; kndex++)
-                {
-                    SPLITCOLOR32(red, green, blue, *s32);
-                    *d32 = COLOR24(red, green, blue);
-                    s32++;
-                    d32++;
-                }
-                src_rect += src_stride;
-                dst_rect += dst_stride;
-            }
-        }
+/******************************************************************************/
+/* hash the source first so unchanged tiles are not converted or written
+   to shared memory */
+static void
+rdpCaptureTile(void *arg, int index)
+{
+    struct rdp_tiles_job *job;
+    struct rdp_tile_job *tile;
+    tile_hash_proc tile_hash;
+    BoxPtr rects;
+    int num_rects;
+    uint64_t hash;
+
+    job = (struct rdp_tiles_job *) arg;
+    tile = job->tiles + index;
+    tile_hash = job->clientCon->dev->tile_hash;
+    rects = REGION_RECTS(&(tile->reg));
+    num_rects = REGION_NUM_RECTS(&(tile->reg));
+    hash = 0;
+    if (tile->rcode == rgnPART)
+    {
+        hash = tile_hash(hash, rects, num_rects * sizeof(BoxRec));
     }
-    else
+    hash = rdpHashBox_a8r8g8b8(tile_hash, hash, job->src, job->src_stride,
+                               rects, num_rects);
+    if (hash == *(tile->hash))
+    {
+        tile->changed = 0;
+        return;
+    }
+    if (tile->rcode == rgnPART)
     {
-        LLOGLN(0, ("rdpCapture1: unimplemented color conversion"));
+        rdpFillBox_yuvalp(tile->rect.x1, tile->rect.y1,
+                          job->dst, job->dst_stride);
     }
-    return rv;
+    rdpCopyBox_a8r8g8b8_to_yuvalp(job->clientCon,
+                                  tile->rect.x1, tile->rect.y1,
+                                  job->src, job->src_stride,
+                                  job->dst, job->dst_stride,
+                                  rects, num_rects);
+    *(tile->hash) = hash;
+    tile->changed = 1;
 }
 
 /******************************************************************************/
-static Bool
+static int
 rdpCapture2(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
             int *num_out_rects, struct image_data *id)
 {
     int x;
     int y;
+    int index;
     int out_rect_index;
-    int num_rects;
+    int num_tiles;
     int rcode;
     BoxRec rect;
     BoxRec extents_rect;
-    BoxPtr rects;
-    RegionRec tile_reg;
-    const uint8_t *src;
-    uint8_t *dst;
-    uint8_t *crc_dst;
-    int src_stride;
-    int dst_stride;
-    int crc_offset;
-    int crc_stride;
-    int crc;
-    int num_crcs;
+    struct rdp_tiles_job job;
+    struct rdp_tile_job *tile;
+    struct rdp_workers *workers;
+    int hash_offset;
+    int hash_stride;
+    int num_hashes;
     int mon_index;
+    Bool rv;
 
     LLOGLN(10, ("rdpCapture2:"));
 
     if (!isShmStatusActive(clientCon->shmemstatus))
     {
-        LLOGLN(0, ("rdpCapture2: WARNING -- Shared memory is not configured"
-                   " for RFX. Aborting capture!"));
-        return FALSE;
+        return RDP_CAPTURE_NO_SHMEM;
     }
 
-    *out_rects = g_new(BoxRec, RDP_MAX_TILES);
-    if (*out_rects == NULL)
+    mon_index = (id->flags >> 28) & 0xF;
+    hash_stride = (id->width + 63) / 64;
+    num_hashes = hash_stride * ((id->height + 63) / 64);
+    if (num_hashes != clientCon->num_rfx_tile_hashes_alloc[mon_index])
     {
-        return FALSE;
+        /* no resizing here, this can be the capture thread */
+        return RDP_CAPTURE_NO_HASHES;
     }
+
+    *out_rects = rdpArenaNew(clientCon->cap_arena, BoxRec, RDP_MAX_TILES);
     out_rect_index = 0;
 
     rdpRegionTranslate(in_reg, -id->left, -id->top);
 
-    src = id->pixels;
-    dst = id->shmem_pixels;
-    src_stride = id->lineBytes;
-    dst_stride = ((id->width + 63) & ~63) * 4;
-
-    src = src + src_stride * id->top + id->left * 4;
-
-    mon_index = (id->flags >> 28) & 0xF;
-    crc_stride = (id->width + 63) / 64;
-    num_crcs = crc_stride * ((id->height + 63) / 64);
-    if (num_crcs != clientCon->num_rfx_crcs_alloc[mon_index])
+    job.clientCon = clientCon;
+    job.src = id->pixels;
+    job.dst = id->shmem_pixels + id->shmem_offset;
+    job.src_stride = id->lineBytes;
+    job.dst_stride = ((id->width + 63) & ~63) * 4;
+    if (id->shmem_offset + job.dst_stride * ((id->height + 63) & ~63) >
+        id->shmem_bytes)
     {
-        LLOGLN(0, ("rdpCapture2: resize the crc list was %d now %d",
-               clientCon->num_rfx_crcs_alloc[mon_index], num_crcs));
-        /* resize the crc list */
-        clientCon->num_rfx_crcs_alloc[mon_index] = num_crcs;
-        free(clientCon->rfx_crcs[mon_index]);
-        clientCon->rfx_crcs[mon_index] = g_new0(int, num_crcs);
+        /* rdpCaptureRfxBytes sized it for other monitors */
+        return RDP_CAPTURE_NO_SHMEM;
     }
 
+    job.src = job.src + job.src_stride * id->top + id->left * 4;
+
+    /* with CaptureAsync this runs on the capture thread, while ca->busy
+       is set it owns in_reg, which is clientCon->cap_dirty, cap_arena
+       and the tile hashes, collect the tiles */
     extents_rect = *rdpRegionExtents(in_reg);
+    num_tiles = (((extents_rect.x2 + 63) & ~63) - (extents_rect.x1 & ~63)) / 64 *
+                ((((extents_rect.y2 + 63) & ~63) - (extents_rect.y1 & ~63)) / 64);
+    job.tiles = rdpArenaNew(clientCon->cap_arena, struct rdp_tile_job,
+                            num_tiles);
+    num_tiles = 0;
     y = extents_rect.y1 & ~63;
     while (y < extents_rect.y2)
     {
@@ -906,159 +1274,357 @@ rdpCapture2(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
 
             if (rcode == rgnOUT)
             {
+                /* nothing of in_reg in it to take out */
                 LLOGLN(10, ("rdpCapture2: rgnOUT"));
-                rdpRegionInit(&tile_reg, &rect, 0);
-                rdpRegionSubtract(in_reg, in_reg, &tile_reg);
-                rdpRegionUninit(&tile_reg);
             }
             else
             {
-                crc = crc_start();
+                tile = job.tiles + num_tiles;
+                tile->rect = rect;
+                tile->rcode = rcode;
+                rdpRegionInit(&(tile->reg), &rect, 0);
                 if (rcode == rgnPART)
                 {
                     LLOGLN(10, ("rdpCapture2: rgnPART"));
-                    rdpFillBox_yuvalp(x, y, dst, dst_stride);
-                    rdpRegionInit(&tile_reg, &rect, 0);
-                    rdpRegionIntersect(&tile_reg, in_reg, &tile_reg);
-                    rects = REGION_RECTS(&tile_reg);
-                    num_rects = REGION_NUM_RECTS(&tile_reg);
-                    crc = crc_process_data(crc, rects,
-                                           num_rects * sizeof(BoxRec));
-                    rdpCopyBox_a8r8g8b8_to_yuvalp(x, y,
-                                                  src, src_stride,
-                                                  dst, dst_stride,
-                                                  rects, num_rects);
-                    rdpRegionUninit(&tile_reg);
-                }
-                else /* rgnIN */
-                {
-                    LLOGLN(10, ("rdpCapture2: rgnIN"));
-                    rdpCopyBox_a8r8g8b8_to_yuvalp(x, y,
-                                                  src, src_stride,
-                                                  dst, dst_stride,
-                                                  &rect, 1);
-                }
-                crc_dst = dst + (y << 8) * (dst_stride >> 8) + (x << 8);
-                crc = crc_process_data(crc, crc_dst, 64 * 64 * 4);
-                crc = crc_end(crc);
-                crc_offset = (y / XRDP_RFX_ALIGN) * crc_stride 
-                             + (x / XRDP_RFX_ALIGN);
-                LLOGLN(10, ("rdpCapture2: crc 0x%8.8x 0x%8.8x",
-                       crc, clientCon->rfx_crcs[mon_index][crc_offset]));
-                if (crc == clientCon->rfx_crcs[mon_index][crc_offset])
-                {
-                    LLOGLN(10, ("rdpCapture2: crc skip at x %d y %d", x, y));
-                    rdpRegionInit(&tile_reg, &rect, 0);
-                    rdpRegionSubtract(in_reg, in_reg, &tile_reg);
-                    rdpRegionUninit(&tile_reg);
-                }
-                else
-                {
-                    clientCon->rfx_crcs[mon_index][crc_offset] = crc;
-                    (*out_rects)[out_rect_index] = rect;
-                    out_rect_index++;
-                    if (out_rect_index >= RDP_MAX_TILES)
-                    {
-                        free(*out_rects);
-                        *out_rects = NULL;
-                        return FALSE;
-                    }
+                    rdpRegionIntersect(&(tile->reg), in_reg, &(tile->reg));
                 }
+                hash_offset = (y / XRDP_RFX_ALIGN) * hash_stride
+                              + (x / XRDP_RFX_ALIGN);
+                tile->hash = clientCon->rfx_tile_hashes[mon_index] + hash_offset;
+                num_tiles++;
             }
             x += XRDP_RFX_ALIGN;
         }
         y += XRDP_RFX_ALIGN;
     }
+
+    /* hash and convert, tiles do not overlap */
+    workers = clientCon->dev->capture_workers;
+    if (num_tiles < RDP_CAPTURE_MIN_THREAD_TILES)
+    {
+        workers = NULL;
+    }
+    rdpWorkersRun(workers, rdpCaptureTile, &job, num_tiles);
+
+    rv = TRUE;
+    for (index = 0; index < num_tiles; index++)
+    {
+        tile = job.tiles + index;
+        if (!tile->changed)
+        {
+            LLOGLN(10, ("rdpCapture2: hash skip at x %d y %d",
+                   tile->rect.x1, tile->rect.y1));
+            rdpRegionSubtract(in_reg, in_reg, &(tile->reg));
+        }
+        else if (out_rect_index < RDP_MAX_TILES)
+        {
+            (*out_rects)[out_rect_index] = tile->rect;
+            out_rect_index++;
+        }
+        else
+        {
+            rv = FALSE;
+        }
+        rdpRegionUninit(&(tile->reg));
+    }
+    if (!rv)
+    {
+        *out_rects = NULL;
+        return RDP_CAPTURE_TOO_MANY_TILES;
+    }
     *num_out_rects = out_rect_index;
-    return TRUE;
+    return RDP_CAPTURE_OK;
 }
 
 /******************************************************************************/
-/* make out_rects always multiple of 2 width and height */
-static Bool
+/* screen rect of a macroblock, clipped to the monitor */
+static void
+rdpCaptureMbRect(struct rdp_mb_job *job, int col, int row, BoxPtr rect)
+{
+    rect->x1 = job->mon.x1 + col * RDP_MB_SIZE;
+    rect->y1 = job->mon.y1 + row * RDP_MB_SIZE;
+    rect->x2 = RDPMIN(rect->x1 + RDP_MB_SIZE, job->mon.x2);
+    rect->y2 = RDPMIN(rect->y1 + RDP_MB_SIZE, job->mon.y2);
+}
+
+/******************************************************************************/
+/* make rect multiple of 2 width and height for nv12 */
+static void
+rdpCaptureEvenRect(BoxPtr rect)
+{
+    rect->x1 -= rect->x1 & 1;
+    rect->y1 -= rect->y1 & 1;
+    rect->x2 += rect->x2 & 1;
+    rect->y2 += rect->y2 & 1;
+}
+
+/******************************************************************************/
+/* screen rect of macroblocks col1 .. col2 - 1 in a row */
+static void
+rdpCaptureMbRun(struct rdp_mb_job *job, int row, int col1, int col2,
+                BoxPtr rect)
+{
+    rdpCaptureMbRect(job, col1, row, rect);
+    rect->x2 = RDPMIN(job->mon.x1 + col2 * RDP_MB_SIZE, job->mon.x2);
+    rdpCaptureEvenRect(rect);
+}
+
+/******************************************************************************/
+/* hash the dirty macroblocks of a row, convert the ones that changed */
+static void
+rdpCaptureMbRow(void *arg, int item)
+{
+    struct rdp_mb_job *job;
+    tile_hash_proc tile_hash;
+    BoxRec rect;
+    uint64_t hash;
+    int row;
+    int col;
+    int index;
+
+    job = (struct rdp_mb_job *) arg;
+    row = (job->row_pass < 0) ? item : item * 2 + job->row_pass;
+    tile_hash = job->clientCon->dev->tile_hash;
+    for (col = 0; col < job->mb_cols; col++)
+    {
+        index = row * job->mb_cols + col;
+        if (job->mb_state[index] == RDP_MB_CLEAN)
+        {
+            continue;
+        }
+        rdpCaptureMbRect(job, col, row, &rect);
+        hash = rdpHashBox_a8r8g8b8(tile_hash, 0, job->src, job->src_stride,
+                                   &rect, 1);
+        if (hash == job->hashes[index])
+        {
+            job->mb_state[index] = RDP_MB_CLEAN;
+            continue;
+        }
+        job->hashes[index] = hash;
+        job->mb_state[index] = RDP_MB_CHANGED;
+        /* with an odd monitor origin this takes a pixel of the neighbours,
+           the ones left and right are in this row, rdpCapture3 keeps the
+           ones above and below from running at the same time */
+        rdpCaptureEvenRect(&rect);
+        job->copy_boxes(job->clientCon,
+                        job->src, job->src_stride, 0, 0,
+                        job->dst, job->dst_stride, 0, 0,
+                        &rect, 1);
+    }
+}
+
+/******************************************************************************/
+/* only macroblocks whose source changed are converted, out_rects are runs
+   of them and clientCon->mb_changed has one bit for each */
+static int
 rdpCapture3(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
             int *num_out_rects, struct image_data *id)
 {
     BoxPtr psrc_rects;
     BoxRec rect;
+    RegionRec stale_reg;
+    struct rdp_mb_job job;
+    struct rdp_workers *workers;
     int num_rects;
     int index;
-    uint8_t *dst_uv;
-    Bool rv;
-    const uint8_t *src;
-    uint8_t *dst;
-    int src_stride;
-    int dst_stride;
+    int col;
+    int row;
+    int col1;
+    int row1;
+    int col2;
+    int row2;
+    int mb_rows;
+    int num_mbs;
+    int num_dirty;
+    int num_runs;
+    int row_bytes;
+    int mon_index;
     int dst_format;
+    uint8_t *state;
+    Bool by_row;
 
     LLOGLN(10, ("rdpCapture3:"));
 
     if (!isShmStatusActive(clientCon->shmemstatus))
     {
-        LLOGLN(0, ("rdpCapture3: WARNING -- Shared memory is not configured."
-               " Aborting capture!"));
-        return FALSE;
+        return RDP_CAPTURE_NO_SHMEM;
     }
 
-    rv = TRUE;
-
     num_rects = REGION_NUM_RECTS(in_reg);
     psrc_rects = REGION_RECTS(in_reg);
 
     if (num_rects < 1)
     {
-        return FALSE;
+        return RDP_CAPTURE_EMPTY;
     }
 
-    *num_out_rects = num_rects;
+    job.clientCon = clientCon;
+    job.src = id->pixels;
+    job.dst = id->shmem_pixels;
+    job.src_stride = id->lineBytes;
+    job.dst_stride = clientCon->cap_stride_bytes;
+    dst_format = clientCon->rdp_format;
+    if (dst_format == XRDP_a8r8g8b8)
+    {
+        job.copy_boxes = rdpCopyBox_a8r8g8b8_to_a8r8g8b8;
+    }
+    else if (dst_format == XRDP_nv12)
+    {
+        job.copy_boxes = rdpCopyBox_a8r8g8b8_to_nv12_cap;
+    }
+    else if (dst_format == XRDP_nv12_avc444)
+    {
+        job.copy_boxes = rdpCopyBox_a8r8g8b8_to_avc444_cap;
+    }
+    else
+    {
+        return RDP_CAPTURE_NO_CONVERSION;
+    }
 
-    *out_rects = g_new(BoxRec, num_rects * 4);
-    index = 0;
-    while (index < num_rects)
+    if (clientCon->num_cap_stale_rects > 0)
     {
-        rect = psrc_rects[index];
-        LLOGLN(10, ("old x1 %d y1 %d x2 %d y2 %d", rect.x1, rect.x2,
-               rect.x2, rect.y2));
-        rect.x1 -= rect.x1 & 1;
-        rect.y1 -= rect.y1 & 1;
-        rect.x2 += rect.x2 & 1;
-        rect.y2 += rect.y2 & 1;
-        LLOGLN(10, ("new x1 %d y1 %d x2 %d y2 %d", rect.x1, rect.x2,
-               rect.x2, rect.y2));
-        (*out_rects)[index] = rect;
-        index++;
+        /* this capture buffer missed what went out in the others
+           rounded even, neighbour rects can overlap, union them again so
+           each pixel is in one rect and has one writer */
+        rdpRegionInit(&stale_reg, NullBox, 0);
+        for (index = 0; index < clientCon->num_cap_stale_rects; index++)
+        {
+            rect = clientCon->cap_stale_rects[index];
+            rdpCaptureEvenRect(&rect);
+            rdpRegionUnionRect(&stale_reg, &rect);
+        }
+        rdpCaptureCopyBoxes(clientCon, job.copy_boxes,
+                            job.src, job.src_stride,
+                            job.dst, job.dst_stride,
+                            REGION_RECTS(&stale_reg),
+                            REGION_NUM_RECTS(&stale_reg));
+        rdpRegionUninit(&stale_reg);
+        clientCon->num_cap_stale_rects = 0;
     }
 
-    src = id->pixels;
-    dst = id->shmem_pixels;
-    dst_format = clientCon->rdp_format;
-    src_stride = id->lineBytes;
-    dst_stride = clientCon->cap_stride_bytes;
+    /* macroblocks start at the monitor origin */
+    job.mon.x1 = id->left;
+    job.mon.y1 = id->top;
+    job.mon.x2 = id->left + id->width;
+    job.mon.y2 = id->top + id->height;
+    job.mb_cols = (id->width + RDP_MB_SIZE - 1) / RDP_MB_SIZE;
+    mb_rows = (id->height + RDP_MB_SIZE - 1) / RDP_MB_SIZE;
+    num_mbs = job.mb_cols * mb_rows;
+    mon_index = (id->flags >> 28) & 0xF;
+    row_bytes = (job.mb_cols + 7) / 8;
+    if ((num_mbs != clientCon->num_mb_hashes_alloc[mon_index]) ||
+        (row_bytes * mb_rows > clientCon->mb_changed_alloc))
+    {
+        /* no resizing here, this can be the capture thread */
+        return RDP_CAPTURE_NO_HASHES;
+    }
+    job.hashes = clientCon->mb_hashes[mon_index];
 
-    if (dst_format == XRDP_a8r8g8b8)
+    /* mark the macroblocks the damage touches */
+    job.mb_state = rdpArenaNew0(clientCon->cap_arena, uint8_t, num_mbs);
+    num_dirty = 0;
+    for (index = 0; index < num_rects; index++)
+    {
+        rect = psrc_rects[index];
+        rect.x1 = RDPMAX(rect.x1, job.mon.x1);
+        rect.y1 = RDPMAX(rect.y1, job.mon.y1);
+        rect.x2 = RDPMIN(rect.x2, job.mon.x2);
+        rect.y2 = RDPMIN(rect.y2, job.mon.y2);
+        if ((rect.x2 <= rect.x1) || (rect.y2 <= rect.y1))
+        {
+            continue;
+        }
+        col1 = (rect.x1 - job.mon.x1) / RDP_MB_SIZE;
+        row1 = (rect.y1 - job.mon.y1) / RDP_MB_SIZE;
+        col2 = (rect.x2 - job.mon.x1 + RDP_MB_SIZE - 1) / RDP_MB_SIZE;
+        row2 = (rect.y2 - job.mon.y1 + RDP_MB_SIZE - 1) / RDP_MB_SIZE;
+        for (row = row1; row < row2; row++)
+        {
+            state = job.mb_state + row * job.mb_cols;
+            for (col = col1; col < col2; col++)
+            {
+                num_dirty += state[col] == RDP_MB_CLEAN;
+                state[col] = RDP_MB_DIRTY;
+            }
+        }
+    }
+
+    workers = clientCon->dev->capture_workers;
+    if (num_dirty * RDP_MB_SIZE * RDP_MB_SIZE < RDP_CAPTURE_MIN_THREAD_PIXELS)
     {
-        rdpCopyBox_a8r8g8b8_to_a8r8g8b8(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        *out_rects, num_rects);
+        workers = NULL;
     }
-    else if (dst_format == XRDP_nv12)
+    if (job.mon.y1 & 1)
     {
-        dst_uv = dst;
-        dst_uv += clientCon->cap_width * clientCon->cap_height;
-        rdpCopyBox_a8r8g8b8_to_nv12(clientCon,
-                                    src, src_stride, 0, 0,
-                                    dst, dst_stride,
-                                    dst_uv, dst_stride,
-                                    0, 0,
-                                    *out_rects, num_rects);
+        /* rounded even, a row takes a pixel line of the rows above and
+           below, run the even rows then the odd ones so they never write
+           the same line together */
+        job.row_pass = 0;
+        rdpWorkersRun(workers, rdpCaptureMbRow, &job, (mb_rows + 1) / 2);
+        job.row_pass = 1;
+        rdpWorkersRun(workers, rdpCaptureMbRow, &job, mb_rows / 2);
     }
     else
     {
-        LLOGLN(0, ("rdpCapture3: unimplemented color conversion"));
+        job.row_pass = -1;
+        rdpWorkersRun(workers, rdpCaptureMbRow, &job, mb_rows);
     }
 
-    return rv;
+    /* runs of changed macroblocks in each row, or one span per row if
+       there are too many */
+    num_runs = 0;
+    for (index = 0; index < num_mbs; index++)
+    {
+        if ((job.mb_state[index] == RDP_MB_CHANGED) &&
+            ((index % job.mb_cols == 0) ||
+             (job.mb_state[index - 1] != RDP_MB_CHANGED)))
+        {
+            num_runs++;
+        }
+    }
+    by_row = num_runs > RDP_MAX_MB_RECTS;
+    *out_rects = rdpArenaNew(clientCon->cap_arena, BoxRec,
+                             by_row ? mb_rows : num_runs);
+    *num_out_rects = 0;
+    clientCon->mb_changed_bytes = row_bytes * mb_rows;
+    memset(clientCon->mb_changed, 0, clientCon->mb_changed_bytes);
+    clientCon->mb_cols = job.mb_cols;
+    clientCon->mb_rows = mb_rows;
+    for (row = 0; row < mb_rows; row++)
+    {
+        state = job.mb_state + row * job.mb_cols;
+        col1 = -1;
+        col2 = -1;
+        for (col = 0; col < job.mb_cols; col++)
+        {
+            if (state[col] != RDP_MB_CHANGED)
+            {
+                continue;
+            }
+            clientCon->mb_changed[row * row_bytes + col / 8] |= 1 << (col & 7);
+            if ((col1 >= 0) && (col2 != col) && !by_row)
+            {
+                rdpCaptureMbRun(&job, row, col1, col2,
+                                *out_rects + *num_out_rects);
+                (*num_out_rects)++;
+                col1 = -1;
+            }
+            if (col1 < 0)
+            {
+                col1 = col;
+            }
+            col2 = col + 1;
+        }
+        if (col1 >= 0)
+        {
+            rdpCaptureMbRun(&job, row, col1, col2,
+                            *out_rects + *num_out_rects);
+            (*num_out_rects)++;
+        }
+    }
+    LLOGLN(10, ("rdpCapture3: dirty macroblocks %d changed runs %d",
+           num_dirty, num_runs));
+    return RDP_CAPTURE_OK;
 }
 
 #if defined(XORGXRDP_GLAMOR)
@@ -1121,9 +1687,10 @@ copy_vmem(rdpPtr dev, RegionPtr in_reg)
 #endif
 
 /**
- * Copy an array of rectangles from one memory area to another
+ * Copy an array of rectangles from one memory area to another, this can
+ * run on the capture thread, see enum rdp_capture_status
  *****************************************************************************/
-Bool
+int
 rdpCapture(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
            int *num_out_rects, struct image_data *id)
 {
@@ -1136,8 +1703,13 @@ rdpCapture(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
 #if defined(XORGXRDP_GLAMOR)
         if ((mode == 2) || (mode == 4))
         {
-            return rdpEglCaptureRfx(clientCon, in_reg, out_rects,
-                                    num_out_rects, id);
+            /* never on the capture thread, rdpCapAsyncCreate */
+            if (!rdpEglCaptureRfx(clientCon, in_reg, out_rects,
+                                  num_out_rects, id))
+            {
+                return RDP_CAPTURE_FAILED;
+            }
+            return RDP_CAPTURE_OK;
         }
         copy_vmem(clientCon->dev, in_reg);
 #endif
@@ -1157,34 +1729,168 @@ rdpCapture(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
             /* used for even align capture */
             return rdpCapture3(clientCon, in_reg, out_rects, num_out_rects, id);
         default:
-            LLOGLN(0, ("rdpCapture: mode %d not implemented", mode));
             break;
     }
-    return FALSE;
+    return RDP_CAPTURE_BAD_MODE;
+}
+
+/******************************************************************************/
+const char *
+rdpCaptureStatusStr(int status)
+{
+    switch (status)
+    {
+        case RDP_CAPTURE_OK:
+            return "ok";
+        case RDP_CAPTURE_EMPTY:
+            return "nothing to capture";
+        case RDP_CAPTURE_NO_SHMEM:
+            return "shared memory is not configured";
+        case RDP_CAPTURE_NO_CONVERSION:
+            return "unimplemented color conversion";
+        case RDP_CAPTURE_NO_HASHES:
+            return "hash list does not fit the monitor";
+        case RDP_CAPTURE_TOO_MANY_TILES:
+            return "too many tiles";
+        case RDP_CAPTURE_BAD_MODE:
+            return "capture mode not implemented";
+        default:
+            break;
+    }
+    return "failed";
+}
+
+/******************************************************************************/
+/* size of the image_data rdpCapture gets for mon_index, the whole session
+   without a monitor list */
+static void
+rdpCaptureMonitorSize(rdpClientCon *clientCon, int mon_index,
+                      int *width, int *height)
+{
+    struct display_size_description *ds;
+
+    ds = &(clientCon->client_info.display_sizes);
+    if (ds->monitorCount > 0)
+    {
+        *width = ds->minfo[mon_index].right + 1 - ds->minfo[mon_index].left;
+        *height = ds->minfo[mon_index].bottom + 1 - ds->minfo[mon_index].top;
+    }
+    else
+    {
+        *width = ds->session_width;
+        *height = ds->session_height;
+    }
+}
+
+/******************************************************************************/
+/* bytes of one monitor in the RFX capture buffer, 64 aligned at 32 bpp */
+static int
+rdpCaptureRfxMonitorBytes(rdpClientCon *clientCon, int mon_index)
+{
+    int width;
+    int height;
+
+    rdpCaptureMonitorSize(clientCon, mon_index, &width, &height);
+    return RDPALIGN(width, XRDP_RFX_ALIGN) *
+           RDPALIGN(height, XRDP_RFX_ALIGN) * 4;
+}
+
+/******************************************************************************/
+/* size of the RFX capture buffer, the monitors are laid out one after the
+   other so a frame can have all of them, rdpCaptureResetState keeps where
+   each starts in rfx_shmem_offsets */
+int
+rdpCaptureRfxBytes(rdpClientCon *clientCon)
+{
+    int num_mons;
+    int bytes;
+    int i;
+
+    num_mons = clientCon->client_info.display_sizes.monitorCount;
+    num_mons = RDPCLAMP(num_mons, 1, 16);
+    bytes = 0;
+    for (i = 0; i < num_mons; i++)
+    {
+        bytes += rdpCaptureRfxMonitorBytes(clientCon, i);
+    }
+    return bytes;
 }
 
 /**
- * Reset any capture state fields following a memory resize
+ * Reset any capture state fields following a memory resize, the hash
+ * lists are sized for the monitors here, on the X server thread, rdpCapture
+ * does not resize them
  *****************************************************************************/
 void
 rdpCaptureResetState(rdpClientCon *clientCon)
 {
     int mode;
     int i;
+    int num_mons;
+    int width;
+    int height;
+    int cols;
+    int rows;
+    int bytes;
 
     LLOGLN(10, ("rdpCapReset:"));
+    num_mons = clientCon->client_info.display_sizes.monitorCount;
+    num_mons = RDPCLAMP(num_mons, 1, 16);
     mode = clientCon->client_info.capture_code;
+    memset(clientCon->rfx_shmem_offsets, 0,
+           sizeof(clientCon->rfx_shmem_offsets));
     switch (mode)
     {
         case 2:
         case 4:
+            bytes = 0;
             for (i = 0 ; i < 16; ++i)
             {
-                free(clientCon->rfx_crcs[i]);
-                clientCon->rfx_crcs[i] = NULL;
-                clientCon->num_rfx_crcs_alloc[i] = 0;
+                free(clientCon->rfx_tile_hashes[i]);
+                clientCon->rfx_tile_hashes[i] = NULL;
+                clientCon->num_rfx_tile_hashes_alloc[i] = 0;
                 clientCon->send_key_frame[i] = 1;
             }
+            for (i = 0; i < num_mons; i++)
+            {
+                clientCon->rfx_shmem_offsets[i] = bytes;
+                bytes += rdpCaptureRfxMonitorBytes(clientCon, i);
+                rdpCaptureMonitorSize(clientCon, i, &width, &height);
+                cols = (width + 63) / 64;
+                rows = (height + 63) / 64;
+                LLOGLN(0, ("rdpCaptureResetState: monitor %d hash list %d",
+                       i, cols * rows));
+                clientCon->rfx_tile_hashes[i] = g_new0(uint64_t, cols * rows);
+                clientCon->num_rfx_tile_hashes_alloc[i] = cols * rows;
+            }
+            break;
+        case 3:
+        case 5:
+            bytes = 0;
+            for (i = 0 ; i < 16; ++i)
+            {
+                free(clientCon->mb_hashes[i]);
+                clientCon->mb_hashes[i] = NULL;
+                clientCon->num_mb_hashes_alloc[i] = 0;
+            }
+            for (i = 0; i < num_mons; i++)
+            {
+                rdpCaptureMonitorSize(clientCon, i, &width, &height);
+                cols = (width + RDP_MB_SIZE - 1) / RDP_MB_SIZE;
+                rows = (height + RDP_MB_SIZE - 1) / RDP_MB_SIZE;
+                LLOGLN(0, ("rdpCaptureResetState: monitor %d hash list %d",
+                       i, cols * rows));
+                clientCon->mb_hashes[i] = g_new0(uint64_t, cols * rows);
+                clientCon->num_mb_hashes_alloc[i] = cols * rows;
+                bytes = RDPMAX(bytes, (cols + 7) / 8 * rows);
+            }
+            if (bytes > clientCon->mb_changed_alloc)
+            {
+                free(clientCon->mb_changed);
+                clientCon->mb_changed = g_new(uint8_t, bytes);
+                clientCon->mb_changed_alloc = bytes;
+            }
+            clientCon->mb_changed_bytes = 0;
             break;
         default:
             break;
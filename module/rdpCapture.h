@@ -33,13 +33,33 @@ capture
 #define MAX_CAPTURE_RECTS 15
 #define MAX_CAPTURE_PIXELS 0x800000
 
-extern _X_EXPORT Bool
+/* rdpCapture can run on the capture thread, where it can not log, it
+   returns one of these for the X server thread to log */
+enum rdp_capture_status
+{
+    RDP_CAPTURE_OK = 0,
+    RDP_CAPTURE_FAILED, /* logged where it failed */
+    RDP_CAPTURE_EMPTY, /* nothing in in_reg */
+    RDP_CAPTURE_NO_SHMEM, /* shared memory is not configured */
+    RDP_CAPTURE_NO_CONVERSION, /* unimplemented color conversion */
+    RDP_CAPTURE_NO_HASHES, /* rdpCaptureResetState sized them otherwise */
+    RDP_CAPTURE_TOO_MANY_TILES,
+    RDP_CAPTURE_BAD_MODE /* capture_code not implemented */
+};
+
+extern _X_EXPORT int
 rdpCapture(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
            int *num_out_rects, struct image_data *id);
 
+extern _X_EXPORT const char *
+rdpCaptureStatusStr(int status);
+
 extern _X_EXPORT void
 rdpCaptureResetState(rdpClientCon *clientCon);
 
+extern _X_EXPORT int
+rdpCaptureRfxBytes(rdpClientCon *clientCon);
+
 extern _X_EXPORT int
 a8r8g8b8_to_a8b8g8r8_box(const uint8_t *s8, int src_stride,
                          uint8_t *d8, int dst_stride,
@@ -49,5 +69,27 @@ a8r8g8b8_to_nv12_box(const uint8_t *s8, int src_stride,
                      uint8_t *d8_y, int dst_stride_y,
                      uint8_t *d8_uv, int dst_stride_uv,
                      int width, int height);
+extern _X_EXPORT int
+a8r8g8b8_to_avc444_box(const uint8_t *s8, int src_stride,
+                       uint8_t *d8_y, uint8_t *d8_uv,
+                       uint8_t *d8_aux_u, uint8_t *d8_aux_v,
+                       uint8_t *d8_aux_uv, int dst_stride,
+                       int width, int height);
+extern _X_EXPORT int
+a8r8g8b8_to_r5g6b5_box(const uint8_t *s8, int src_stride,
+                       uint8_t *d8, int dst_stride,
+                       int width, int height);
+extern _X_EXPORT int
+a8r8g8b8_to_a1r5g5b5_box(const uint8_t *s8, int src_stride,
+                         uint8_t *d8, int dst_stride,
+                         int width, int height);
+extern _X_EXPORT int
+a8r8g8b8_to_r3g3b2_box(const uint8_t *s8, int src_stride,
+                       uint8_t *d8, int dst_stride,
+                       int width, int height);
+extern _X_EXPORT int
+a8r8g8b8_to_yuvalp_box(const uint8_t *s8, int src_stride,
+                       uint8_t *d8, int dst_stride,
+                       int width, int height);
 
 #endif
@@ -30,6 +30,7 @@ Client connection to xrdp
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -51,11 +52,69 @@ Client connection to xrdp
 #include "rdpReg.h"
 #include "rdpCapture.h"
 #include "rdpRandR.h"
+#include "rdpWorkers.h"
+#include "rdpSimd.h"
 
 #define LOG_LEVEL 1
 #define LLOGLN(_level, _args) \
     do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
 
+/* frame pacing, see rdpClientConPaceAcked */
+#define RDP_PACE_START_MS 40
+/* acks before the best ack time is taken again */
+#define RDP_PACE_MIN_ACKS 128
+/* ack times this much over twice the best are not queueing yet */
+#define RDP_PACE_SLACK_MS 4
+/* after a key press or click, damage in this window skips the pacing */
+#define RDP_PACE_INPUT_MS 100
+
+/* no captures while xrdp has this much to read, frames are skipped
+   until it catches up */
+#define RDP_OUT_SKIP_BYTES (64 * 1024)
+/* xrdp is not reading at all, disconnect */
+#define RDP_OUT_MAX_BYTES (16 * 1024 * 1024)
+/* how often servers without write notify look at the queue */
+#define RDP_OUT_RETRY_MS 10
+
+/* region simplifier costs in pixels converted, see
+   rdpClientConSimplifyRegion, by capture code
+   row, a converter row setup, codes 2 to 5 convert whole cells
+   rect, out_rects bytes and the region and xrdp work for a rect
+   max_rects, more than this a frame makes rect twice as costly */
+static const struct
+{
+    int row;
+    int rect;
+    int max_rects;
+} g_simplify_costs[6] =
+{
+    { 8, 128, 128 },
+    { 8, 128, 128 },
+    { 0, 64, 1024 },
+    { 0, 64, 1024 },
+    { 0, 64, 1024 },
+    { 0, 64, 1024 }
+};
+
+/* receive room to keep free for one recv */
+#define RDP_RECV_MIN_ROOM 4096
+/* longest message from xrdp */
+#define RDP_RECV_MAX_BYTES (1024 * 1024)
+
+/* caps in message 2, xrdp answers with message 109 listing the ones it
+   takes, clientCon->xrdp_caps has a bit for each */
+#define RDP_XUP_CAP_TILE_MAP 2 /* copy rects as a cell map, out_tile_map */
+#define RDP_XUP_CAP_SHM_BUFS 3 /* message 65, XRDP_PAINT_SHM_BUF paints */
+#define RDP_XUP_CAP_MB_MAP 4 /* XRDP_MB_MAP_INCLUDED in WIRETOSURFACE_1 */
+#define RDP_XUP_CAP_SHARED_FB 5 /* XRDP_PAINT_SHARED_FB paints */
+/* XRDP_SHMEM_OFFSET_INCLUDED in WIRETOSURFACE_2 */
+#define RDP_XUP_CAP_GFX_SHMEM_OFFSET 6
+
+/* num_rects_c that says a cell map follows instead of the copy rects */
+#define RDP_RECTS_TILE_MAP 0xFFFF
+/* longest cell run one out_tile_map code holds */
+#define RDP_TILE_MAP_MAX_RUN 0x7FFF
+
 #define LTOUI32(_in) ((unsigned int)(_in))
 
 #define USE_MAX_OS_BYTES 1
@@ -100,8 +159,46 @@ static int g_rdp_opcodes[16] =
     0xff  /* GXset          0xf 1 */
 };
 
+/* capture on a separate thread, the X server thread copies the dirty
+   spans of the framebuffer to shadow and posts the job, the capture thread
+   converts into shared memory and writes a byte to the pipe, then the
+   X server thread sends the paint message */
+struct rdp_cap_async
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int pipe_fds[2]; /* capture thread writes [1], X server thread reads [0] */
+    int stop;
+    int posted; /* the capture thread has a job */
+    int busy; /* posted, or done and not sent yet */
+    /* the job */
+    rdpClientCon *clientCon;
+    RegionPtr cap_dirty;
+    struct image_data id;
+    int mon;
+    BoxPtr rects;
+    int num_rects;
+    int status; /* from rdpCapture, logged on the X server thread */
+    /* same layout as dev->pfbMemory */
+    uint8_t *shadow;
+    int shadow_bytes;
+};
+
+/* capture modes that align rects read up to this many pixels outside
+   the dirty region */
+#define RDP_CAP_ASYNC_MARGIN 16
+
 static int
 rdpClientConDisconnect(rdpPtr dev, rdpClientCon *clientCon);
+static void
+rdpClientConSetDisconnected(rdpClientCon *clientCon);
+static void
+rdpClientConFreeOutQueue(rdpClientCon *clientCon);
+static void
+rdpCapFrameReset(rdpClientCon *clientCon);
+static void
+rdpCapFrameRun(rdpClientCon *clientCon);
 static CARD32
 rdpDeferredIdleDisconnectCallback(OsTimerPtr timer, CARD32 now, pointer arg);
 static void
@@ -110,12 +207,53 @@ static void
 rdpClientConProcessClientInfoMonitors(rdpPtr dev, rdpClientCon *clientCon);
 static int
 rdpSendMemoryAllocationComplete(rdpPtr dev, rdpClientCon *clientCon);
+static void
+rdpClientConFreeSharedMemory(rdpClientCon *clientCon);
+int
+rdpClientConPreCheck(rdpPtr dev, rdpClientCon *clientCon, int in_size);
+static struct rdp_cap_async *
+rdpCapAsyncCreate(ScreenPtr pScreen, rdpClientCon *clientCon);
+static void
+rdpCapAsyncDelete(rdpClientCon *clientCon);
+static void
+rdpCapAsyncWait(rdpClientCon *clientCon);
+static int
+rdpClientConGotCaptureDone(ScreenPtr pScreen, rdpPtr dev,
+                           rdpClientCon *clientCon);
+static void
+rdpClientConDirtyGridInit(rdpPtr dev, rdpClientCon *clientCon);
+static void
+rdpClientConDirtyGridDelete(rdpClientCon *clientCon);
+static Bool
+rdpClientConDirtyPending(rdpClientCon *clientCon);
+static void
+rdpClientConDirtyGridFlush(rdpClientCon *clientCon);
+static void
+rdpClientConSimplifyRegion(rdpClientCon *clientCon, RegionPtr reg);
+
+/* called for the fds rdpClientConAddEnabledDevice watches */
+typedef void (*rdp_notify_proc)(int fd, int ready, void *data);
+
+static void
+rdpClientConListenNotify(int fd, int ready, void *data);
+static void
+rdpClientConDisconnectNotify(int fd, int ready, void *data);
+static void
+rdpClientConSckNotify(int fd, int ready, void *data);
+static void
+rdpClientConCapAsyncNotify(int fd, int ready, void *data);
 
 #if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1, 18, 5, 0, 0)
 
+/* these servers have no notify procs, rdpClientConCheck selects on the
+   fds and calls the procs with these */
+#define X_NOTIFY_READ 1
+#define X_NOTIFY_WRITE 2
+
 /******************************************************************************/
 static int
-rdpClientConAddEnabledDevice(ScreenPtr pScreen, int fd)
+rdpClientConAddEnabledDevice(ScreenPtr pScreen, int fd,
+                             rdp_notify_proc proc, void *data)
 {
     AddEnabledDevice(fd);
     return 0;
@@ -129,21 +267,52 @@ rdpClientConRemoveEnabledDevice(int fd)
     return 0;
 }
 
-#else
+/******************************************************************************/
+/* the wakeup handler calls rdpClientConCheck, which sends the queue */
+static CARD32
+rdpClientConOutTimerCallback(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    rdpClientCon *clientCon;
+
+    clientCon = (rdpClientCon *) arg;
+    if (clientCon->out_head != NULL)
+    {
+        return RDP_OUT_RETRY_MS;
+    }
+    return 0;
+}
 
 /******************************************************************************/
-static void
-rdpClientConNotifyFdProcPtr(int fd, int ready, void *data)
+/* no write notify here, a timer wakes the X server while there is a
+   queue */
+static int
+rdpClientConSetWriteNotify(ScreenPtr pScreen, rdpClientCon *clientCon,
+                           int on)
 {
-    ScreenPtr pScreen = (ScreenPtr) data;
-    rdpClientConCheck(pScreen);
+    if (on)
+    {
+        clientCon->out_timer = TimerSet(clientCon->out_timer, 0,
+                                        RDP_OUT_RETRY_MS,
+                                        rdpClientConOutTimerCallback,
+                                        clientCon);
+    }
+    else if (clientCon->out_timer != NULL)
+    {
+        TimerCancel(clientCon->out_timer);
+    }
+    return 0;
 }
 
+#else
+
 /******************************************************************************/
+/* the X server calls proc when fd is readable, nothing is polled on
+   wakeups that are not for xrdp */
 static int
-rdpClientConAddEnabledDevice(ScreenPtr pScreen, int fd)
+rdpClientConAddEnabledDevice(ScreenPtr pScreen, int fd,
+                             rdp_notify_proc proc, void *data)
 {
-    SetNotifyFd(fd, rdpClientConNotifyFdProcPtr, X_NOTIFY_READ, pScreen);
+    SetNotifyFd(fd, proc, X_NOTIFY_READ, data);
     return 0;
 }
 
@@ -155,6 +324,18 @@ rdpClientConRemoveEnabledDevice(int fd)
     return 0;
 }
 
+/******************************************************************************/
+/* also wake up when sck is writable, while there is a queue */
+static int
+rdpClientConSetWriteNotify(ScreenPtr pScreen, rdpClientCon *clientCon,
+                           int on)
+{
+    SetNotifyFd(clientCon->sck, rdpClientConSckNotify,
+                on ? X_NOTIFY_READ | X_NOTIFY_WRITE : X_NOTIFY_READ,
+                clientCon);
+    return 0;
+}
+
 #endif
 
 /******************************************************************************/
@@ -215,9 +396,19 @@ rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
     int new_sck;
 
     LLOGLN(0, ("rdpClientConGotConnection:"));
+    new_sck = g_sck_accept(dev->listen_sck);
+    if (new_sck == -1)
+    {
+        /* nothing to add, a clientCon that never connected would not be
+           removed */
+        LLOGLN(0, ("rdpClientConGotConnection: g_sck_accept failed"));
+        return 1;
+    }
     clientCon = g_new0(rdpClientCon, 1);
     clientCon->shmemstatus = SHM_UNINITIALIZED;
     clientCon->updateRetries = 0;
+    clientCon->pace.frame_ms = RDP_PACE_START_MS;
+    clientCon->pace.stats_time = GetTimeInMillis();
     clientCon->dev = dev;
     clientCon->shmemfd = -1;
     dev->last_event_time_ms = GetTimeInMillis();
@@ -227,34 +418,29 @@ rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
     init_stream(clientCon->in_s, 8192);
     make_stream(clientCon->out_s);
     init_stream(clientCon->out_s, 8192 * 4 + 100);
-
-    new_sck = g_sck_accept(dev->listen_sck);
-    if (new_sck == -1)
-    {
-        LLOGLN(0, ("rdpClientConGotConnection: g_sck_accept failed"));
-    }
-    else
-    {
-        LLOGLN(0, ("rdpClientConGotConnection: g_sck_accept ok new_sck %d",
-               new_sck));
-        clientCon->sck = new_sck;
-        g_sck_set_non_blocking(clientCon->sck);
-        g_sck_tcp_set_no_delay(clientCon->sck); /* only works if TCP */
-        clientCon->connected = TRUE;
-        clientCon->begin = FALSE;
-        dev->conNumber++;
-        clientCon->conNumber = dev->conNumber;
-        rdpClientConAddEnabledDevice(pScreen, clientCon->sck);
-    }
+    make_stream(clientCon->frame_s);
+    init_stream(clientCon->frame_s, 8192 * 4);
+    clientCon->frame_shmem_fd = -1;
+
+    LLOGLN(0, ("rdpClientConGotConnection: g_sck_accept ok new_sck %d",
+           new_sck));
+    clientCon->sck = new_sck;
+    g_sck_set_non_blocking(clientCon->sck);
+    g_sck_tcp_set_no_delay(clientCon->sck); /* only works if TCP */
+    clientCon->connected = TRUE;
+    clientCon->begin = FALSE;
+    dev->conNumber++;
+    clientCon->conNumber = dev->conNumber;
+    rdpClientConAddEnabledDevice(pScreen, clientCon->sck,
+                                 rdpClientConSckNotify, clientCon);
 
 #if 1
-    if (dev->clientConTail != NULL)
+    while (dev->clientConHead != NULL)
     {
         /* Only allow one client at a time */
         LLOGLN(0, ("rdpClientConGotConnection: "
-                   "marking only clientCon %p for disconnect",
-                   dev->clientConTail));
-        dev->clientConTail->connected = FALSE;
+                   "disconnecting clientCon %p", dev->clientConHead));
+        rdpClientConDisconnect(dev, dev->clientConHead);
     }
 #endif
 
@@ -276,6 +462,11 @@ rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
 
     clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
     clientCon->shmRegion = rdpRegionCreate(NullBox, 0);
+    clientCon->frame_dirty = rdpRegionCreate(NullBox, 0);
+    rdpRegionInit(&(clientCon->cap_dirty), NullBox, 0);
+    clientCon->cap_arena = g_new0(struct rdp_arena, 1);
+
+    clientCon->cap_async = rdpCapAsyncCreate(pScreen, clientCon);
 
     return 0;
 }
@@ -388,8 +579,20 @@ rdpClientConDisconnect(rdpPtr dev, rdpClientCon *clientCon)
         dev->disconnect_time_ms = GetTimeInMillis();
     }
 
+    rdpCapAsyncDelete(clientCon);
     rdpClientConRemoveEnabledDevice(clientCon->sck);
     g_sck_close(clientCon->sck);
+    rdpClientConFreeOutQueue(clientCon);
+    if (clientCon->out_timer != NULL)
+    {
+        TimerCancel(clientCon->out_timer);
+        TimerFree(clientCon->out_timer);
+    }
+    if (clientCon->remove_timer != NULL)
+    {
+        TimerCancel(clientCon->remove_timer);
+        TimerFree(clientCon->remove_timer);
+    }
     if (clientCon->maxOsBitmaps > 0)
     {
         for (index = 0; index < clientCon->maxOsBitmaps; index++)
@@ -404,83 +607,258 @@ rdpClientConDisconnect(rdpPtr dev, rdpClientCon *clientCon)
         }
     }
     free(clientCon->osBitmaps);
+    for (index = 0; index < 16; index++)
+    {
+        free(clientCon->rfx_tile_hashes[index]);
+        free(clientCon->mb_hashes[index]);
+    }
+    free(clientCon->mb_changed);
+    free(clientCon->tile_cells);
+    free(clientCon->tile_map);
+    rdpClientConDirtyGridDelete(clientCon);
+    free(clientCon->simplify_boxes);
+    free(clientCon->simplify_rects);
+    free(clientCon->cap_stale_rects);
+    rdpRegionUninit(&(clientCon->cap_dirty));
+    rdpArenaDelete(clientCon->cap_arena);
+    free(clientCon->cap_arena);
 
     rdpRemoveClientConFromDev(dev, clientCon);
 
     rdpRegionDestroy(clientCon->dirtyRegion);
     rdpRegionDestroy(clientCon->shmRegion);
+    rdpRegionDestroy(clientCon->frame_dirty);
     if (clientCon->updateTimer != NULL)
     {
         TimerCancel(clientCon->updateTimer);
         TimerFree(clientCon->updateTimer);
     }
     free_stream(clientCon->out_s);
+    free_stream(clientCon->frame_s);
     free_stream(clientCon->in_s);
-    if (clientCon->shmemptr != NULL)
-    {
-        g_free_unmap_fd(clientCon->shmemptr,
-                        clientCon->shmemfd,
-                        clientCon->shmem_bytes);
-    }
+    rdpClientConFreeSharedMemory(clientCon);
     free(clientCon);
     return 0;
 }
 
 /*****************************************************************************/
-/* returns error */
-static int
-rdpClientConSend(rdpPtr dev, rdpClientCon *clientCon, const char *data, int len)
+static CARD32
+rdpClientConRemoveTimerCallback(OsTimerPtr timer, CARD32 now, pointer arg)
 {
-    int sent;
-    int retries = 0;
+    rdpClientCon *clientCon;
 
-    LLOGLN(10, ("rdpClientConSend - sending %d bytes", len));
+    clientCon = (rdpClientCon *) arg;
+    LLOGLN(0, ("rdpClientConRemoveTimerCallback: removing clientCon %p",
+               clientCon));
+    rdpClientConDisconnect(clientCon->dev, clientCon);
+    return 0;
+}
 
+/*****************************************************************************/
+/* for I/O errors deep in the call stack, where clientCon can not be
+   freed, it is removed from a timer once the stack unwinds, the fd may
+   never be ready again to do it */
+static void
+rdpClientConSetDisconnected(rdpClientCon *clientCon)
+{
     if (!clientCon->connected)
     {
-        return 1;
+        return;
+    }
+    clientCon->connected = FALSE;
+    /* TimerSet does not arm a timer for 0 ms */
+    clientCon->remove_timer = TimerSet(clientCon->remove_timer, 0, 1,
+                                       rdpClientConRemoveTimerCallback,
+                                       clientCon);
+}
+
+/*****************************************************************************/
+static void
+rdpClientConFreeOutQueue(rdpClientCon *clientCon)
+{
+    struct rdp_out_msg *msg;
+
+    while (clientCon->out_head != NULL)
+    {
+        msg = clientCon->out_head;
+        clientCon->out_head = msg->next;
+        if (msg->fd >= 0)
+        {
+            close(msg->fd);
+        }
+        free(msg->data);
+        free(msg);
     }
+    clientCon->out_tail = NULL;
+    clientCon->out_bytes = 0;
+}
+
+/*****************************************************************************/
+/* sends what it can, the first byte carries fd if it is not -1
+   returns bytes sent, 0 if sck would block, -1 on error */
+static int
+rdpClientConSendSome(rdpClientCon *clientCon, const char *data, int len,
+                     int fd)
+{
+    int sent;
 
-    while (len > 0)
+    if (fd >= 0)
+    {
+        sent = g_sck_send_fd_set(clientCon->sck, data, len, &fd, 1);
+    }
+    else
     {
         sent = g_sck_send(clientCon->sck, data, len, 0);
+    }
+    if (sent > 0)
+    {
+        return sent;
+    }
+    if ((sent == -1) && g_sck_last_error_would_block(clientCon->sck))
+    {
+        return 0;
+    }
+    LLOGLN(0, ("rdpClientConSendSome: g_tcp_send failed(returned %d)",
+           sent));
+    rdpClientConSetDisconnected(clientCon);
+    return -1;
+}
+
+/*****************************************************************************/
+/* called when sck is writable
+   returns error */
+static int
+rdpClientConSendQueued(rdpPtr dev, rdpClientCon *clientCon)
+{
+    struct rdp_out_msg *msg;
+    int sent;
 
-        if (sent == -1)
+    while (clientCon->out_head != NULL)
+    {
+        msg = clientCon->out_head;
+        sent = rdpClientConSendSome(clientCon, msg->data + msg->offset,
+                                    msg->len - msg->offset, msg->fd);
+        if (sent < 0)
         {
-            if (g_sck_last_error_would_block(clientCon->sck))
-            {
-                // Just because we couldn't after 100 retries
-                // does not mean we're disconnected.
-                if (retries > 100)
-                {
-                    return 0;
-                }
-                ++retries;
-                g_sleep(1);
-            }
-            else
-            {
-                LLOGLN(0, ("rdpClientConSend: g_tcp_send failed(returned -1)"));
-                clientCon->connected = FALSE;
-                return 1;
-            }
+            return 1;
+        }
+        if (sent == 0)
+        {
+            return 0;
+        }
+        if (msg->fd >= 0)
+        {
+            /* it went with the first byte */
+            close(msg->fd);
+            msg->fd = -1;
         }
-        else if (sent == 0)
+        msg->offset += sent;
+        clientCon->out_bytes -= sent;
+        if (msg->offset < msg->len)
+        {
+            continue;
+        }
+        clientCon->out_head = msg->next;
+        if (clientCon->out_head == NULL)
+        {
+            clientCon->out_tail = NULL;
+        }
+        free(msg->data);
+        free(msg);
+    }
+    LLOGLN(10, ("rdpClientConSendQueued: queue empty"));
+    rdpClientConSetWriteNotify(dev->pScreen, clientCon, 0);
+    if (rdpClientConDirtyPending(clientCon))
+    {
+        /* captures were skipped while the queue was long */
+        rdpScheduleDeferredUpdate(clientCon);
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* sends data and fd, if -1 is not, what the socket does not take now
+   is queued and sent when it is writable, never blocks
+   returns error */
+static int
+rdpClientConSendData(rdpPtr dev, rdpClientCon *clientCon, const char *data,
+                     int len, int fd)
+{
+    struct rdp_out_msg *msg;
+    int sent;
+
+    if (!clientCon->connected)
+    {
+        return 1;
+    }
+    if (clientCon->out_head == NULL)
+    {
+        sent = rdpClientConSendSome(clientCon, data, len, fd);
+        if (sent < 0)
         {
-            LLOGLN(0, ("rdpClientConSend: g_tcp_send failed(returned zero)"));
-            clientCon->connected = FALSE;
             return 1;
         }
-        else
+        if (sent == len)
+        {
+            return 0;
+        }
+        if (sent > 0)
         {
             data += sent;
             len -= sent;
+            fd = -1;
         }
     }
-
+    if (clientCon->out_bytes + len > RDP_OUT_MAX_BYTES)
+    {
+        LLOGLN(0, ("rdpClientConSendData: xrdp is not reading, %d bytes "
+               "queued", clientCon->out_bytes));
+        rdpClientConSetDisconnected(clientCon);
+        return 1;
+    }
+    msg = g_new(struct rdp_out_msg, 1);
+    msg->next = NULL;
+    msg->data = g_new(char, len);
+    memcpy(msg->data, data, len);
+    msg->len = len;
+    msg->offset = 0;
+    /* the caller can close fd before the queue gets to it */
+    msg->fd = (fd >= 0) ? dup(fd) : -1;
+    if (clientCon->out_tail == NULL)
+    {
+        clientCon->out_head = msg;
+        rdpClientConSetWriteNotify(dev->pScreen, clientCon, 1);
+    }
+    else
+    {
+        clientCon->out_tail->next = msg;
+    }
+    clientCon->out_tail = msg;
+    clientCon->out_bytes += len;
+    LLOGLN(10, ("rdpClientConSendData: queued %d, %d bytes queued", len,
+           clientCon->out_bytes));
     return 0;
 }
 
+/*****************************************************************************/
+/* returns error */
+static int
+rdpClientConSend(rdpPtr dev, rdpClientCon *clientCon, const char *data, int len)
+{
+    LLOGLN(10, ("rdpClientConSend - sending %d bytes", len));
+    return rdpClientConSendData(dev, clientCon, data, len, -1);
+}
+
+/*****************************************************************************/
+/* an fd for xrdp, with a 4 byte message to carry it
+   returns error */
+static int
+rdpClientConSendFd(rdpPtr dev, rdpClientCon *clientCon, int fd)
+{
+    LLOGLN(10, ("rdpClientConSendFd - sending fd %d", fd));
+    return rdpClientConSendData(dev, clientCon, "int", 4, fd);
+}
+
 /******************************************************************************/
 static int
 rdpClientConSendMsg(rdpPtr dev, rdpClientCon *clientCon)
@@ -541,92 +919,6 @@ rdpClientConSendPending(rdpPtr dev, rdpClientCon *clientCon)
     return rv;
 }
 
-/******************************************************************************/
-/* returns error */
-static int
-rdpClientConRecv(rdpPtr dev, rdpClientCon *clientCon, char *data, int len)
-{
-    int rcvd;
-
-    if (!clientCon->connected)
-    {
-        return 1;
-    }
-
-    while (len > 0)
-    {
-        rcvd = g_sck_recv(clientCon->sck, data, len, 0);
-
-        if (rcvd == -1)
-        {
-            if (g_sck_last_error_would_block(clientCon->sck))
-            {
-                g_sleep(1);
-            }
-            else
-            {
-                LLOGLN(0, ("rdpClientConRecv: g_sck_recv failed(returned -1)"));
-                clientCon->connected = FALSE;
-                return 1;
-            }
-        }
-        else if (rcvd == 0)
-        {
-            LLOGLN(0, ("rdpClientConRecv: g_sck_recv failed(returned 0)"));
-            clientCon->connected = FALSE;
-            return 1;
-        }
-        else
-        {
-            data += rcvd;
-            len -= rcvd;
-        }
-    }
-
-    return 0;
-}
-
-/******************************************************************************/
-static int
-rdpClientConRecvMsg(rdpPtr dev, rdpClientCon *clientCon)
-{
-    int len;
-    int rv;
-    struct stream *s;
-
-    rv = 1;
-
-    s = clientCon->in_s;
-    if (s != 0)
-    {
-        init_stream(s, 4);
-        rv = rdpClientConRecv(dev, clientCon, s->data, 4);
-
-        if (rv == 0)
-        {
-            s->end = s->data + 4;
-            in_uint32_le(s, len);
-
-            if (len > 3)
-            {
-                init_stream(s, len);
-                rv = rdpClientConRecv(dev, clientCon, s->data, len - 4);
-                if (rv == 0)
-                {
-                    s->end = s->data + len;
-                }
-            }
-        }
-    }
-
-    if (rv != 0)
-    {
-        LLOGLN(0, ("rdpClientConRecvMsg: error"));
-    }
-
-    return rv;
-}
-
 /******************************************************************************/
 static int
 rdpClientConSendCaps(rdpPtr dev, rdpClientCon *clientCon)
@@ -656,9 +948,34 @@ rdpClientConSendCaps(rdpPtr dev, rdpClientCon *clientCon)
     cap_bytes += 4;
 #endif
 
-    s_mark_end(ls);
-    len = (int)(ls->end - ls->data);
-    s_pop_layer(ls, iso_hdr);
+    out_uint16_le(ls, RDP_XUP_CAP_TILE_MAP);
+    out_uint16_le(ls, 4);
+    cap_count++;
+    cap_bytes += 4;
+
+    out_uint16_le(ls, RDP_XUP_CAP_SHM_BUFS);
+    out_uint16_le(ls, 4);
+    cap_count++;
+    cap_bytes += 4;
+
+    out_uint16_le(ls, RDP_XUP_CAP_MB_MAP);
+    out_uint16_le(ls, 4);
+    cap_count++;
+    cap_bytes += 4;
+
+    out_uint16_le(ls, RDP_XUP_CAP_SHARED_FB);
+    out_uint16_le(ls, 4);
+    cap_count++;
+    cap_bytes += 4;
+
+    out_uint16_le(ls, RDP_XUP_CAP_GFX_SHMEM_OFFSET);
+    out_uint16_le(ls, 4);
+    cap_count++;
+    cap_bytes += 4;
+
+    s_mark_end(ls);
+    len = (int)(ls->end - ls->data);
+    s_pop_layer(ls, iso_hdr);
     out_uint16_le(ls, 2); /* caps */
     out_uint16_le(ls, cap_count); /* num caps */
     out_uint32_le(ls, cap_bytes); /* caps len after header */
@@ -690,48 +1007,293 @@ rdpClientConProcessMsgVersion(rdpPtr dev, rdpClientCon *clientCon,
     return 0;
 }
 
+/******************************************************************************/
+static void
+rdpClientConFreeSharedMemory(rdpClientCon *clientCon)
+{
+    struct rdp_shm_buf *buf;
+    int index;
+
+    for (index = 0; index < clientCon->num_shm_bufs; index++)
+    {
+        buf = clientCon->shm_bufs + index;
+        g_free_unmap_fd(buf->ptr, buf->fd, buf->bytes);
+        rdpRegionDestroy(buf->stale);
+    }
+    memset(clientCon->shm_bufs, 0, sizeof(clientCon->shm_bufs));
+    clientCon->num_shm_bufs = 0;
+    clientCon->shm_buf_index = 0;
+    clientCon->num_cap_stale_rects = 0;
+    clientCon->shmemptr = NULL;
+    clientCon->shmemfd = -1;
+    clientCon->shmem_bytes = 0;
+}
+
+/******************************************************************************/
+/* tells xrdp about a new ring of capture buffers, or that there is none
+   any more, paints then name a buffer by its index and the generation
+   instead of sending its fd each time
+   only for an xrdp that took RDP_XUP_CAP_SHM_BUFS, others get the fd
+   with each paint */
+static int
+rdpClientConSendShmBufs(rdpPtr dev, rdpClientCon *clientCon)
+{
+    int size;
+    int index;
+    int rv;
+
+    if (!clientCon->connected ||
+        ((clientCon->xrdp_caps & (1 << RDP_XUP_CAP_SHM_BUFS)) == 0))
+    {
+        return 0;
+    }
+    clientCon->shm_generation++;
+    LLOGLN(0, ("rdpClientConSendShmBufs: generation %d with %d buffers",
+           clientCon->shm_generation, clientCon->num_shm_bufs));
+    size = 2 + 2 + 4 + 4 + clientCon->num_shm_bufs * 4;
+    rdpClientConPreCheck(dev, clientCon, size);
+    out_uint16_le(clientCon->out_s, 65); /* set shm buffers */
+    out_uint16_le(clientCon->out_s, size);
+    clientCon->count++;
+    out_uint32_le(clientCon->out_s, clientCon->shm_generation);
+    out_uint32_le(clientCon->out_s, clientCon->num_shm_bufs);
+    for (index = 0; index < clientCon->num_shm_bufs; index++)
+    {
+        out_uint32_le(clientCon->out_s, clientCon->shm_bufs[index].bytes);
+    }
+    /* the fds follow the message, in buffer order */
+    rv = rdpClientConSendPending(dev, clientCon);
+    for (index = 0; index < clientCon->num_shm_bufs; index++)
+    {
+        if (rdpClientConSendFd(dev, clientCon,
+                               clientCon->shm_bufs[index].fd) != 0)
+        {
+            rv = 1;
+        }
+    }
+    return rv;
+}
+
+/******************************************************************************/
+/* capture buffers in the ring, xrdp without RDP_XUP_CAP_SHM_BUFS keeps
+   one mapping and closes the fds that come after, it only gets one */
+static int
+rdpClientConNumShmBufs(rdpClientCon *clientCon)
+{
+    if ((clientCon->xrdp_caps & (1 << RDP_XUP_CAP_SHM_BUFS)) == 0)
+    {
+        return 1;
+    }
+    return RDPCLAMP(clientCon->dev->capture_frames, 1, RDP_MAX_SHM_BUFS);
+}
+
 /**************************************************************************//**
  * Allocate shared memory
  *
  * This memory is shared with the xup driver in xrdp which avoids a lot
  * of unnecessary copying
  *
+ * There are rdpClientConNumShmBufs buffers of this size so capture can
+ * run ahead of xrdp, see rdpClientConSelectShmBuf. The first one is in use.
+ * With the same size, the buffer in use is kept and only the count
+ * changes, see rdpClientConProcessMsgCaps.
+ *
  * @param clientCon Client connection
- * @param bytes Size of area to attach
+ * @param bytes Size of area to attach, 0 to only free
  */
 static void
 rdpClientConAllocateSharedMemory(rdpClientCon *clientCon, int bytes)
 {
+    struct rdp_shm_buf *buf;
+    struct rdp_shm_buf in_use;
+    BoxRec box;
     void *shmemptr;
     int shmemfd;
+    int num_shm_bufs;
+    int index;
+    Bool in_place;
+
+    num_shm_bufs = rdpClientConNumShmBufs(clientCon);
+    if (clientCon->num_shm_bufs == num_shm_bufs &&
+        clientCon->shmem_bytes == bytes)
+    {
+        LLOGLN(0, ("rdpClientConAllocateSharedMemory: reusing %d buffers",
+               num_shm_bufs));
+        return;
+    }
+    in_place = (clientCon->num_shm_bufs > 0) &&
+               (clientCon->shmem_bytes == bytes);
+    if (in_place)
+    {
+        /* parts of a frame can point at the buffer in use, it moves to
+           the front and stays */
+        in_use = clientCon->shm_bufs[clientCon->shm_buf_index];
+        clientCon->shm_bufs[clientCon->shm_buf_index] = clientCon->shm_bufs[0];
+        clientCon->shm_bufs[0] = in_use;
+        clientCon->shm_buf_index = 0;
+        while (clientCon->num_shm_bufs > num_shm_bufs)
+        {
+            clientCon->num_shm_bufs--;
+            buf = clientCon->shm_bufs + clientCon->num_shm_bufs;
+            g_free_unmap_fd(buf->ptr, buf->fd, buf->bytes);
+            rdpRegionDestroy(buf->stale);
+            memset(buf, 0, sizeof(struct rdp_shm_buf));
+        }
+    }
+    else
+    {
+        rdpClientConFreeSharedMemory(clientCon);
+        if (bytes < 1)
+        {
+            /* capturing straight from the shared framebuffer */
+            return;
+        }
+    }
+    for (index = clientCon->num_shm_bufs; index < num_shm_bufs; index++)
+    {
+        if (g_alloc_shm_map_fd(&shmemptr, &shmemfd, bytes) != 0)
+        {
+            LLOGLN(0, ("rdpClientConAllocateSharedMemory: g_alloc_shm_map_fd "
+                   "failed"));
+            break;
+        }
+        buf = clientCon->shm_bufs + index;
+        buf->ptr = (uint8_t *) shmemptr;
+        buf->fd = shmemfd;
+        buf->bytes = bytes;
+        buf->stale = rdpRegionCreate(NullBox, 0);
+        if (in_place)
+        {
+            /* a buffer added to a ring in use missed all of it */
+            box.x1 = 0;
+            box.y1 = 0;
+            box.x2 = clientCon->dev->width;
+            box.y2 = clientCon->dev->height;
+            rdpRegionUnionRect(buf->stale, &box);
+        }
+        LLOGLN(0, ("rdpClientConAllocateSharedMemory: shmemfd %d shmemptr %p "
+               "bytes %d", buf->fd, buf->ptr, buf->bytes));
+    }
+    clientCon->num_shm_bufs = index;
+    if (index > 0)
+    {
+        clientCon->shmemptr = clientCon->shm_bufs[0].ptr;
+        clientCon->shmemfd = clientCon->shm_bufs[0].fd;
+        clientCon->shmem_bytes = bytes;
+    }
+    rdpClientConSendShmBufs(clientCon->dev, clientCon);
+}
+
+/******************************************************************************/
+/* index of the capture buffer with fd, -1 if it is not one of them or
+   xrdp does not know the buffers from message 65 */
+static int
+rdpClientConShmBufId(rdpClientCon *clientCon, int fd)
+{
+    int index;
+
+    if ((clientCon->xrdp_caps & (1 << RDP_XUP_CAP_SHM_BUFS)) == 0)
+    {
+        return -1;
+    }
+    for (index = 0; index < clientCon->num_shm_bufs; index++)
+    {
+        if (clientCon->shm_bufs[index].fd == fd)
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/******************************************************************************/
+/* moves the parts of a new frame to the next capture buffer, only called
+   when rdpClientConCaptureBusy says xrdp is done with that buffer */
+static void
+rdpClientConSelectShmBuf(rdpClientCon *clientCon)
+{
+    struct rdp_shm_buf *buf;
+    struct image_data *id;
+    BoxPtr rects;
+    int num_rects;
+    int index;
+    int capture_code;
 
-    if (clientCon->shmemptr != NULL && clientCon->shmem_bytes == bytes)
+    id = &(clientCon->cap_parts[0].id);
+    if ((clientCon->num_shm_bufs < 1) || (clientCon->num_cap_parts < 1) ||
+        (id->shmem_pixels == id->pixels))
     {
-        LLOGLN(0, ("rdpClientConAllocateSharedMemory: reusing shmemfd %d",
-               clientCon->shmemfd));
         return;
     }
-    if (clientCon->shmemptr != NULL)
+    clientCon->shm_buf_index = (clientCon->shm_buf_index + 1) %
+                               clientCon->num_shm_bufs;
+    buf = clientCon->shm_bufs + clientCon->shm_buf_index;
+    clientCon->shmemptr = buf->ptr;
+    clientCon->shmemfd = buf->fd;
+    for (index = 0; index < clientCon->num_cap_parts; index++)
+    {
+        id = &(clientCon->cap_parts[index].id);
+        id->shmem_pixels = buf->ptr;
+        id->shmem_fd = buf->fd;
+        id->shmem_bytes = buf->bytes;
+    }
+    /* this one missed what the others brought, only H264 encodes more
+       than the paint rects
+       the new paint stays in, rdpCapture3 skips macroblocks that did not
+       change since the last capture, which went to another buffer */
+    clientCon->num_cap_stale_rects = 0;
+    capture_code = clientCon->client_info.capture_code;
+    if ((capture_code == 3) || (capture_code == 5))
     {
-        g_free_unmap_fd(clientCon->shmemptr,
-                        clientCon->shmemfd,
-                        clientCon->shmem_bytes);
-        clientCon->shmemptr = NULL;
-        clientCon->shmemfd = -1;
-        clientCon->shmem_bytes = 0;
+        num_rects = REGION_NUM_RECTS(buf->stale);
+        if (num_rects > 0)
+        {
+            if (num_rects > clientCon->cap_stale_rects_alloc)
+            {
+                free(clientCon->cap_stale_rects);
+                clientCon->cap_stale_rects = g_new(BoxRec, num_rects);
+                clientCon->cap_stale_rects_alloc = num_rects;
+            }
+            rects = REGION_RECTS(buf->stale);
+            memcpy(clientCon->cap_stale_rects, rects,
+                   num_rects * sizeof(BoxRec));
+            clientCon->num_cap_stale_rects = num_rects;
+        }
     }
-    if (g_alloc_shm_map_fd(&shmemptr, &shmemfd, bytes) != 0)
+    rdpRegionEmpty(buf->stale);
+}
+
+/******************************************************************************/
+/* the other capture buffers miss what this paint brings */
+static void
+rdpClientConShmBufPainted(rdpClientCon *clientCon, RegionPtr cap_dirty)
+{
+    int index;
+
+    for (index = 0; index < clientCon->num_shm_bufs; index++)
     {
-        LLOGLN(0, ("rdpClientConAllocateSharedMemory: g_alloc_shm_map_fd "
-               "failed"));
+        if (index != clientCon->shm_buf_index)
+        {
+            rdpRegionUnion(clientCon->shm_bufs[index].stale,
+                           clientCon->shm_bufs[index].stale, cap_dirty);
+        }
     }
-    clientCon->shmemptr = shmemptr;
-    clientCon->shmemfd = shmemfd;
-    clientCon->shmem_bytes = bytes;
-    LLOGLN(0, ("rdpClientConAllocateSharedMemory: shmemfd %d shmemptr %p "
-            "bytes %d",
-            clientCon->shmemfd, clientCon->shmemptr,
-            clientCon->shmem_bytes));
+}
+
+/******************************************************************************/
+/* capture code 0 at 32 bpp can send the framebuffer as is when it is
+   shared, see rdpAllocFramebuffer, and xrdp took RDP_XUP_CAP_SHARED_FB,
+   rdpClientConResizeAllMemoryAreas keeps the answer in cap_from_fb */
+static Bool
+rdpClientConFbShared(rdpPtr dev, rdpClientCon *clientCon)
+{
+    return (dev->pfbMemory_fd >= 0) &&
+           (clientCon->xrdp_caps & (1 << RDP_XUP_CAP_SHARED_FB)) &&
+           (clientCon->client_info.capture_code == 0) &&
+           (clientCon->rdp_format == XRDP_a8r8g8b8) &&
+           (clientCon->cap_width == dev->width) &&
+           (clientCon->cap_height == dev->height) &&
+           (clientCon->cap_stride_bytes == dev->paddedWidthInBytes);
 }
 
 /******************************************************************************/
@@ -771,6 +1333,9 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
 
     enum shared_memory_status shmemstatus;
 
+    /* the capture thread may be writing to the old shared memory */
+    rdpCapAsyncWait(clientCon);
+
     // Updare the rdp size from the client size
     clientCon->rdp_width = width;
     clientCon->rdp_height = height;
@@ -786,8 +1351,8 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
         LLOGLN(0, ("  cap_width %d cap_height %d",
                clientCon->cap_width, clientCon->cap_height));
 
-        bytes = clientCon->cap_width * clientCon->cap_height *
-                clientCon->rdp_Bpp;
+        /* room for every monitor, see rdpCapFrameAddMonitors */
+        bytes = rdpCaptureRfxBytes(clientCon);
 
         clientCon->shmem_lineBytes = clientCon->rdp_Bpp * clientCon->cap_width;
         clientCon->cap_stride_bytes = clientCon->cap_width * 4;
@@ -801,6 +1366,13 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
         clientCon->cap_height = height;
 
         bytes = clientCon->cap_width * clientCon->cap_height * 2;
+        if (clientCon->client_info.capture_format == XRDP_nv12_avc444)
+        {
+            /* main and auxiliary views, the auxiliary y plane is in
+               16 line groups */
+            clientCon->cap_height = RDPALIGN(height, XRDP_H264_ALIGN);
+            bytes = clientCon->cap_width * clientCon->cap_height * 3;
+        }
 
         clientCon->shmem_lineBytes = clientCon->rdp_Bpp * clientCon->cap_width;
         clientCon->cap_stride_bytes = clientCon->cap_width * 4;
@@ -817,7 +1389,6 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
         clientCon->cap_stride_bytes = clientCon->cap_width * clientCon->rdp_Bpp;
         shmemstatus = SHM_ACTIVE_PENDING;
     }
-    rdpClientConAllocateSharedMemory(clientCon, bytes);
 
     if (clientCon->client_info.capture_format != 0)
     {
@@ -878,7 +1449,18 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
         LLOGLN(0, ("rdpClientConProcessScreenSizeMsg: RRScreenSizeSet ok=[%d]", ok));
     }
 
+    /* caps from xrdp after this take effect with the next resize */
+    clientCon->cap_from_fb = rdpClientConFbShared(dev, clientCon);
+    if (clientCon->cap_from_fb)
+    {
+        /* no copy of the framebuffer needed */
+        bytes = 0;
+        clientCon->fb_generation_sent = 0;
+    }
+    rdpClientConAllocateSharedMemory(clientCon, bytes);
+
     rdpCaptureResetState(clientCon);
+    rdpClientConDirtyGridInit(dev, clientCon);
 
     if (clientCon->shmemstatus == SHM_UNINITIALIZED
        || clientCon->shmemstatus == SHM_RESIZING)
@@ -944,6 +1526,14 @@ rdpClientConProcessMsgClientInput(rdpPtr dev, rdpClientCon *clientCon)
     LLOGLN(10, ("rdpClientConProcessMsgClientInput: msg %d param1 %d param2 %d "
            "param3 %d param4 %d", msg, param1, param2, param3, param4));
 
+    if ((msg == 15) || ((msg > 100) && (msg < 200)))
+    {
+        /* key down, buttons and wheel, not mouse moves, the echo should
+           not wait for the paced slot */
+        clientCon->pace.input_time = GetTimeInMillis();
+        clientCon->pace.input_fast = 1;
+    }
+
     if (msg < 100)
     {
         rdpInputKeyboardEvent(dev, msg, param1, param2, param3, param4);
@@ -995,9 +1585,6 @@ rdpClientConProcessMsgClientInput(rdpPtr dev, rdpClientCon *clientCon)
     return 0;
 }
 
-int
-rdpClientConPreCheck(rdpPtr dev, rdpClientCon *clientCon, int in_size);
-
 /******************************************************************************/
 static int
 rdpSendMemoryAllocationComplete(rdpPtr dev, rdpClientCon *clientCon)
@@ -1223,6 +1810,162 @@ rdpClientConProcessMsgClientInfo(rdpPtr dev, rdpClientCon *clientCon)
     return 0;
 }
 
+/******************************************************************************/
+/* frames that can be on their way to xrdp, one for each capture buffer,
+   with the shared framebuffer as many as there would be buffers */
+static int
+rdpClientConCaptureWindow(rdpClientCon *clientCon)
+{
+    int window;
+
+    window = clientCon->num_shm_bufs;
+    if (window < 1)
+    {
+        window = rdpClientConNumShmBufs(clientCon);
+    }
+    return window;
+}
+
+/******************************************************************************/
+static int
+rdpClientConRegionPixels(RegionPtr reg)
+{
+    BoxPtr rects;
+    int num_rects;
+    int index;
+    int pixels;
+
+    rects = REGION_RECTS(reg);
+    num_rects = REGION_NUM_RECTS(reg);
+    pixels = 0;
+    for (index = 0; index < num_rects; index++)
+    {
+        pixels += (rects[index].x2 - rects[index].x1) *
+                  (rects[index].y2 - rects[index].y1);
+    }
+    return pixels;
+}
+
+/******************************************************************************/
+/* called after rect_id is bumped for a paint of pixels */
+static void
+rdpClientConPaceSent(rdpClientCon *clientCon, int pixels)
+{
+    struct rdp_pace *pace;
+    int slot;
+
+    pace = &(clientCon->pace);
+    slot = clientCon->rect_id % RDP_PACE_SLOTS;
+    pace->send_time[slot] = GetTimeInMillis();
+    pace->send_pixels[slot] = pixels;
+    pace->stats_frames++;
+    pace->stats_pixels += pixels;
+}
+
+/******************************************************************************/
+/* xrdp acked up to rect_id_ack, was up to prev_ack
+   the interval between captures follows how long acks take, when they
+   take much longer than the best lately frames are queueing somewhere
+   and the interval backs off, else it comes down a step at a time, it
+   stays within xorg.conf FrameRateMin and FrameRateMax */
+static void
+rdpClientConPaceAcked(rdpClientCon *clientCon, int prev_ack)
+{
+    struct rdp_pace *pace;
+    rdpPtr dev;
+    int ack;
+    int ack_ms;
+    int ms;
+    int pixels;
+    int frame_ms;
+    int min_ms;
+    int max_ms;
+
+    pace = &(clientCon->pace);
+    dev = clientCon->dev;
+    ack = clientCon->rect_id_ack;
+    if ((ack <= prev_ack) || (ack > clientCon->rect_id) ||
+        (clientCon->rect_id - ack >= RDP_PACE_SLOTS))
+    {
+        return;
+    }
+    ms = (int) (GetTimeInMillis() - pace->send_time[ack % RDP_PACE_SLOTS]);
+    ms = RDPMAX(ms, 1);
+    pixels = 0;
+    for (; (ack > prev_ack) && (ack > clientCon->rect_id - RDP_PACE_SLOTS);
+         ack--)
+    {
+        pixels += pace->send_pixels[ack % RDP_PACE_SLOTS];
+    }
+    if (pace->acks == 0)
+    {
+        pace->ack_ms8 = ms * 8;
+        pace->px_per_ms = pixels / ms;
+    }
+    else
+    {
+        pace->ack_ms8 += ms - pace->ack_ms8 / 8;
+        pace->px_per_ms += (pixels / ms - pace->px_per_ms) / 8;
+    }
+    if (((pace->acks % RDP_PACE_MIN_ACKS) == 0) || (ms < pace->ack_ms_min))
+    {
+        pace->ack_ms_min = ms;
+    }
+    pace->acks++;
+    pace->stats_acks++;
+
+    ack_ms = pace->ack_ms8 / 8;
+    frame_ms = pace->frame_ms;
+    if (ack_ms > pace->ack_ms_min * 2 + RDP_PACE_SLACK_MS)
+    {
+        frame_ms = frame_ms * 5 / 4 + 1;
+    }
+    else
+    {
+        frame_ms--;
+    }
+    /* no use capturing faster than acks come back for the frames in
+       flight */
+    frame_ms = RDPMAX(frame_ms, ack_ms / rdpClientConCaptureWindow(clientCon));
+    min_ms = 1000 / RDPMAX(dev->frame_rate_max, 1);
+    max_ms = 1000 / RDPMAX(dev->frame_rate_min, 1);
+    pace->frame_ms = RDPCLAMP(frame_ms, min_ms, RDPMAX(min_ms, max_ms));
+    LLOGLN(10, ("rdpClientConPaceAcked: ack %d ms avg %d best %d px/ms %d "
+           "frame_ms %d", ms, ack_ms, pace->ack_ms_min, pace->px_per_ms,
+           pace->frame_ms));
+}
+
+/******************************************************************************/
+/* logs the pacing stats every xorg.conf StatsInterval seconds */
+static void
+rdpClientConLogStats(rdpClientCon *clientCon, CARD32 now)
+{
+    struct rdp_pace *pace;
+    int ms;
+
+    pace = &(clientCon->pace);
+    ms = (int) (now - pace->stats_time);
+    if ((clientCon->dev->stats_interval_s < 1) ||
+        (ms < clientCon->dev->stats_interval_s * 1000))
+    {
+        return;
+    }
+    /* capture scratch heap allocs, 0 once the arena has grown to fit */
+    LLOGLN(0, ("rdpClientConLogStats: %d ms, %d frames, %d acks, "
+           "%d pixels/frame, ack %d ms, best %d ms, %d px/ms, "
+           "target %d fps, %d capture allocs", ms, pace->stats_frames,
+           pace->stats_acks,
+           pace->stats_pixels / RDPMAX(pace->stats_frames, 1),
+           pace->ack_ms8 / 8, pace->ack_ms_min, pace->px_per_ms,
+           1000 / RDPMAX(pace->frame_ms, 1),
+           clientCon->cap_arena->heap_allocs));
+    clientCon->cap_arena->heap_allocs = 0;
+    pace->stats_time = now;
+    pace->stats_frames = 0;
+    pace->stats_acks = 0;
+    pace->stats_pixels = 0;
+}
+
 /******************************************************************************/
 static int
 rdpClientConProcessMsgClientRegion(rdpPtr dev, rdpClientCon *clientCon)
@@ -1233,14 +1976,17 @@ rdpClientConProcessMsgClientRegion(rdpPtr dev, rdpClientCon *clientCon)
     int y;
     int cx;
     int cy;
+    int prev_ack;
     RegionRec reg;
     BoxRec box;
 
     LLOGLN(10, ("rdpClientConProcessMsgClientRegion:"));
     s = clientCon->in_s;
 
+    prev_ack = clientCon->rect_id_ack;
     in_uint32_le(s, flags);
     in_uint32_le(s, clientCon->rect_id_ack);
+    rdpClientConPaceAcked(clientCon, prev_ack);
     in_uint32_le(s, x);
     in_uint32_le(s, y);
     in_uint32_le(s, cx);
@@ -1270,10 +2016,12 @@ rdpClientConProcessMsgClientRegionEx(rdpPtr dev, rdpClientCon *clientCon)
 {
     struct stream *s;
     int flags;
+    int prev_ack;
 
     LLOGLN(10, ("rdpClientConProcessMsgClientRegionEx:"));
     s = clientCon->in_s;
 
+    prev_ack = clientCon->rect_id_ack;
     in_uint32_le(s, flags);
     in_uint32_le(s, clientCon->rect_id_ack);
     if (clientCon->rect_id_ack == INT_MAX)
@@ -1281,6 +2029,10 @@ rdpClientConProcessMsgClientRegionEx(rdpPtr dev, rdpClientCon *clientCon)
         // Client just wishes to ack all in-flight frames
         clientCon->rect_id_ack = clientCon->rect_id;
     }
+    else
+    {
+        rdpClientConPaceAcked(clientCon, prev_ack);
+    }
     LLOGLN(10, ("rdpClientConProcessMsgClientRegionEx: flags 0x%8.8x", flags));
     LLOGLN(10, ("rdpClientConProcessMsgClientRegionEx: rect_id %d "
            "rect_id_ack %d", clientCon->rect_id, clientCon->rect_id_ack));
@@ -1317,6 +2069,61 @@ rdpClientConProcessMsgClientSuppressOutput(rdpPtr dev, rdpClientCon *clientCon)
     return 0;
 }
 
+/******************************************************************************/
+/* the caps from message 2 that xrdp takes */
+static int
+rdpClientConProcessMsgCaps(rdpPtr dev, rdpClientCon *clientCon)
+{
+    int num_caps;
+    int cap_type;
+    int cap_len;
+    int index;
+    int old_caps;
+    struct stream *s;
+
+    s = clientCon->in_s;
+    in_uint16_le(s, num_caps);
+    old_caps = clientCon->xrdp_caps;
+    clientCon->xrdp_caps = 0;
+    for (index = 0; index < num_caps; index++)
+    {
+        if (s->p + 4 > s->end)
+        {
+            break;
+        }
+        in_uint16_le(s, cap_type);
+        in_uint16_le(s, cap_len);
+        if ((cap_len < 4) || (s->p + cap_len - 4 > s->end))
+        {
+            break;
+        }
+        s->p += cap_len - 4;
+        LLOGLN(0, ("rdpClientConProcessMsgCaps: xrdp takes cap %d",
+               cap_type));
+        if (cap_type < 32)
+        {
+            clientCon->xrdp_caps |= 1 << cap_type;
+        }
+    }
+    if (((old_caps ^ clientCon->xrdp_caps) &
+         (1 << RDP_XUP_CAP_SHM_BUFS)) &&
+        (clientCon->num_shm_bufs > 0))
+    {
+        /* the buffers came first, paints named them by fd until now, the
+           ring only has more than one with the cap */
+        if (clientCon->num_shm_bufs != rdpClientConNumShmBufs(clientCon))
+        {
+            rdpClientConAllocateSharedMemory(clientCon,
+                                             clientCon->shmem_bytes);
+        }
+        else
+        {
+            rdpClientConSendShmBufs(dev, clientCon);
+        }
+    }
+    return 0;
+}
+
 /******************************************************************************/
 static int
 rdpClientConProcessMsg(rdpPtr dev, rdpClientCon *clientCon)
@@ -1345,6 +2152,9 @@ rdpClientConProcessMsg(rdpPtr dev, rdpClientCon *clientCon)
         case 108: /* client suppress output */
             rdpClientConProcessMsgClientSuppressOutput(dev, clientCon);
             break;
+        case 109: /* xrdp caps */
+            rdpClientConProcessMsgCaps(dev, clientCon);
+            break;
         default:
             LLOGLN(0, ("rdpClientConProcessMsg: unknown msg_type %d",
                    msg_type));
@@ -1355,41 +2165,213 @@ rdpClientConProcessMsg(rdpPtr dev, rdpClientCon *clientCon)
 }
 
 /******************************************************************************/
+/* in_s->data holds what came from sck, messages from recv_start to
+   recv_end are not processed yet, the last may be partial, one recv
+   takes all there is room for
+   returns error */
 static int
-rdpClientConGotData(ScreenPtr pScreen, rdpPtr dev, rdpClientCon *clientCon)
+rdpClientConRecvAvailable(rdpPtr dev, rdpClientCon *clientCon)
 {
-    int rv;
-
-    LLOGLN(10, ("rdpClientConGotData:"));
+    struct stream *s;
+    char *data;
+    int pending;
+    int need;
+    int rcvd;
 
-    rv = rdpClientConRecvMsg(dev, clientCon);
-    if (rv == 0)
+    if (!clientCon->connected)
     {
-        rv = rdpClientConProcessMsg(dev, clientCon);
+        return 1;
     }
-
-    return rv;
-}
-
-/******************************************************************************/
-static int
-rdpClientConGotControlConnection(ScreenPtr pScreen, rdpPtr dev,
-                                 rdpClientCon *clientCon)
-{
-    LLOGLN(0, ("rdpClientConGotControlConnection:"));
+    s = clientCon->in_s;
+    pending = clientCon->recv_end - clientCon->recv_start;
+    /* a partial message must fit */
+    need = RDPMAX(clientCon->recv_need, RDP_RECV_MIN_ROOM + pending);
+    if (need > s->size)
+    {
+        data = g_new(char, need);
+        memcpy(data, s->data + clientCon->recv_start, pending);
+        free(s->data);
+        s->data = data;
+        s->size = need;
+        clientCon->recv_start = 0;
+        clientCon->recv_end = pending;
+    }
+    else if (s->size - clientCon->recv_end < need - pending)
+    {
+        memmove(s->data, s->data + clientCon->recv_start, pending);
+        clientCon->recv_start = 0;
+        clientCon->recv_end = pending;
+    }
+    rcvd = g_sck_recv(clientCon->sck, s->data + clientCon->recv_end,
+                      s->size - clientCon->recv_end, 0);
+    if (rcvd == -1)
+    {
+        if (g_sck_last_error_would_block(clientCon->sck))
+        {
+            return 0;
+        }
+        LLOGLN(0, ("rdpClientConRecvAvailable: g_sck_recv failed(returned -1)"));
+        rdpClientConSetDisconnected(clientCon);
+        return 1;
+    }
+    if (rcvd == 0)
+    {
+        LLOGLN(0, ("rdpClientConRecvAvailable: g_sck_recv failed(returned 0)"));
+        rdpClientConSetDisconnected(clientCon);
+        return 1;
+    }
+    clientCon->recv_end += rcvd;
+    LLOGLN(10, ("rdpClientConRecvAvailable: rcvd %d pending %d", rcvd,
+           clientCon->recv_end - clientCon->recv_start));
     return 0;
 }
 
 /******************************************************************************/
+/* processes every whole message received, each is a 4 byte length,
+   counting itself, and the body, in_s is set to the body
+   returns error */
 static int
-rdpClientConGotControlData(ScreenPtr pScreen, rdpPtr dev,
-                           rdpClientCon *clientCon)
+rdpClientConProcessRecv(rdpPtr dev, rdpClientCon *clientCon)
 {
-    LLOGLN(0, ("rdpClientConGotControlData:"));
+    struct stream *s;
+    char *msg;
+    int pending;
+    int len;
+
+    s = clientCon->in_s;
+    clientCon->recv_need = 0;
+    while (clientCon->connected)
+    {
+        pending = clientCon->recv_end - clientCon->recv_start;
+        if (pending < 4)
+        {
+            break;
+        }
+        msg = s->data + clientCon->recv_start;
+        len = (((unsigned char) msg[0]) << 0) |
+              (((unsigned char) msg[1]) << 8) |
+              (((unsigned char) msg[2]) << 16) |
+              (((unsigned char) msg[3]) << 24);
+        if ((len < 4) || (len > RDP_RECV_MAX_BYTES))
+        {
+            LLOGLN(0, ("rdpClientConProcessRecv: bad message length %d", len));
+            rdpClientConSetDisconnected(clientCon);
+            return 1;
+        }
+        if (pending < len)
+        {
+            /* the rest comes with the next recv */
+            clientCon->recv_need = len;
+            break;
+        }
+        s->p = msg + 4;
+        s->end = msg + len;
+        clientCon->recv_start += len;
+        rdpClientConProcessMsg(dev, clientCon);
+    }
+    if (clientCon->recv_start == clientCon->recv_end)
+    {
+        clientCon->recv_start = 0;
+        clientCon->recv_end = 0;
+    }
     return 0;
 }
 
 /******************************************************************************/
+static int
+rdpClientConGotData(ScreenPtr pScreen, rdpPtr dev, rdpClientCon *clientCon)
+{
+    int rv;
+
+    LLOGLN(10, ("rdpClientConGotData:"));
+
+    rv = rdpClientConRecvAvailable(dev, clientCon);
+    if (rv == 0)
+    {
+        rv = rdpClientConProcessRecv(dev, clientCon);
+    }
+
+    return rv;
+}
+
+/******************************************************************************/
+static void
+rdpClientConListenNotify(int fd, int ready, void *data)
+{
+    rdpPtr dev;
+
+    dev = (rdpPtr) data;
+    rdpClientConGotConnection(dev->pScreen, dev);
+}
+
+/******************************************************************************/
+static void
+rdpClientConDisconnectNotify(int fd, int ready, void *data)
+{
+    rdpPtr dev;
+    char buf[8];
+
+    dev = (rdpPtr) data;
+    if (g_sck_recv(dev->disconnect_sck, buf, sizeof(buf), 0))
+    {
+        LLOGLN(0, ("rdpClientConDisconnectNotify: got disconnection "
+               "request"));
+
+        /* disconnect all clients */
+        while (dev->clientConHead != NULL)
+        {
+            rdpClientConDisconnect(dev, dev->clientConHead);
+        }
+    }
+}
+
+/******************************************************************************/
+/* clientCon->sck is readable, or writable with a queue */
+static void
+rdpClientConSckNotify(int fd, int ready, void *data)
+{
+    rdpClientCon *clientCon;
+    rdpPtr dev;
+
+    clientCon = (rdpClientCon *) data;
+    dev = clientCon->dev;
+    if (ready & X_NOTIFY_WRITE)
+    {
+        if (rdpClientConSendQueued(dev, clientCon) != 0)
+        {
+            LLOGLN(0, ("rdpClientConSckNotify: rdpClientConSendQueued "
+                   "failed"));
+        }
+    }
+    if (clientCon->connected && (ready & X_NOTIFY_READ))
+    {
+        if (rdpClientConGotData(dev->pScreen, dev, clientCon) != 0)
+        {
+            LLOGLN(0, ("rdpClientConSckNotify: rdpClientConGotData failed"));
+        }
+    }
+    if (!clientCon->connected)
+    {
+        /* I/O error on this client - remove it */
+        rdpClientConDisconnect(dev, clientCon);
+    }
+}
+
+/******************************************************************************/
+static void
+rdpClientConCapAsyncNotify(int fd, int ready, void *data)
+{
+    rdpClientCon *clientCon;
+
+    clientCon = (rdpClientCon *) data;
+    rdpClientConGotCaptureDone(clientCon->dev->pScreen, clientCon->dev,
+                               clientCon);
+}
+
+#if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1, 18, 5, 0, 0)
+
+/******************************************************************************/
+/* these servers have no notify procs, the wakeup handler calls this */
 int
 rdpClientConCheck(ScreenPtr pScreen)
 {
@@ -1397,30 +2379,28 @@ rdpClientConCheck(ScreenPtr pScreen)
     rdpClientCon *clientCon;
     rdpClientCon *nextCon;
     fd_set rfds;
+    fd_set wfds;
     struct timeval time;
     int max;
     int sel;
-    int count;
-    char buf[8];
+    int ready;
 
     LLOGLN(10, ("rdpClientConCheck:"));
     dev = rdpGetDevFromScreen(pScreen);
     time.tv_sec = 0;
     time.tv_usec = 0;
     FD_ZERO(&rfds);
-    count = 0;
-    max = 0;
+    FD_ZERO(&wfds);
+    max = -1;
 
     if (dev->disconnect_sck > 0)
     {
-        count++;
         FD_SET(LTOUI32(dev->disconnect_sck), &rfds);
         max = RDPMAX(dev->disconnect_sck, max);
     }
 
     if (dev->listen_sck > 0)
     {
-        count++;
         FD_SET(LTOUI32(dev->listen_sck), &rfds);
         max = RDPMAX(dev->listen_sck, max);
     }
@@ -1438,31 +2418,27 @@ rdpClientConCheck(ScreenPtr pScreen)
 
         if (clientCon->sck > 0)
         {
-            count++;
             FD_SET(LTOUI32(clientCon->sck), &rfds);
+            if (clientCon->out_head != NULL)
+            {
+                FD_SET(LTOUI32(clientCon->sck), &wfds);
+            }
             max = RDPMAX(clientCon->sck, max);
         }
-        if (clientCon->sckControl > 0)
-        {
-            count++;
-            FD_SET(LTOUI32(clientCon->sckControl), &rfds);
-            max = RDPMAX(clientCon->sckControl, max);
-        }
-        if (clientCon->sckControlListener > 0)
+        if (clientCon->cap_async != NULL)
         {
-            count++;
-            FD_SET(LTOUI32(clientCon->sckControlListener), &rfds);
-            max = RDPMAX(clientCon->sckControlListener, max);
+            FD_SET(LTOUI32(clientCon->cap_async->pipe_fds[0]), &rfds);
+            max = RDPMAX(clientCon->cap_async->pipe_fds[0], max);
         }
         clientCon = clientCon->next;
     }
-    if (count < 1)
+    if (max < 0)
     {
         sel = 0;
     }
     else
     {
-        sel = select(max + 1, &rfds, 0, 0, &time);
+        sel = select(max + 1, &rfds, &wfds, 0, &time);
     }
     if (sel < 1)
     {
@@ -1474,7 +2450,7 @@ rdpClientConCheck(ScreenPtr pScreen)
     {
         if (FD_ISSET(LTOUI32(dev->listen_sck), &rfds))
         {
-            rdpClientConGotConnection(pScreen, dev);
+            rdpClientConListenNotify(dev->listen_sck, X_NOTIFY_READ, dev);
         }
     }
 
@@ -1482,61 +2458,55 @@ rdpClientConCheck(ScreenPtr pScreen)
     {
         if (FD_ISSET(LTOUI32(dev->disconnect_sck), &rfds))
         {
-
-            if (g_sck_recv(dev->disconnect_sck, buf, sizeof(buf), 0))
-            {
-                LLOGLN(0, ("rdpClientConCheck: got disconnection request"));
-
-                /* disconnect all clients */
-                while (dev->clientConHead != NULL)
-                {
-                    rdpClientConDisconnect(dev, dev->clientConHead);
-                }
-            }
+            rdpClientConDisconnectNotify(dev->disconnect_sck, X_NOTIFY_READ,
+                                         dev);
         }
     }
 
-    for (clientCon = dev->clientConHead;
-            clientCon != NULL;
-            clientCon = clientCon->next)
+    clientCon = dev->clientConHead;
+    while (clientCon != NULL)
     {
+        /* the procs can remove clientCon */
+        nextCon = clientCon->next;
+        if ((clientCon->cap_async != NULL) &&
+            FD_ISSET(LTOUI32(clientCon->cap_async->pipe_fds[0]), &rfds))
+        {
+            rdpClientConCapAsyncNotify(clientCon->cap_async->pipe_fds[0],
+                                       X_NOTIFY_READ, clientCon);
+        }
+        ready = 0;
         if (clientCon->sck > 0)
         {
             if (FD_ISSET(LTOUI32(clientCon->sck), &rfds))
             {
-                if (rdpClientConGotData(pScreen, dev, clientCon) != 0)
-                {
-                    LLOGLN(0, ("rdpClientConCheck: rdpClientConGotData failed"));
-                    continue; /* skip other socket checks for this clientCon */
-                }
+                ready |= X_NOTIFY_READ;
             }
-        }
-        if (clientCon->sckControlListener > 0)
-        {
-            if (FD_ISSET(LTOUI32(clientCon->sckControlListener), &rfds))
+            if (FD_ISSET(LTOUI32(clientCon->sck), &wfds))
             {
-                if (rdpClientConGotControlConnection(pScreen, dev, clientCon) != 0)
-                {
-                    LLOGLN(0, ("rdpClientConCheck: rdpClientConGotControlConnection failed"));
-                    continue;
-                }
+                ready |= X_NOTIFY_WRITE;
             }
         }
-        if (clientCon->sckControl > 0)
+        if (ready != 0)
         {
-            if (FD_ISSET(LTOUI32(clientCon->sckControl), &rfds))
-            {
-                if (rdpClientConGotControlData(pScreen, dev, clientCon) != 0)
-                {
-                    LLOGLN(0, ("rdpClientConCheck: rdpClientConGotControlData failed"));
-                    continue;
-                }
-            }
+            rdpClientConSckNotify(clientCon->sck, ready, clientCon);
         }
+        clientCon = nextCon;
     }
     return 0;
 }
 
+#else
+
+/******************************************************************************/
+/* the X server calls the notify procs, nothing to poll */
+int
+rdpClientConCheck(ScreenPtr pScreen)
+{
+    return 0;
+}
+
+#endif
+
 /******************************************************************************/
 int
 rdpClientConInit(rdpPtr dev)
@@ -1581,7 +2551,8 @@ rdpClientConInit(rdpPtr dev)
         }
         g_sck_listen(dev->listen_sck);
         g_chmod_hex(dev->uds_data, 0x0660);
-        rdpClientConAddEnabledDevice(dev->pScreen, dev->listen_sck);
+        rdpClientConAddEnabledDevice(dev->pScreen, dev->listen_sck,
+                                     rdpClientConListenNotify, dev);
     }
 
     /* disconnect socket */ /* TODO: don't hardcode socket name */
@@ -1597,7 +2568,8 @@ rdpClientConInit(rdpPtr dev)
         }
         g_sck_listen(dev->disconnect_sck);
         g_chmod_hex(dev->disconnect_uds, 0x0660);
-        rdpClientConAddEnabledDevice(dev->pScreen, dev->disconnect_sck);
+        rdpClientConAddEnabledDevice(dev->pScreen, dev->disconnect_sck,
+                                     rdpClientConDisconnectNotify, dev);
     }
 
     /* disconnect idle */
@@ -1646,6 +2618,8 @@ rdpClientConInit(rdpPtr dev)
     LLOGLN(0, ("rdpClientConInit: kill disconnected [%d] timeout [%d] sec",
                dev->do_kill_disconnected, dev->disconnect_timeout_s));
 
+    dev->capture_workers = rdpWorkersCreate(dev->capture_threads,
+                                            dev->capture_numa);
 
     return 0;
 }
@@ -1686,6 +2660,9 @@ rdpClientConDeinit(rdpPtr dev)
         }
     }
 
+    rdpWorkersDelete(dev->capture_workers);
+    dev->capture_workers = NULL;
+
     return 0;
 }
 
@@ -2191,8 +3168,8 @@ rdpClientConSetCursorShmFd(rdpPtr dev, rdpClientCon *clientCon,
         memcpy(shmemptr, cur_data, width * height * Bpp);
         memcpy(shmemptr + width * height * Bpp, cur_mask, width * height / 8);
         rdpClientConSendPending(clientCon->dev, clientCon);
-        rv = g_sck_send_fd_set(clientCon->sck, "int", 4, &fd, 1);
-        LLOGLN(10, ("rdpClientConSetCursorShmFd: g_sck_send_fd_set rv %d", rv));
+        rv = rdpClientConSendFd(clientCon->dev, clientCon, fd);
+        LLOGLN(10, ("rdpClientConSetCursorShmFd: rdpClientConSendFd rv %d", rv));
         g_free_unmap_fd(shmemptr, fd, shmsize);
     }
     return rv;
@@ -2553,9 +3530,7 @@ rdpClientConCheckDirtyScreen(rdpPtr dev, rdpClientCon *clientCon)
 
 /******************************************************************************/
 static int
-out_rects_dr(struct stream *s,
-             BoxPtr rects_d, int num_rects_d,
-             BoxPtr rects_c, int num_rects_c)
+out_rects(struct stream *s, BoxPtr rects, int num_rects)
 {
     int index;
     BoxRec box;
@@ -2564,10 +3539,10 @@ out_rects_dr(struct stream *s,
     short cx;
     short cy;
 
-    out_uint16_le(s, num_rects_d);
-    for (index = 0; index < num_rects_d; index++)
+    out_uint16_le(s, num_rects);
+    for (index = 0; index < num_rects; index++)
     {
-        box = rects_d[index];
+        box = rects[index];
         x = box.x1;
         y = box.y1;
         cx = box.x2 - box.x1;
@@ -2576,24 +3551,316 @@ out_rects_dr(struct stream *s,
         out_uint16_le(s, y);
         out_uint16_le(s, cx);
         out_uint16_le(s, cy);
-        LLOGLN(10, ("out_rects_dr: rects_d index %d x %d y %d cx %d cy %d",
+        LLOGLN(10, ("out_rects: index %d x %d y %d cx %d cy %d",
                index, x, y, cx, cy));
     }
-    out_uint16_le(s, num_rects_c);
-    for (index = 0; index < num_rects_c; index++)
+    return 0;
+}
+
+/******************************************************************************/
+/* one cell run, 1 byte up to 127 cells, else 2 bytes with the top bit
+   set */
+static uint8_t *
+out_tile_map_run(uint8_t *p, int run)
+{
+    if (run < 0x80)
     {
-        box = rects_c[index];
-        x = box.x1;
-        y = box.y1;
-        cx = box.x2 - box.x1;
-        cy = box.y2 - box.y1;
-        out_uint16_le(s, x);
-        out_uint16_le(s, y);
-        out_uint16_le(s, cx);
-        out_uint16_le(s, cy);
-        LLOGLN(10, ("out_rects_dr: rects_c index %d x %d y %d cx %d cy %d",
-               index, x, y, cx, cy));
+        *(p++) = run;
+    }
+    else
+    {
+        *(p++) = 0x80 | (run >> 8);
+        *(p++) = run;
+    }
+    return p;
+}
+
+/******************************************************************************/
+/* codes the copy rects as a map of cell x cell cells over width x height
+   from left, top, into clientCon->tile_map, for xrdps with
+   RDP_XUP_CAP_TILE_MAP
+   the map, in place of num_rects_c and the copy rects:
+     uint16 RDP_RECTS_TILE_MAP
+     uint16 cell, left, top, cols, rows
+     uint16 run_bytes
+     runs of clean and copy cells in row major order, clean first, the
+     clean run after the last copy cell is left out
+   the rects are all cell aligned, except where they end at width or
+   height
+   returns the bytes in clientCon->tile_map, 0 when the rects are not
+   longer */
+static int
+rdpClientConTileMap(rdpClientCon *clientCon, BoxPtr rects, int num_rects,
+                    int left, int top, int width, int height, int cell)
+{
+    uint8_t *cells;
+    uint8_t *p;
+    uint8_t *end;
+    int cols;
+    int rows;
+    int num_cells;
+    int col;
+    int row;
+    int col2;
+    int row2;
+    int index;
+    int last;
+    int run;
+    int copy;
+
+    if ((clientCon->xrdp_caps & (1 << RDP_XUP_CAP_TILE_MAP)) == 0)
+    {
+        return 0;
+    }
+    cols = (width + cell - 1) / cell;
+    rows = (height + cell - 1) / cell;
+    num_cells = cols * rows;
+    /* 14 byte header and the shortest map, one clean run and one copy
+       run */
+    if ((num_rects * 8 + 2 <= 14 + 2) || (num_cells < 1) ||
+        (cols > 0xFFFF) || (rows > 0xFFFF))
+    {
+        return 0;
+    }
+    if (num_cells > clientCon->tile_cells_alloc)
+    {
+        free(clientCon->tile_cells);
+        clientCon->tile_cells = g_new(uint8_t, num_cells);
+        clientCon->tile_cells_alloc = num_cells;
+    }
+    cells = clientCon->tile_cells;
+    memset(cells, 0, num_cells);
+    last = -1;
+    for (index = 0; index < num_rects; index++)
+    {
+        row = RDPMAX(rects[index].y1 - top, 0) / cell;
+        row2 = RDPMIN((rects[index].y2 - top + cell - 1) / cell, rows);
+        col = RDPMAX(rects[index].x1 - left, 0) / cell;
+        col2 = RDPMIN((rects[index].x2 - left + cell - 1) / cell, cols);
+        if (col2 <= col)
+        {
+            continue;
+        }
+        for (; row < row2; row++)
+        {
+            memset(cells + row * cols + col, 1, col2 - col);
+            last = RDPMAX(last, row * cols + col2 - 1);
+        }
+    }
+    if (last < 0)
+    {
+        return 0;
+    }
+    /* no longer than the rects, and run_bytes fits in 16 bits */
+    if (clientCon->tile_map_alloc < num_rects * 8 + 2)
+    {
+        free(clientCon->tile_map);
+        clientCon->tile_map_alloc = num_rects * 8 + 2;
+        clientCon->tile_map = g_new(uint8_t, clientCon->tile_map_alloc);
+    }
+    p = clientCon->tile_map + 14;
+    end = clientCon->tile_map + RDPMIN(num_rects * 8 + 2, 14 + 0xFFFF);
+    copy = 0;
+    index = 0;
+    while (index <= last)
+    {
+        run = 0;
+        while ((index <= last) && (cells[index] == copy) &&
+               (run < RDP_TILE_MAP_MAX_RUN))
+        {
+            run++;
+            index++;
+        }
+        /* a run code, and a 0 run of the other kind if the run was
+           split */
+        if (p + 2 + 1 > end)
+        {
+            return 0;
+        }
+        p = out_tile_map_run(p, run);
+        copy = !copy;
+    }
+    run = (int) (p - (clientCon->tile_map + 14));
+    p = clientCon->tile_map;
+    p[0] = RDP_RECTS_TILE_MAP & 0xFF;
+    p[1] = RDP_RECTS_TILE_MAP >> 8;
+    p[2] = cell;
+    p[3] = cell >> 8;
+    p[4] = left;
+    p[5] = left >> 8;
+    p[6] = top;
+    p[7] = top >> 8;
+    p[8] = cols;
+    p[9] = cols >> 8;
+    p[10] = rows;
+    p[11] = rows >> 8;
+    p[12] = run;
+    p[13] = run >> 8;
+    LLOGLN(10, ("rdpClientConTileMap: %d rects in %d bytes, map %d bytes",
+           num_rects, num_rects * 8 + 2, 14 + run));
+    return 14 + run;
+}
+
+/******************************************************************************/
+/* the copy rects of the tile and macroblock capture codes are cells,
+   returns the bytes of the map in clientCon->tile_map, 0 to send the
+   rects */
+static int
+rdpClientConCopyTileMap(rdpClientCon *clientCon, struct image_data *id,
+                        BoxPtr rects, int num_rects)
+{
+    switch (clientCon->client_info.capture_code)
+    {
+        case 2:
+        case 4:
+            /* rdpCapture2 rects are from id->left, id->top */
+            return rdpClientConTileMap(clientCon, rects, num_rects,
+                                       0, 0, id->width, id->height,
+                                       XRDP_RFX_ALIGN);
+        case 3:
+        case 5:
+            return rdpClientConTileMap(clientCon, rects, num_rects,
+                                       id->left, id->top,
+                                       id->width, id->height,
+                                       XRDP_H264_ALIGN);
+        default:
+            return 0;
+    }
+}
+
+/******************************************************************************/
+/* the dirty rects and the copy rects, or the map from
+   rdpClientConTileMap if there is one */
+static int
+out_rects_d_copy(struct stream *s, rdpClientCon *clientCon,
+                 BoxPtr rects_d, int num_rects_d,
+                 BoxPtr rects_c, int num_rects_c, int tile_map_bytes)
+{
+    out_rects(s, rects_d, num_rects_d);
+    if (tile_map_bytes > 0)
+    {
+        out_uint8a(s, clientCon->tile_map, tile_map_bytes);
+    }
+    else
+    {
+        out_rects(s, rects_c, num_rects_c);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* WIRETOSURFACE_1 flags, a changed macroblock map follows the surface rect */
+#define XRDP_MB_MAP_INCLUDED (1 << 8)
+/* message 64 flags, the pixels are in the shared framebuffer, the fd is
+   only sent with the first paint after it was allocated */
+#define XRDP_PAINT_SHARED_FB (1 << 9)
+#define XRDP_PAINT_FD_INCLUDED (1 << 10)
+/* message 64 flags, the pixels are in a buffer from message 65, its
+   index and the generation follow the surface rect, no fd */
+#define XRDP_PAINT_SHM_BUF (1 << 11)
+/* WIRETOSURFACE_2 flags, where the surface starts in the shared memory
+   follows the surface rect */
+#define XRDP_SHMEM_OFFSET_INCLUDED (1 << 12)
+
+/* surface commands in one gfx frame, leaves room in out_s for the
+   message 62 header and the start and end frame commands */
+#define RDP_FRAME_CMD_BYTES (8192 * 3)
+
+/******************************************************************************/
+/* sends the surface commands in frame_s as one gfx frame, xrdp acks it
+   with one frame_id */
+static int
+rdpClientConSendFrameEnd(rdpPtr dev, rdpClientCon *clientCon)
+{
+    int size;
+    int cmd_bytes;
+    int start_frame_bytes;
+    int end_frame_bytes;
+    int buf_id;
+    struct stream *s;
+    struct stream *frame_s;
+
+    frame_s = clientCon->frame_s;
+    cmd_bytes = (int) (frame_s->p - frame_s->data);
+    if (cmd_bytes < 1)
+    {
+        return 0;
+    }
+    LLOGLN(10, ("rdpClientConSendFrameEnd: cmd_bytes %d", cmd_bytes));
+
+    start_frame_bytes = 8 + 8;
+    end_frame_bytes = 8 + 4;
+
+    size = 2 + 2;                   /* header */
+    size += 4;                      /* message 62 cmd_bytes */
+    size += start_frame_bytes;      /* start frame message */
+    size += cmd_bytes;              /* surface messages */
+    size += end_frame_bytes;        /* end frame message */
+    size += 4;                      /* message 62 data_bytes */
+    buf_id = -1;
+    if (clientCon->frame_shmem_bytes > 0)
+    {
+        buf_id = rdpClientConShmBufId(clientCon, clientCon->frame_shmem_fd);
+        if (buf_id >= 0)
+        {
+            size += 4 + 4;          /* buffer index and generation */
+        }
+    }
+
+    rdpClientConBeginUpdate(dev, clientCon);
+    rdpClientConPreCheck(dev, clientCon, size);
+    s = clientCon->out_s;
+    out_uint16_le(s, 62);
+    out_uint16_le(s, size);
+    clientCon->count++;
+
+    out_uint32_le(s, start_frame_bytes +
+                    cmd_bytes +
+                    end_frame_bytes); /* total of cmd_bytes */
+
+    ++clientCon->rect_id;
+    rdpClientConPaceSent(clientCon, clientCon->pace.frame_pixels);
+    clientCon->pace.frame_pixels = 0;
+
+    /* XR_RDPGFX_CMDID_STARTFRAME */
+    out_uint16_le(s, 0x000B);
+    out_uint16_le(s, 0);                    /* flags */
+    out_uint32_le(s, start_frame_bytes);    /* cmd_bytes */
+    out_uint32_le(s, clientCon->rect_id);   /* frame_id */
+    out_uint32_le(s, 0);                    /* time_stamp */
+
+    out_uint8a(s, frame_s->data, cmd_bytes);
+
+    /* XR_RDPGFX_CMDID_ENDFRAME */
+    out_uint16_le(s, 0x000C);
+    out_uint16_le(s, 0);                    /* flags */
+    out_uint32_le(s, end_frame_bytes);      /* cmd_bytes */
+    out_uint32_le(s, clientCon->rect_id);   /* frame_id */
+
+    if (buf_id >= 0)
+    {
+        /* a buffer from message 65, no fd */
+        out_uint32_le(s, clientCon->frame_shmem_bytes); /* shmem_bytes */
+        out_uint32_le(s, buf_id);
+        out_uint32_le(s, clientCon->shm_generation);
+        rdpClientConSendPending(clientCon->dev, clientCon);
+    }
+    else if (clientCon->frame_shmem_bytes > 0)
+    {
+        out_uint32_le(s, clientCon->frame_shmem_bytes); /* shmem_bytes */
+        rdpClientConSendPending(clientCon->dev, clientCon);
+        rdpClientConSendFd(dev, clientCon, clientCon->frame_shmem_fd);
+    }
+    else
+    {
+        out_uint32_le(s, 0);                /* shmem_bytes */
     }
+
+    rdpClientConEndUpdate(dev, clientCon);
+
+    init_stream(frame_s, 0);
+    clientCon->frame_shmem_bytes = 0;
+    clientCon->frame_shmem_fd = -1;
     return 0;
 }
 
@@ -2609,11 +3876,15 @@ rdpClientConSendPaintRectShmFd(rdpPtr dev, rdpClientCon *clientCon,
     int num_rects_c;
     struct stream *s;
     int capture_code;
-    int start_frame_bytes;
-    int wiretosurface1_bytes;
-    int wiretosurface2_bytes;
-    int end_frame_bytes;
+    int wiretosurface_bytes;
     int surface_id;
+    int mb_map_bytes;
+    int offset_bytes;
+    int flags;
+    int send_fd;
+    int buf_id;
+    int copy_bytes;
+    int tile_map_bytes;
 
     LLOGLN(10, ("rdpClientConSendPaintRectShmFd:"));
     LLOGLN(10, ("rdpClientConSendPaintRectShmFd: cap_left %d cap_top %d "
@@ -2633,14 +3904,21 @@ rdpClientConSendPaintRectShmFd(rdpPtr dev, rdpClientCon *clientCon,
         LLOGLN(10, ("rdpClientConSendPaintRectShmFd: nothing to send"));
         return 0;
     }
-
-    rdpClientConBeginUpdate(dev, clientCon);
+    tile_map_bytes = rdpClientConCopyTileMap(clientCon, id, copyRects,
+                                             num_rects_c);
+    copy_bytes = tile_map_bytes > 0 ? tile_map_bytes : 2 + num_rects_c * 8;
 
     if (capture_code < 4)
     {
         /* non gfx */
-        size = 2 + 2 + 2 + num_rects_d * 8 + 2 + num_rects_c * 8;
+        buf_id = rdpClientConShmBufId(clientCon, id->shmem_fd);
+        rdpClientConBeginUpdate(dev, clientCon);
+        size = 2 + 2 + 2 + num_rects_d * 8 + copy_bytes;
         size += 4 + 4 + 4 + 4 + 2 + 2 + 2 + 2;
+        if (buf_id >= 0)
+        {
+            size += 4 + 4;
+        }
         rdpClientConPreCheck(dev, clientCon, size);
 
         s = clientCon->out_s;
@@ -2648,18 +3926,42 @@ rdpClientConSendPaintRectShmFd(rdpPtr dev, rdpClientCon *clientCon,
         out_uint16_le(s, size);
         clientCon->count++;
 
-        out_rects_dr(s, REGION_RECTS(dirtyReg), num_rects_d,
-                     copyRects, num_rects_c);
+        out_rects_d_copy(s, clientCon, REGION_RECTS(dirtyReg), num_rects_d,
+                         copyRects, num_rects_c, tile_map_bytes);
 
-        out_uint32_le(s, id->flags);
-        ++clientCon->rect_id;
-        out_uint32_le(s, clientCon->rect_id);
-        out_uint32_le(s, id->shmem_bytes);
-        out_uint32_le(s, id->shmem_offset);
-		if (capture_code == 2) /* rfx */
-		{
-            out_uint16_le(s, id->left);
-            out_uint16_le(s, id->top);
+        flags = id->flags;
+        send_fd = 1;
+        if (buf_id >= 0)
+        {
+            /* rdpClientConSendShmBufs sent the fd */
+            flags |= XRDP_PAINT_SHM_BUF;
+            send_fd = 0;
+        }
+        else if ((dev->pfbMemory_fd >= 0) &&
+                 (id->shmem_fd == dev->pfbMemory_fd))
+        {
+            /* the framebuffer itself, its fd only goes out once */
+            flags |= XRDP_PAINT_SHARED_FB;
+            if (clientCon->fb_generation_sent == dev->fb_generation)
+            {
+                send_fd = 0;
+            }
+            else
+            {
+                flags |= XRDP_PAINT_FD_INCLUDED;
+                clientCon->fb_generation_sent = dev->fb_generation;
+            }
+        }
+        out_uint32_le(s, flags);
+        ++clientCon->rect_id;
+        rdpClientConPaceSent(clientCon, rdpClientConRegionPixels(dirtyReg));
+        out_uint32_le(s, clientCon->rect_id);
+        out_uint32_le(s, id->shmem_bytes);
+        out_uint32_le(s, id->shmem_offset);
+		if (capture_code == 2) /* rfx */
+		{
+            out_uint16_le(s, id->left);
+            out_uint16_le(s, id->top);
             out_uint16_le(s, id->width);
             out_uint16_le(s, id->height);
 		}
@@ -2670,222 +3972,589 @@ rdpClientConSendPaintRectShmFd(rdpPtr dev, rdpClientCon *clientCon,
             out_uint16_le(s, clientCon->cap_width);
             out_uint16_le(s, clientCon->cap_height);
         }
+        if (buf_id >= 0)
+        {
+            out_uint32_le(s, buf_id);
+            out_uint32_le(s, clientCon->shm_generation);
+        }
+        /* the paint goes out in one send, an fd needs a second one */
         rdpClientConSendPending(clientCon->dev, clientCon);
-        g_sck_send_fd_set(clientCon->sck, "int", 4, &(id->shmem_fd), 1);
+        if (send_fd)
+        {
+            rdpClientConSendFd(dev, clientCon, id->shmem_fd);
+        }
+        rdpClientConEndUpdate(dev, clientCon);
     }
-    else if (capture_code == 4) /* gfx pro rfx */
+    else
     {
-        start_frame_bytes = 8 + 8;
-        wiretosurface2_bytes = 8 + 13 +
-                               2 + num_rects_d * 8 +
-                               2 + num_rects_c * 8 +
-                               8;
-        end_frame_bytes = 8 + 4;
-
-        size = 2 + 2;                   /* header */
-        size += 4;                      /* message 62 cmd_bytes */
-        size += start_frame_bytes;      /* start frame message */
-        size += wiretosurface2_bytes;   /* frame message */
-        size += end_frame_bytes;        /* end frame message */
-        size += 4;                      /* message 62 data_bytes */
-
-        rdpClientConPreCheck(dev, clientCon, size);
-        s = clientCon->out_s;
-        out_uint16_le(s, 62);
-        out_uint16_le(s, size);
-        clientCon->count++;
-
-        out_uint32_le(s, start_frame_bytes +
-                        wiretosurface2_bytes +
-                        end_frame_bytes); /* total of cmd_bytes */
-
-        ++clientCon->rect_id;
-
-        /* XR_RDPGFX_CMDID_STARTFRAME */
-        out_uint16_le(s, 0x000B);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, start_frame_bytes);    /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
-        out_uint32_le(s, 0);                    /* time_stamp */
+        /* gfx, the surface command waits in frame_s for
+           rdpClientConSendFrameEnd */
+        mb_map_bytes = 0;
+        if ((capture_code == 5) && (clientCon->mb_changed_bytes > 0) &&
+            (clientCon->xrdp_caps & (1 << RDP_XUP_CAP_MB_MAP)))
+        {
+            /* mb_cols, mb_rows and one bit per macroblock from
+               rdpCapture3, only for an xrdp that takes the map */
+            mb_map_bytes = 2 + 2 + clientCon->mb_changed_bytes;
+        }
+        offset_bytes = 0;
+        if ((capture_code == 4) && (id->shmem_offset != 0))
+        {
+            /* a monitor after the first, rdpCapFrameMonitorsShareBuf only
+               lets it in with RDP_XUP_CAP_GFX_SHMEM_OFFSET */
+            offset_bytes = 4;
+        }
+        if (capture_code == 4)
+        {
+            wiretosurface_bytes = 8 + 13 +
+                                  2 + num_rects_d * 8 +
+                                  copy_bytes +
+                                  8 + offset_bytes;
+        }
+        else
+        {
+            wiretosurface_bytes = 8 + 9 +
+                                  2 + num_rects_d * 8 +
+                                  copy_bytes +
+                                  8 + mb_map_bytes;
+        }
+        s = clientCon->frame_s;
+        if ((s->p > s->data) &&
+            ((int) (s->p - s->data) + wiretosurface_bytes >
+             RDP_FRAME_CMD_BYTES))
+        {
+            /* too much for one message, what is there goes as a frame */
+            rdpClientConSendFrameEnd(dev, clientCon);
+        }
 
         surface_id = (id->flags >> 28) & 0xF;
-        /* XR_RDPGFX_CMDID_WIRETOSURFACE_2 */
-        out_uint16_le(s, 0x0002);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, wiretosurface2_bytes); /* cmd_bytes */
-        out_uint16_le(s, surface_id);           /* surface_id */
-        out_uint16_le(s, 0x0009);               /* codec_id */
-        out_uint32_le(s, 0);                    /* codec_context_id */
-        out_uint8(s, 0x20);                     /* pixel_format */
-
-        out_uint32_le(s, id->flags);            /* flags */
+        flags = id->flags;
+        if (capture_code == 4)
+        {
+            /* XR_RDPGFX_CMDID_WIRETOSURFACE_2 */
+            out_uint16_le(s, 0x0002);
+            out_uint16_le(s, 0);                    /* flags */
+            out_uint32_le(s, wiretosurface_bytes);  /* cmd_bytes */
+            out_uint16_le(s, surface_id);           /* surface_id */
+            out_uint16_le(s, 0x0009);               /* codec_id */
+            out_uint32_le(s, 0);                    /* codec_context_id */
+            out_uint8(s, 0x20);                     /* pixel_format */
+            if (offset_bytes > 0)
+            {
+                flags |= XRDP_SHMEM_OFFSET_INCLUDED;
+            }
+        }
+        else
+        {
+            /* XR_RDPGFX_CMDID_WIRETOSURFACE_1 */
+            out_uint16_le(s, 0x0001);
+            out_uint16_le(s, 0);                    /* flags */
+            out_uint32_le(s, wiretosurface_bytes);  /* cmd_bytes */
+            out_uint16_le(s, surface_id);           /* surface_id */
+            out_uint16_le(s, 0x000B);               /* codec_id */
+            out_uint8(s, 0x20);                     /* pixel_format */
+            if (mb_map_bytes > 0)
+            {
+                flags |= XRDP_MB_MAP_INCLUDED;
+            }
+        }
+        out_uint32_le(s, flags);                    /* flags */
 
-        out_rects_dr(s, REGION_RECTS(dirtyReg), num_rects_d,
-                     copyRects, num_rects_c);
+        out_rects_d_copy(s, clientCon, REGION_RECTS(dirtyReg), num_rects_d,
+                         copyRects, num_rects_c, tile_map_bytes);
 
         out_uint16_le(s, id->left);
         out_uint16_le(s, id->top);
         out_uint16_le(s, id->width);
         out_uint16_le(s, id->height);
 
-        /* XR_RDPGFX_CMDID_ENDFRAME */
-        out_uint16_le(s, 0x000C);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, end_frame_bytes);      /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
-
-        if ((id->shmem_bytes > 0) && ((id->flags & 1) == 0))
+        if (offset_bytes > 0)
         {
-            out_uint32_le(s, id->shmem_bytes);  /* shmem_bytes */
-            rdpClientConSendPending(clientCon->dev, clientCon);
-            g_sck_send_fd_set(clientCon->sck, "int", 4, &(id->shmem_fd), 1);
+            out_uint32_le(s, id->shmem_offset);
         }
-        else
+        if (mb_map_bytes > 0)
         {
-            out_uint32_le(s, 0);                /* shmem_bytes */
+            out_uint16_le(s, clientCon->mb_cols);
+            out_uint16_le(s, clientCon->mb_rows);
+            out_uint8a(s, clientCon->mb_changed, clientCon->mb_changed_bytes);
+        }
+
+        clientCon->pace.frame_pixels += rdpClientConRegionPixels(dirtyReg);
+        if ((id->shmem_bytes > 0) && ((id->flags & 1) == 0))
+        {
+            clientCon->frame_shmem_bytes = id->shmem_bytes;
+            clientCon->frame_shmem_fd = id->shmem_fd;
         }
     }
-    else if (capture_code == 5) /* gfx h264 */
+
+    return 0;
+}
+
+/******************************************************************************/
+/* X server thread, after rdpCapture */
+static void
+rdpCapRectSend(rdpClientCon *clientCon, int mon, struct image_data *id,
+               RegionPtr cap_dirty, BoxPtr rects, int num_rects)
+{
+    LLOGLN(10, ("rdpCapRectSend: num_rects %d", num_rects));
+    if (clientCon->send_key_frame[mon])
     {
-        start_frame_bytes = 8 + 8;
-        wiretosurface1_bytes = 8 + 9 +
-                               2 + num_rects_d * 8 +
-                               2 + num_rects_c * 8 +
-                               8;
-        end_frame_bytes = 8 + 4;
+        clientCon->send_key_frame[mon] = 0;
+        id->flags = (enum xrdp_encoder_flags)
+                    ((int)id->flags | KEY_FRAME_REQUESTED);
+    }
+    rdpClientConSendPaintRectShmFd(clientCon->dev, clientCon, id,
+                                   cap_dirty, rects, num_rects);
+}
 
-        size = 2 + 2;                   /* header */
-        size += 4;                      /* message 62 cmd_bytes */
-        size += start_frame_bytes;      /* start frame message */
-        size += wiretosurface1_bytes;   /* frame message */
-        size += end_frame_bytes;        /* end frame message */
-        size += 4;                      /* message 62 data_bytes */
+/******************************************************************************/
+/* capture thread, rdpCapture only uses pixman regions and the arena here,
+   it does not log or resize, its status goes back to the X server thread */
+static void *
+rdpCapAsyncThread(void *arg)
+{
+    struct rdp_cap_async *ca;
+    char byte;
 
-        rdpClientConPreCheck(dev, clientCon, size);
-        s = clientCon->out_s;
-        out_uint16_le(s, 62);
-        out_uint16_le(s, size);
-        clientCon->count++;
+    ca = (struct rdp_cap_async *) arg;
+    /* CaptureNTBytes auto, times the copies here and not on the X server
+       thread, the first capture waits for it */
+    rdpSimdTuneNT();
+    pthread_mutex_lock(&(ca->mutex));
+    for (;;)
+    {
+        while (!ca->stop && !ca->posted)
+        {
+            pthread_cond_wait(&(ca->cond), &(ca->mutex));
+        }
+        if (ca->stop)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&(ca->mutex));
+        ca->rects = NULL;
+        ca->num_rects = 0;
+        ca->status = rdpCapture(ca->clientCon, ca->cap_dirty,
+                                &(ca->rects), &(ca->num_rects), &(ca->id));
+        pthread_mutex_lock(&(ca->mutex));
+        ca->posted = 0;
+        pthread_cond_broadcast(&(ca->cond));
+        byte = 0;
+        if (write(ca->pipe_fds[1], &byte, 1) != 1)
+        {
+            /* pipe full, the X server thread has a byte to read anyway */
+        }
+    }
+    pthread_mutex_unlock(&(ca->mutex));
+    return NULL;
+}
 
-        out_uint32_le(s, start_frame_bytes +
-                        wiretosurface1_bytes +
-                        end_frame_bytes); /* total of cmd_bytes */
+/******************************************************************************/
+/* returns NULL when capture should run on the X server thread */
+static struct rdp_cap_async *
+rdpCapAsyncCreate(ScreenPtr pScreen, rdpClientCon *clientCon)
+{
+    struct rdp_cap_async *ca;
+    sigset_t new_mask;
+    sigset_t old_mask;
+    int error;
+
+    if (!clientCon->dev->capture_async || clientCon->dev->glamor)
+    {
+        return NULL;
+    }
+    ca = g_new0(struct rdp_cap_async, 1);
+    if (pipe(ca->pipe_fds) != 0)
+    {
+        LLOGLN(0, ("rdpCapAsyncCreate: pipe failed"));
+        free(ca);
+        return NULL;
+    }
+    g_sck_set_non_blocking(ca->pipe_fds[0]);
+    g_sck_set_non_blocking(ca->pipe_fds[1]);
+    ca->clientCon = clientCon;
+    pthread_mutex_init(&(ca->mutex), NULL);
+    pthread_cond_init(&(ca->cond), NULL);
+    /* signals go to the X server thread */
+    sigfillset(&new_mask);
+    pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
+    error = pthread_create(&(ca->thread), NULL, rdpCapAsyncThread, ca);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    if (error != 0)
+    {
+        LLOGLN(0, ("rdpCapAsyncCreate: pthread_create failed"));
+        pthread_cond_destroy(&(ca->cond));
+        pthread_mutex_destroy(&(ca->mutex));
+        close(ca->pipe_fds[0]);
+        close(ca->pipe_fds[1]);
+        free(ca);
+        return NULL;
+    }
+    rdpClientConAddEnabledDevice(pScreen, ca->pipe_fds[0],
+                                 rdpClientConCapAsyncNotify, clientCon);
+    LLOGLN(0, ("rdpCapAsyncCreate: capture thread started"));
+    return ca;
+}
 
-        ++clientCon->rect_id;
+/******************************************************************************/
+static void
+rdpCapAsyncDrain(struct rdp_cap_async *ca)
+{
+    char buf[64];
+
+    while (read(ca->pipe_fds[0], buf, sizeof(buf)) > 0)
+    {
+    }
+}
 
-        /* XR_RDPGFX_CMDID_STARTFRAME */
-        out_uint16_le(s, 0x000B);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, start_frame_bytes);    /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
-        out_uint32_le(s, 0);                    /* time_stamp */
+/******************************************************************************/
+static void
+rdpCapAsyncFinish(struct rdp_cap_async *ca)
+{
+    rdpArenaReset(ca->clientCon->cap_arena);
+    ca->rects = NULL;
+    ca->num_rects = 0;
+    ca->cap_dirty = NULL;
+    ca->busy = 0;
+}
 
-        surface_id = (id->flags >> 28) & 0xF;
-        /* XR_RDPGFX_CMDID_WIRETOSURFACE_1 */
-        out_uint16_le(s, 0x0001);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, wiretosurface1_bytes); /* cmd_bytes */
-        out_uint16_le(s, surface_id);           /* surface_id */
-        out_uint16_le(s, 0x000B);               /* codec_id */
-        out_uint8(s, 0x20);                     /* pixel_format */
+/******************************************************************************/
+/* wait for the capture thread to go idle, a result not sent yet is dropped
+   and its region is dirty again
+   call before changing shared memory or capture state */
+static void
+rdpCapAsyncWait(rdpClientCon *clientCon)
+{
+    struct rdp_cap_async *ca;
 
-        out_uint32_le(s, id->flags);            /* flags */
+    ca = clientCon->cap_async;
+    if ((ca == NULL) || !ca->busy)
+    {
+        return;
+    }
+    pthread_mutex_lock(&(ca->mutex));
+    while (ca->posted)
+    {
+        pthread_cond_wait(&(ca->cond), &(ca->mutex));
+    }
+    pthread_mutex_unlock(&(ca->mutex));
+    rdpCapAsyncDrain(ca);
+    rdpCapAsyncFinish(ca);
+    /* the parts captured so far are not sent either, frame_dirty has
+       the one just dropped too */
+    rdpRegionUnion(clientCon->dirtyRegion, clientCon->dirtyRegion,
+                   clientCon->frame_dirty);
+    rdpCapFrameReset(clientCon);
+    init_stream(clientCon->frame_s, 0);
+    clientCon->frame_shmem_bytes = 0;
+    clientCon->frame_shmem_fd = -1;
+}
 
-        out_rects_dr(s, REGION_RECTS(dirtyReg), num_rects_d,
-                     copyRects, num_rects_c);
+/******************************************************************************/
+static void
+rdpCapAsyncDelete(rdpClientCon *clientCon)
+{
+    struct rdp_cap_async *ca;
 
-        out_uint16_le(s, id->left);
-        out_uint16_le(s, id->top);
-        out_uint16_le(s, id->width);
-        out_uint16_le(s, id->height);
+    ca = clientCon->cap_async;
+    if (ca == NULL)
+    {
+        return;
+    }
+    rdpCapAsyncWait(clientCon);
+    pthread_mutex_lock(&(ca->mutex));
+    ca->stop = 1;
+    pthread_cond_broadcast(&(ca->cond));
+    pthread_mutex_unlock(&(ca->mutex));
+    pthread_join(ca->thread, NULL);
+    rdpClientConRemoveEnabledDevice(ca->pipe_fds[0]);
+    close(ca->pipe_fds[0]);
+    close(ca->pipe_fds[1]);
+    pthread_cond_destroy(&(ca->cond));
+    pthread_mutex_destroy(&(ca->mutex));
+    free(ca->shadow);
+    free(ca);
+    clientCon->cap_async = NULL;
+}
 
-        /* XR_RDPGFX_CMDID_ENDFRAME */
-        out_uint16_le(s, 0x000C);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, end_frame_bytes);      /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
+/******************************************************************************/
+/* copy the dirty spans so X clients can keep drawing while the capture
+   thread converts, then hand the job over, the capture thread owns
+   cap_dirty and clientCon->cap_arena until rdpClientConGotCaptureDone */
+static void
+rdpCapAsyncPost(rdpClientCon *clientCon, RegionPtr cap_dirty, int mon,
+                struct image_data *id)
+{
+    struct rdp_cap_async *ca;
+    BoxPtr rects;
+    int num_rects;
+    int index;
+    int bytes;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    int offset;
 
-        if ((id->shmem_bytes > 0) && ((id->flags & 1) == 0))
-        {
-            out_uint32_le(s, id->shmem_bytes);  /* shmem_bytes */
-            rdpClientConSendPending(clientCon->dev, clientCon);
-            g_sck_send_fd_set(clientCon->sck, "int", 4, &(id->shmem_fd), 1);
-        }
-        else
+    ca = clientCon->cap_async;
+    bytes = id->lineBytes * clientCon->dev->height;
+    if (bytes > ca->shadow_bytes)
+    {
+        free(ca->shadow);
+        ca->shadow = g_new(uint8_t, bytes);
+        ca->shadow_bytes = bytes;
+    }
+    rects = REGION_RECTS(cap_dirty);
+    num_rects = REGION_NUM_RECTS(cap_dirty);
+    for (index = 0; index < num_rects; index++)
+    {
+        x1 = RDPMAX(rects[index].x1 - RDP_CAP_ASYNC_MARGIN, 0);
+        y1 = RDPMAX(rects[index].y1 - RDP_CAP_ASYNC_MARGIN, 0);
+        x2 = RDPMIN(rects[index].x2 + RDP_CAP_ASYNC_MARGIN,
+                    clientCon->dev->width);
+        y2 = RDPMIN(rects[index].y2 + RDP_CAP_ASYNC_MARGIN,
+                    clientCon->dev->height);
+        for (; y1 < y2; y1++)
         {
-            out_uint32_le(s, 0);                /* shmem_bytes */
+            offset = y1 * id->lineBytes + x1 * 4;
+            memcpy(ca->shadow + offset, id->pixels + offset, (x2 - x1) * 4);
         }
     }
+    ca->id = *id;
+    ca->id.pixels = ca->shadow;
+    ca->cap_dirty = cap_dirty;
+    ca->mon = mon;
+    ca->busy = 1;
+    pthread_mutex_lock(&(ca->mutex));
+    ca->posted = 1;
+    pthread_cond_broadcast(&(ca->cond));
+    pthread_mutex_unlock(&(ca->mutex));
+}
 
-    rdpClientConEndUpdate(dev, clientCon);
+/******************************************************************************/
+/* the capture thread wrote to the pipe */
+static int
+rdpClientConGotCaptureDone(ScreenPtr pScreen, rdpPtr dev,
+                           rdpClientCon *clientCon)
+{
+    struct rdp_cap_async *ca;
+    int posted;
 
+    LLOGLN(10, ("rdpClientConGotCaptureDone:"));
+    ca = clientCon->cap_async;
+    rdpCapAsyncDrain(ca);
+    pthread_mutex_lock(&(ca->mutex));
+    posted = ca->posted;
+    pthread_mutex_unlock(&(ca->mutex));
+    if (!ca->busy || posted)
+    {
+        return 0;
+    }
+    rdpSimdTuneNTLog();
+    if (ca->status == RDP_CAPTURE_OK)
+    {
+        rdpCapRectSend(clientCon, ca->mon, &(ca->id), ca->cap_dirty,
+                       ca->rects, ca->num_rects);
+    }
+    else
+    {
+        LLOGLN(0, ("rdpClientConGotCaptureDone: rdpCapture failed, %s",
+               rdpCaptureStatusStr(ca->status)));
+    }
+    rdpCapAsyncFinish(ca);
+    /* the next part of the frame, or the end of it */
+    rdpCapFrameRun(clientCon);
+    if (rdpClientConDirtyPending(clientCon))
+    {
+        rdpScheduleDeferredUpdate(clientCon);
+    }
     return 0;
 }
 
+/******************************************************************************/
+/* as many paints are on their way as there are capture buffers, do not
+   capture more yet */
+static Bool
+rdpClientConCaptureBusy(rdpClientCon *clientCon)
+{
+    int window;
+
+    window = rdpClientConCaptureWindow(clientCon);
+    if (clientCon->rect_id - clientCon->rect_id_ack >= window)
+    {
+        return TRUE;
+    }
+    if (clientCon->out_bytes > RDP_OUT_SKIP_BYTES)
+    {
+        /* skip frames, the damage adds up until xrdp reads */
+        return TRUE;
+    }
+    if ((clientCon->cap_async != NULL) && clientCon->cap_async->busy)
+    {
+        return TRUE;
+    }
+    if (clientCon->cap_part_index < clientCon->num_cap_parts)
+    {
+        return TRUE;
+    }
+    return FALSE;
+}
+
 /******************************************************************************/
 /* this is called to capture a rect from the screen, if in a multi monitor
    session, this will get called for each monitor, if no monitor info
    from the client, the rect will be a band of less than MAX_CAPTURE_PIXELS
    pixels
-   after the capture, it sends the info to xrdp
+   after the capture, it sends the info to xrdp, gfx surface commands wait
+   for rdpClientConSendFrameEnd
    returns error */
 static int
 rdpCapRect(rdpClientCon *clientCon, BoxPtr cap_rect, int mon,
            struct image_data *id)
 {
+    RegionRec cap_reg;
     RegionPtr cap_dirty;
-    RegionPtr cap_dirty_save;
+    BoxPtr extents;
     BoxPtr rects;
     int num_rects;
+    int status;
 
-    cap_dirty = rdpRegionCreate(cap_rect, 0);
     LLOGLN(10, ("rdpCapRect: cap_rect x1 %d y1 %d x2 %d y2 %d",
                cap_rect->x1, cap_rect->y1, cap_rect->x2, cap_rect->y2));
-    rdpRegionIntersect(cap_dirty, cap_dirty, clientCon->dirtyRegion);
-    /* make a copy of cap_dirty because it may get altered */
-    cap_dirty_save = rdpRegionCreate(NullBox, 0);
-    rdpRegionCopy(cap_dirty_save, cap_dirty);
+    /* cap_dirty keeps its rects from one capture to the next, a one box
+       region needs none */
+    cap_dirty = &(clientCon->cap_dirty);
+    rdpRegionInit(&cap_reg, cap_rect, 0);
+    rdpRegionIntersect(cap_dirty, &cap_reg, clientCon->dirtyRegion);
     num_rects = REGION_NUM_RECTS(cap_dirty);
-    if (num_rects > 0)
+    if (num_rects < 1)
     {
-        rects = 0;
-        num_rects = 0;
-        LLOGLN(10, ("rdpCapRect: capture_code %d",
-                    clientCon->client_info.capture_code));
-        if (rdpCapture(clientCon, cap_dirty, &rects, &num_rects, id))
-        {
-            LLOGLN(10, ("rdpCapRect: num_rects %d", num_rects));
-            if (clientCon->send_key_frame[mon])
-            {
-                clientCon->send_key_frame[mon] = 0;
-                id->flags = (enum xrdp_encoder_flags)
-                            ((int)id->flags | KEY_FRAME_REQUESTED);
-            }
-            rdpClientConSendPaintRectShmFd(clientCon->dev, clientCon, id,
-                                           cap_dirty, rects, num_rects);
-            free(rects);
-        }
-        else
+        rdpRegionUninit(&cap_reg);
+        return 0;
+    }
+    rdpClientConShmBufPainted(clientCon, cap_dirty);
+    rdpRegionUnion(clientCon->frame_dirty, clientCon->frame_dirty,
+                   cap_dirty);
+    /* rdpCapture can change cap_dirty, all of cap_rect is clean after */
+    extents = rdpRegionExtents(clientCon->dirtyRegion);
+    if ((extents->x1 >= cap_rect->x1) && (extents->y1 >= cap_rect->y1) &&
+        (extents->x2 <= cap_rect->x2) && (extents->y2 <= cap_rect->y2))
+    {
+        rdpRegionEmpty(clientCon->dirtyRegion);
+    }
+    else
+    {
+        rdpRegionSubtract(clientCon->dirtyRegion, clientCon->dirtyRegion,
+                          &cap_reg);
+    }
+    rdpRegionUninit(&cap_reg);
+    if ((clientCon->cap_async != NULL) && (id->shmem_pixels != id->pixels))
+    {
+        rdpCapAsyncPost(clientCon, cap_dirty, mon, id);
+        return 0;
+    }
+    rects = NULL;
+    num_rects = 0;
+    LLOGLN(10, ("rdpCapRect: capture_code %d",
+                clientCon->client_info.capture_code));
+    status = rdpCapture(clientCon, cap_dirty, &rects, &num_rects, id);
+    if (status == RDP_CAPTURE_OK)
+    {
+        rdpCapRectSend(clientCon, mon, id, cap_dirty, rects, num_rects);
+    }
+    else
+    {
+        LLOGLN(0, ("rdpCapRect: rdpCapture failed, %s",
+               rdpCaptureStatusStr(status)));
+    }
+    rdpArenaReset(clientCon->cap_arena);
+    return 0;
+}
+
+/******************************************************************************/
+static void
+rdpCapFrameReset(rdpClientCon *clientCon)
+{
+    clientCon->num_cap_parts = 0;
+    clientCon->cap_part_index = 0;
+    rdpRegionEmpty(clientCon->frame_dirty);
+}
+
+/******************************************************************************/
+/* X server thread, captures the parts of the frame in order and ends it,
+   with a capture thread one part is posted at a time and
+   rdpClientConGotCaptureDone calls this again for the next */
+static void
+rdpCapFrameRun(rdpClientCon *clientCon)
+{
+    struct rdp_cap_part *part;
+
+    /* damage since the frame started goes in the parts not captured */
+    rdpClientConDirtyGridFlush(clientCon);
+    rdpClientConSimplifyRegion(clientCon, clientCon->dirtyRegion);
+    while (clientCon->cap_part_index < clientCon->num_cap_parts)
+    {
+        if ((clientCon->cap_async != NULL) && clientCon->cap_async->busy)
         {
-            LLOGLN(0, ("rdpCapRect: rdpCapture failed"));
+            return;
         }
+        part = clientCon->cap_parts + clientCon->cap_part_index;
+        clientCon->cap_part_index++;
+        rdpCapRect(clientCon, &(part->cap_rect), part->mon, &(part->id));
     }
-    rdpRegionSubtract(clientCon->dirtyRegion, clientCon->dirtyRegion,
-                      cap_dirty_save);
-    rdpRegionDestroy(cap_dirty);
-    rdpRegionDestroy(cap_dirty_save);
-    return 0;
+    rdpClientConSendFrameEnd(clientCon->dev, clientCon);
+    rdpCapFrameReset(clientCon);
 }
 
 /******************************************************************************/
-static CARD32
-rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
+/* adds a part to the frame if it has anything dirty
+   returns FALSE if the frame is full */
+static Bool
+rdpCapFrameAddPart(rdpClientCon *clientCon, BoxPtr cap_rect, int mon,
+                   struct image_data *id)
+{
+    struct rdp_cap_part *part;
+    int rcode;
+
+    rcode = rdpRegionContainsRect(clientCon->dirtyRegion, cap_rect);
+    if (rcode == rgnOUT)
+    {
+        return TRUE;
+    }
+    if (clientCon->num_cap_parts >= RDP_MAX_CAP_PARTS)
+    {
+        return FALSE;
+    }
+    part = clientCon->cap_parts + clientCon->num_cap_parts;
+    part->cap_rect = *cap_rect;
+    part->mon = mon;
+    part->id = *id;
+    clientCon->num_cap_parts++;
+    return TRUE;
+}
+
+/******************************************************************************/
+/* the RFX modes lay each monitor out at rfx_shmem_offsets in the capture
+   buffer, message 64 has the offset, WIRETOSURFACE_2 only for an xrdp
+   that took RDP_XUP_CAP_GFX_SHMEM_OFFSET, without it a frame can only
+   have one monitor, at the start of the buffer
+   bands of one screen and the other modes share the desktop sized
+   buffer */
+static Bool
+rdpCapFrameMonitorsShareBuf(rdpClientCon *clientCon)
+{
+    return (clientCon->client_info.capture_code != 4) ||
+           (clientCon->xrdp_caps & (1 << RDP_XUP_CAP_GFX_SHMEM_OFFSET));
+}
+
+/******************************************************************************/
+/* puts the dirty bands of the screen in a frame
+   returns TRUE if all of them are in */
+static Bool
+rdpCapFrameAddBands(rdpClientCon *clientCon, struct image_data *id,
+                    RegionPtr frame_area)
 {
-    rdpClientCon *clientCon = (rdpClientCon *)arg;
-    struct image_data id;
     int index;
-    int monitor_index;
-    int monitor_count;
     int band_index;
     int band_count;
     int band_height;
@@ -2894,8 +4563,332 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
     int de_width;
     int de_height;
 
+    dirty_extents = *rdpRegionExtents(clientCon->dirtyRegion);
+    dirty_extents.x1 = RDPMAX(dirty_extents.x1, 0);
+    dirty_extents.y1 = RDPMAX(dirty_extents.y1, 0);
+    dirty_extents.x2 = RDPMIN(dirty_extents.x2, clientCon->rdp_width);
+    dirty_extents.y2 = RDPMIN(dirty_extents.y2, clientCon->rdp_height);
+    LLOGLN(10, ("rdpCapFrameAddBands: dirty_extents %d %d %d %d",
+           dirty_extents.x1, dirty_extents.y1,
+           dirty_extents.x2, dirty_extents.y2));
+    de_width = dirty_extents.x2 - dirty_extents.x1;
+    de_height = dirty_extents.y2 - dirty_extents.y1;
+    if ((de_width < 1) || (de_height < 1))
+    {
+        /* nothing changed in visible area */
+        return TRUE;
+    }
+    band_height = MAX_CAPTURE_PIXELS / de_width;
+    band_count = (de_width * de_height / MAX_CAPTURE_PIXELS) + 1;
+    LLOGLN(10, ("rdpCapFrameAddBands: band_count %d", band_count));
+    for (band_index = 0; band_index < band_count; band_index++)
+    {
+        /* start on a different band each time in case they do not
+           all fit */
+        index = (clientCon->rect_id + band_index) % band_count;
+        cap_rect.x1 = dirty_extents.x1;
+        cap_rect.y1 = dirty_extents.y1 + index * band_height;
+        cap_rect.x2 = dirty_extents.x2;
+        cap_rect.y2 = RDPMIN(cap_rect.y1 + band_height, dirty_extents.y2);
+        if (!rdpCapFrameAddPart(clientCon, &cap_rect, 0, id))
+        {
+            return FALSE;
+        }
+        rdpRegionUnionRect(frame_area, &cap_rect);
+    }
+    return TRUE;
+}
+
+/******************************************************************************/
+/* puts the dirty monitors in a frame, only one for RFX gfx without
+   RDP_XUP_CAP_GFX_SHMEM_OFFSET
+   returns TRUE if all of them are in */
+static Bool
+rdpCapFrameAddMonitors(rdpClientCon *clientCon, RegionPtr frame_area)
+{
+    struct image_data id;
+    int index;
+    int monitor_index;
+    int monitor_count;
+    BoxRec cap_rect;
+    Bool share;
+
+    share = rdpCapFrameMonitorsShareBuf(clientCon);
+    monitor_count = clientCon->dev->monitorCount;
+    for (monitor_index = 0; monitor_index < monitor_count; monitor_index++)
+    {
+        // Offset the monitor index by the rectangle ID so we start
+        // the monitor scan on a different monitor each time.
+        index = (clientCon->rect_id + monitor_index) % monitor_count;
+        cap_rect.x1 = clientCon->dev->minfo[index].left;
+        cap_rect.y1 = clientCon->dev->minfo[index].top;
+        cap_rect.x2 = clientCon->dev->minfo[index].right + 1;
+        cap_rect.y2 = clientCon->dev->minfo[index].bottom + 1;
+        if (!share && (clientCon->num_cap_parts > 0) &&
+            (rdpRegionContainsRect(clientCon->dirtyRegion,
+                                   &cap_rect) != rgnOUT))
+        {
+            return FALSE;
+        }
+        rdpClientConGetScreenImageRect(clientCon->dev, clientCon, &id);
+        id.left = cap_rect.x1;
+        id.top = cap_rect.y1;
+        id.width = cap_rect.x2 - cap_rect.x1;
+        id.height = cap_rect.y2 - cap_rect.y1;
+        id.flags = (index & 0xF) << 28;
+        if (share)
+        {
+            /* 0 for the modes that are not RFX */
+            id.shmem_offset = clientCon->rfx_shmem_offsets[index];
+        }
+        if (!rdpCapFrameAddPart(clientCon, &cap_rect, index, &id))
+        {
+            return FALSE;
+        }
+        rdpRegionUnionRect(frame_area, &cap_rect);
+    }
+    return TRUE;
+}
+
+/******************************************************************************/
+/* cost of spans all h rows high */
+static int64_t
+rdpSimplifyCost(BoxPtr spans, int num_spans, int h, int row, int rect)
+{
+    int64_t cost;
+    int index;
+
+    cost = 0;
+    for (index = 0; index < num_spans; index++)
+    {
+        cost += (int64_t) (spans[index].x2 - spans[index].x1) * h +
+                h * row + rect;
+    }
+    return cost;
+}
+
+/******************************************************************************/
+/* spans sorted by x1, joins the ones that overlap and the ones with a
+   gap that costs less than the rect it saves
+   returns the spans left */
+static int
+rdpSimplifySpans(BoxPtr spans, int num_spans, int h, int row, int rect)
+{
+    int index;
+    int out;
+    int max_gap;
+
+    if (num_spans < 1)
+    {
+        return 0;
+    }
+    max_gap = row + rect / RDPMAX(h, 1);
+    out = 0;
+    for (index = 1; index < num_spans; index++)
+    {
+        if (spans[index].x1 - spans[out].x2 <= max_gap)
+        {
+            spans[out].x2 = RDPMAX(spans[out].x2, spans[index].x2);
+        }
+        else
+        {
+            out++;
+            spans[out] = spans[index];
+        }
+    }
+    return out + 1;
+}
+
+/******************************************************************************/
+static int
+rdpSimplifyOut(BoxPtr spans, int num_spans, int y1, int y2,
+               xRectangle *out, int num_out)
+{
+    int index;
+
+    for (index = 0; index < num_spans; index++)
+    {
+        out[num_out].x = spans[index].x1;
+        out[num_out].y = y1;
+        out[num_out].width = spans[index].x2 - spans[index].x1;
+        out[num_out].height = y2 - y1;
+        num_out++;
+    }
+    return num_out;
+}
+
+/******************************************************************************/
+/* one pass of rdpClientConSimplifyRegion, joins spans in each band, then
+   each band with the one below while that costs less than the two
+   rects are y x banded, scratch holds 3 * num_rects boxes
+   returns the rects in out, at most num_rects */
+static int
+rdpSimplifyPass(BoxPtr rects, int num_rects, BoxPtr scratch,
+                xRectangle *out, int row, int rect)
+{
+    BoxPtr cur;
+    BoxPtr nxt;
+    BoxPtr tmp;
+    BoxPtr swap;
+    int num_cur;
+    int num_nxt;
+    int num_tmp;
+    int cur_y1;
+    int cur_y2;
+    int nxt_y1;
+    int nxt_y2;
+    int num_out;
+    int index;
+    int i1;
+    int i2;
+
+    cur = scratch;
+    nxt = scratch + num_rects;
+    tmp = scratch + num_rects * 2;
+    num_cur = 0;
+    num_out = 0;
+    cur_y1 = 0;
+    cur_y2 = 0;
+    index = 0;
+    while (index < num_rects)
+    {
+        /* the next band */
+        nxt_y1 = rects[index].y1;
+        nxt_y2 = rects[index].y2;
+        num_nxt = 0;
+        while ((index < num_rects) && (rects[index].y1 == nxt_y1))
+        {
+            nxt[num_nxt++] = rects[index++];
+        }
+        num_nxt = rdpSimplifySpans(nxt, num_nxt, nxt_y2 - nxt_y1, row, rect);
+        if (num_cur > 0)
+        {
+            /* both bands as one, from the top of cur to the bottom of
+               nxt, the rows in between too */
+            i1 = 0;
+            i2 = 0;
+            num_tmp = 0;
+            while ((i1 < num_cur) || (i2 < num_nxt))
+            {
+                if ((i2 >= num_nxt) ||
+                    ((i1 < num_cur) && (cur[i1].x1 <= nxt[i2].x1)))
+                {
+                    tmp[num_tmp++] = cur[i1++];
+                }
+                else
+                {
+                    tmp[num_tmp++] = nxt[i2++];
+                }
+            }
+            num_tmp = rdpSimplifySpans(tmp, num_tmp, nxt_y2 - cur_y1,
+                                       row, rect);
+            if (rdpSimplifyCost(tmp, num_tmp, nxt_y2 - cur_y1, row, rect) <=
+                rdpSimplifyCost(cur, num_cur, cur_y2 - cur_y1, row, rect) +
+                rdpSimplifyCost(nxt, num_nxt, nxt_y2 - nxt_y1, row, rect))
+            {
+                swap = cur;
+                cur = tmp;
+                tmp = swap;
+                num_cur = num_tmp;
+                cur_y2 = nxt_y2;
+                continue;
+            }
+            num_out = rdpSimplifyOut(cur, num_cur, cur_y1, cur_y2,
+                                     out, num_out);
+        }
+        swap = cur;
+        cur = nxt;
+        nxt = swap;
+        num_cur = num_nxt;
+        cur_y1 = nxt_y1;
+        cur_y2 = nxt_y2;
+    }
+    return rdpSimplifyOut(cur, num_cur, cur_y1, cur_y2, out, num_out);
+}
+
+/******************************************************************************/
+/* trades captured pixels for fewer rects where the rects cost more, by
+   the costs of the capture code in g_simplify_costs, and keeps the
+   rects of a frame under max_rects
+   reg only grows */
+static void
+rdpClientConSimplifyRegion(rdpClientCon *clientCon, RegionPtr reg)
+{
+    BoxPtr rects;
+    RegionPtr new_reg;
+    int num_rects;
+    int num_out;
+    int capture_code;
+    int row;
+    int rect;
+    int max_rects;
+    int pass;
+
+    num_rects = REGION_NUM_RECTS(reg);
+    if (num_rects < 2)
+    {
+        return;
+    }
+    capture_code = clientCon->client_info.capture_code;
+    if ((capture_code < 0) || (capture_code > 5))
+    {
+        capture_code = 0;
+    }
+    row = g_simplify_costs[capture_code].row;
+    rect = g_simplify_costs[capture_code].rect;
+    max_rects = g_simplify_costs[capture_code].max_rects;
+    if (num_rects > clientCon->simplify_alloc)
+    {
+        free(clientCon->simplify_boxes);
+        free(clientCon->simplify_rects);
+        clientCon->simplify_alloc = num_rects;
+        clientCon->simplify_boxes = g_new(BoxRec, num_rects * 3);
+        clientCon->simplify_rects = g_new(xRectangle, num_rects);
+    }
+    rects = REGION_RECTS(reg);
+    num_out = num_rects;
+    for (pass = 0; pass < 8; pass++)
+    {
+        num_out = rdpSimplifyPass(rects, num_rects,
+                                  clientCon->simplify_boxes,
+                                  clientCon->simplify_rects, row, rect);
+        if (num_out <= max_rects)
+        {
+            break;
+        }
+        rect *= 2;
+    }
+    LLOGLN(10, ("rdpClientConSimplifyRegion: %d rects to %d, rect cost %d",
+           num_rects, num_out, rect));
+    if (num_out > max_rects)
+    {
+        /* still too many, one rect */
+        rdpRegionReset(reg, rdpRegionExtents(reg));
+        return;
+    }
+    if (num_out >= num_rects)
+    {
+        return;
+    }
+    new_reg = rdpRegionFromRects(num_out, clientCon->simplify_rects,
+                                 CT_YXBANDED);
+    rdpRegionCopy(reg, new_reg);
+    rdpRegionDestroy(new_reg);
+}
+
+/******************************************************************************/
+static CARD32
+rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    rdpClientCon *clientCon = (rdpClientCon *)arg;
+    struct image_data id;
+    RegionPtr frame_area;
+    Bool all_parts;
+
     LLOGLN(10, ("rdpDeferredUpdateCallback:"));
+    all_parts = TRUE;
     clientCon->updateScheduled = FALSE;
+    clientCon->pace.input_armed = 0;
     if (clientCon->suppress_output)
     {
         LLOGLN(10, ("rdpDeferredUpdateCallback: suppress_output set"));
@@ -2908,109 +4901,55 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
                clientCon->shmemstatus, clientCon->rect_id, clientCon->rect_id_ack));
         return 0;
     }
-    if ((clientCon->rect_id > clientCon->rect_id_ack) ||
+    if (rdpClientConCaptureBusy(clientCon) ||
         /* do not allow captures until we have the client_info */
         clientCon->client_info.size == 0)
     {
         return 0;
     }
     clientCon->lastUpdateTime = now;
+    rdpClientConLogStats(clientCon, now);
     LLOGLN(10, ("rdpDeferredUpdateCallback: sending"));
     clientCon->updateRetries = 0;
-    rdpClientConGetScreenImageRect(clientCon->dev, clientCon, &id);
-    LLOGLN(10, ("rdpDeferredUpdateCallback: rdp_width %d rdp_height %d "
-           "rdp_Bpp %d screen width %d screen height %d",
-           clientCon->rdp_width, clientCon->rdp_height, clientCon->rdp_Bpp,
-           id.width, id.height));
-    if (clientCon->dev->monitorCount < 1)
-    {
-        dirty_extents = *rdpRegionExtents(clientCon->dirtyRegion);
-        dirty_extents.x1 = RDPMAX(dirty_extents.x1, 0);
-        dirty_extents.y1 = RDPMAX(dirty_extents.y1, 0);
-        dirty_extents.x2 = RDPMIN(dirty_extents.x2, clientCon->rdp_width);
-        dirty_extents.y2 = RDPMIN(dirty_extents.y2, clientCon->rdp_height);
-        LLOGLN(10, ("rdpDeferredUpdateCallback: dirty_extents %d %d %d %d",
-               dirty_extents.x1, dirty_extents.y1,
-               dirty_extents.x2, dirty_extents.y2));
-        de_width = dirty_extents.x2 - dirty_extents.x1;
-        de_height = dirty_extents.y2 - dirty_extents.y1;
-        if ((de_width > 0) && (de_height > 0))
-        {
-            band_height = MAX_CAPTURE_PIXELS / de_width;
-            band_index = 0;
-            band_count = (de_width * de_height / MAX_CAPTURE_PIXELS) + 1;
-            LLOGLN(10, ("rdpDeferredUpdateCallback: band_index %d "
-                   "band_count %d", band_index, band_count));
-            while (band_index < band_count)
-            {
-                if (clientCon->rect_id > clientCon->rect_id_ack)
-                {
-                    LLOGLN(10, ("rdpDeferredUpdateCallback: reschedule "
-                           "rect_id %d rect_id_ack %d",
-                           clientCon->rect_id, clientCon->rect_id_ack));
-                    break;
-                }
-                index = (clientCon->rect_id + band_index) % band_count;
-                cap_rect.x1 = dirty_extents.x1;
-                cap_rect.y1 = dirty_extents.y1 + index * band_height;
-                cap_rect.x2 = dirty_extents.x2;
-                cap_rect.y2 = RDPMIN(cap_rect.y1 + band_height,
-                                     dirty_extents.y2);
-                rdpCapRect(clientCon, &cap_rect, 0, &id);
-                band_index++;
-            }
-            if (band_index == band_count)
-            {
-                /* gone through all bands, nothing changed */
-                rdpRegionDestroy(clientCon->dirtyRegion);
-                clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
-            }
+    rdpClientConDirtyGridFlush(clientCon);
+    rdpClientConSimplifyRegion(clientCon, clientCon->dirtyRegion);
+    /* all monitors or bands go out in one frame without waiting for
+       acks in between, RFX monitors go in frames of their own while
+       there are capture buffers for them */
+    do
+    {
+        if (rdpClientConCaptureBusy(clientCon))
+        {
+            LLOGLN(10, ("rdpDeferredUpdateCallback: reschedule rect_id %d "
+                   "rect_id_ack %d",
+                   clientCon->rect_id, clientCon->rect_id_ack));
+            break;
+        }
+        rdpClientConGetScreenImageRect(clientCon->dev, clientCon, &id);
+        LLOGLN(10, ("rdpDeferredUpdateCallback: rdp_width %d rdp_height %d "
+               "rdp_Bpp %d screen width %d screen height %d",
+               clientCon->rdp_width, clientCon->rdp_height,
+               clientCon->rdp_Bpp, id.width, id.height));
+        frame_area = rdpRegionCreate(NullBox, 0);
+        if (clientCon->dev->monitorCount < 1)
+        {
+            all_parts = rdpCapFrameAddBands(clientCon, &id, frame_area);
         }
         else
         {
-            /* nothing changed in visible area */
-            rdpRegionDestroy(clientCon->dirtyRegion);
-            clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
+            all_parts = rdpCapFrameAddMonitors(clientCon, frame_area);
         }
-    }
-    else
-    {
-        monitor_index = 0;
-        monitor_count = clientCon->dev->monitorCount;
-        while (monitor_index < monitor_count)
+        if (all_parts)
         {
-            // Did we get anything from the last monitor?
-            if (clientCon->rect_id > clientCon->rect_id_ack)
-            {
-                LLOGLN(10, ("rdpDeferredUpdateCallback: reschedule rect_id %d "
-                       "rect_id_ack %d",
-                       clientCon->rect_id, clientCon->rect_id_ack));
-                break;
-            }
-            // Offset the monitor index by the rectangle ID so we start
-            // the monitor scan on a different monitor each time.
-            index = (clientCon->rect_id + monitor_index) % monitor_count;
-            cap_rect.x1 = clientCon->dev->minfo[index].left;
-            cap_rect.y1 = clientCon->dev->minfo[index].top;
-            cap_rect.x2 = clientCon->dev->minfo[index].right + 1;
-            cap_rect.y2 = clientCon->dev->minfo[index].bottom + 1;
-            rdpClientConGetScreenImageRect(clientCon->dev, clientCon, &id);
-            id.left = cap_rect.x1;
-            id.top = cap_rect.y1;
-            id.width = cap_rect.x2 - cap_rect.x1;
-            id.height = cap_rect.y2 - cap_rect.y1;
-            id.flags = (index & 0xF) << 28;
-            rdpCapRect(clientCon, &cap_rect, index, &id);
-            monitor_index++;
-        }
-        if (monitor_index == monitor_count)
-        {
-            /* gone through all monitors, nothing changed */
-            rdpRegionDestroy(clientCon->dirtyRegion);
-            clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
-        }
-    }
-    if (rdpRegionNotEmpty(clientCon->dirtyRegion))
+            /* what is not on a screen will not be captured */
+            rdpRegionIntersect(clientCon->dirtyRegion,
+                               clientCon->dirtyRegion, frame_area);
+        }
+        rdpRegionDestroy(frame_area);
+        rdpClientConSelectShmBuf(clientCon);
+        rdpCapFrameRun(clientCon);
+    } while (!all_parts && rdpRegionNotEmpty(clientCon->dirtyRegion));
+    if (rdpClientConDirtyPending(clientCon))
     {
         rdpScheduleDeferredUpdate(clientCon);
     }
@@ -3020,7 +4959,6 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
 
 
 /******************************************************************************/
-#define MIN_MS_BETWEEN_FRAMES 40
 #define MIN_MS_TO_WAIT_FOR_MORE_UPDATES 4
 #define UPDATE_RETRY_TIMEOUT 200 // After this number of retries, give up and perform the capture anyway. This prevents an infinite loop.
 static void
@@ -3029,17 +4967,60 @@ rdpScheduleDeferredUpdate(rdpClientCon *clientCon)
     uint32_t curTime;
     uint32_t msToWait;
     uint32_t minNextUpdateTime;
+    int frame_ms;
+    int pixels;
+    BoxPtr extents;
+    struct rdp_dirty_grid *grid;
 
+    curTime = (uint32_t) GetTimeInMillis();
+    if (clientCon->pace.input_fast)
+    {
+        if (curTime - clientCon->pace.input_time < RDP_PACE_INPUT_MS)
+        {
+            /* capture what the input brought as soon as the X server is
+               done with the requests at hand, even if an update is
+               already scheduled for later, TimerSet does not arm 0 */
+            if (!clientCon->updateScheduled || !clientCon->pace.input_armed)
+            {
+                clientCon->updateTimer = TimerSet(clientCon->updateTimer,
+                                                  0, 1,
+                                                  rdpDeferredUpdateCallback,
+                                                  clientCon);
+                clientCon->updateScheduled = TRUE;
+                clientCon->pace.input_armed = 1;
+            }
+            return;
+        }
+        clientCon->pace.input_fast = 0;
+    }
     if (clientCon->updateScheduled)
     {
         return;
     }
-    curTime = (uint32_t) GetTimeInMillis();
+    /* the interval from rdpClientConPaceAcked, longer if the damage takes
+       longer than that to get through */
+    frame_ms = clientCon->pace.frame_ms;
+    if (clientCon->pace.px_per_ms > 0)
+    {
+        extents = rdpRegionExtents(clientCon->dirtyRegion);
+        pixels = (extents->x2 - extents->x1) * (extents->y2 - extents->y1);
+        grid = &(clientCon->dirty_grid);
+        if (grid->row1 < grid->row2)
+        {
+            /* the rows with marked cells, across the screen */
+            pixels = RDPMAX(pixels, ((grid->row2 - grid->row1) <<
+                                     grid->cell_shift) * grid->width);
+        }
+        frame_ms = RDPMAX(frame_ms,
+                          RDPMIN(pixels / clientCon->pace.px_per_ms,
+                                 1000 / RDPMAX(clientCon->dev->frame_rate_min,
+                                               1)));
+    }
     /* use two separate delays in order to limit the update rate and wait a bit
        for more changes before sending an update. Always waiting the longer
        delay would introduce unnecessarily much latency. */
     msToWait = MIN_MS_TO_WAIT_FOR_MORE_UPDATES;
-    minNextUpdateTime = clientCon->lastUpdateTime + MIN_MS_BETWEEN_FRAMES;
+    minNextUpdateTime = clientCon->lastUpdateTime + frame_ms;
     /* the first check is to gracefully handle the infrequent case of
        the time wrapping around */
     if(clientCon->lastUpdateTime < curTime &&
@@ -3056,13 +5037,265 @@ rdpScheduleDeferredUpdate(rdpClientCon *clientCon)
     ++clientCon->updateRetries;
 }
 
+/******************************************************************************/
+/* the grid covers the screen in cells of what the capture code converts,
+   RFX tiles or H.264 macroblocks, the other codes copy exactly the dirty
+   rects, there the grid would capture more and damage stays a region */
+static void
+rdpClientConDirtyGridInit(rdpPtr dev, rdpClientCon *clientCon)
+{
+    struct rdp_dirty_grid *grid;
+
+    grid = &(clientCon->dirty_grid);
+    rdpClientConDirtyGridFlush(clientCon);
+    free(grid->bits);
+    grid->bits = NULL;
+    switch (clientCon->client_info.capture_code)
+    {
+        case 2:
+        case 4:
+            grid->cell_shift = 6; /* XRDP_RFX_ALIGN */
+            break;
+        case 3:
+        case 5:
+            grid->cell_shift = 4; /* XRDP_H264_ALIGN */
+            break;
+        default:
+            grid->cell_shift = 0;
+            return;
+    }
+    grid->width = dev->width;
+    grid->height = dev->height;
+    grid->cols = (grid->width + (1 << grid->cell_shift) - 1) >>
+                 grid->cell_shift;
+    grid->rows = (grid->height + (1 << grid->cell_shift) - 1) >>
+                 grid->cell_shift;
+    grid->words_per_row = (grid->cols + 31) / 32;
+    grid->bits = g_new0(uint32_t, grid->words_per_row * grid->rows);
+    grid->row1 = grid->rows;
+    grid->row2 = 0;
+    LLOGLN(0, ("rdpClientConDirtyGridInit: %d x %d cells of %d",
+           grid->cols, grid->rows, 1 << grid->cell_shift));
+}
+
+/******************************************************************************/
+static void
+rdpClientConDirtyGridDelete(rdpClientCon *clientCon)
+{
+    free(clientCon->dirty_grid.bits);
+    free(clientCon->dirty_grid.rects);
+    memset(&(clientCon->dirty_grid), 0, sizeof(clientCon->dirty_grid));
+}
+
+/******************************************************************************/
+/* returns FALSE if box is not all on the grid, it goes to dirtyRegion
+   then, the screen can change size before xrdp says so */
+static Bool
+rdpClientConDirtyGridAdd(rdpClientCon *clientCon, BoxPtr box)
+{
+    struct rdp_dirty_grid *grid;
+    uint32_t *row_bits;
+    int col1;
+    int col2;
+    int row1;
+    int row2;
+    int word1;
+    int word2;
+    int index;
+    uint32_t mask1;
+    uint32_t mask2;
+
+    grid = &(clientCon->dirty_grid);
+    if ((grid->bits == NULL) ||
+        (box->x1 < 0) || (box->y1 < 0) ||
+        (box->x2 > grid->width) || (box->y2 > grid->height))
+    {
+        return FALSE;
+    }
+    if ((box->x2 <= box->x1) || (box->y2 <= box->y1))
+    {
+        return TRUE;
+    }
+    col1 = box->x1 >> grid->cell_shift;
+    col2 = (box->x2 - 1) >> grid->cell_shift;
+    row1 = box->y1 >> grid->cell_shift;
+    row2 = ((box->y2 - 1) >> grid->cell_shift) + 1;
+    word1 = col1 / 32;
+    word2 = col2 / 32;
+    mask1 = 0xFFFFFFFF << (col1 & 31);
+    mask2 = 0xFFFFFFFF >> (31 - (col2 & 31));
+    grid->row1 = RDPMIN(grid->row1, row1);
+    grid->row2 = RDPMAX(grid->row2, row2);
+    for (; row1 < row2; row1++)
+    {
+        row_bits = grid->bits + row1 * grid->words_per_row;
+        if (word1 == word2)
+        {
+            row_bits[word1] |= mask1 & mask2;
+            continue;
+        }
+        row_bits[word1] |= mask1;
+        for (index = word1 + 1; index < word2; index++)
+        {
+            row_bits[index] = 0xFFFFFFFF;
+        }
+        row_bits[word2] |= mask2;
+    }
+    return TRUE;
+}
+
+/******************************************************************************/
+/* TRUE if there is damage not captured yet */
+static Bool
+rdpClientConDirtyPending(rdpClientCon *clientCon)
+{
+    return (clientCon->dirty_grid.row1 < clientCon->dirty_grid.row2) ||
+           rdpRegionNotEmpty(clientCon->dirtyRegion);
+}
+
+/******************************************************************************/
+/* moves the marked cells to dirtyRegion, a run of cells in a row is one
+   rect and rows with the same runs are one band */
+static void
+rdpClientConDirtyGridFlush(rdpClientCon *clientCon)
+{
+    struct rdp_dirty_grid *grid;
+    uint32_t *row_bits;
+    xRectangle *rect;
+    RegionPtr reg;
+    int num_rects;
+    int band;
+    int band_rects;
+    int row;
+    int col;
+    int col1;
+    int cell;
+    int y;
+    int index;
+
+    grid = &(clientCon->dirty_grid);
+    if (grid->row1 >= grid->row2)
+    {
+        return;
+    }
+    cell = 1 << grid->cell_shift;
+    num_rects = 0;
+    band = 0;
+    band_rects = 0;
+    for (row = grid->row1; row < grid->row2; row++)
+    {
+        row_bits = grid->bits + row * grid->words_per_row;
+        y = row << grid->cell_shift;
+        /* at most one rect for every other cell */
+        if (num_rects + grid->cols / 2 + 1 > grid->rects_alloc)
+        {
+            grid->rects_alloc = num_rects + grid->cols / 2 + 1 +
+                                grid->cols * 4;
+            rect = g_new(xRectangle, grid->rects_alloc);
+            if (num_rects > 0)
+            {
+                memcpy(rect, grid->rects, num_rects * sizeof(xRectangle));
+            }
+            free(grid->rects);
+            grid->rects = rect;
+        }
+        index = num_rects;
+        col = 0;
+        while (col < grid->cols)
+        {
+            if (row_bits[col / 32] == 0)
+            {
+                col = (col + 32) & ~31;
+                continue;
+            }
+            if ((row_bits[col / 32] & (1u << (col & 31))) == 0)
+            {
+                col++;
+                continue;
+            }
+            col1 = col;
+            while ((col < grid->cols) &&
+                   (row_bits[col / 32] & (1u << (col & 31))))
+            {
+                col++;
+            }
+            rect = grid->rects + num_rects;
+            rect->x = col1 << grid->cell_shift;
+            rect->y = y;
+            rect->width = RDPMIN(col << grid->cell_shift, grid->width) -
+                          rect->x;
+            rect->height = RDPMIN(cell, grid->height - y);
+            num_rects++;
+        }
+        memset(row_bits, 0, grid->words_per_row * sizeof(uint32_t));
+        if (num_rects == index)
+        {
+            continue;
+        }
+        /* same runs as the band right above, make it taller */
+        if ((band_rects == num_rects - index) &&
+            (grid->rects[band].y + grid->rects[band].height == y))
+        {
+            for (col = 0; col < band_rects; col++)
+            {
+                if ((grid->rects[band + col].x != grid->rects[index + col].x) ||
+                    (grid->rects[band + col].width !=
+                     grid->rects[index + col].width))
+                {
+                    break;
+                }
+            }
+            if (col == band_rects)
+            {
+                for (col = 0; col < band_rects; col++)
+                {
+                    grid->rects[band + col].height +=
+                        grid->rects[index + col].height;
+                }
+                num_rects = index;
+                continue;
+            }
+        }
+        band = index;
+        band_rects = num_rects - index;
+    }
+    grid->row1 = grid->rows;
+    grid->row2 = 0;
+    if (num_rects < 1)
+    {
+        return;
+    }
+    reg = rdpRegionFromRects(num_rects, grid->rects, CT_YXBANDED);
+    rdpRegionUnion(clientCon->dirtyRegion, clientCon->dirtyRegion, reg);
+    rdpRegionDestroy(reg);
+}
+
 /******************************************************************************/
 int
 rdpClientConAddDirtyScreenReg(rdpPtr dev, rdpClientCon *clientCon,
                               RegionPtr reg)
 {
+    BoxPtr rects;
+    int num_rects;
+    int index;
+
     LLOGLN(10, ("rdpClientConAddDirtyScreenReg:"));
-    rdpRegionUnion(clientCon->dirtyRegion, clientCon->dirtyRegion, reg);
+    if (clientCon->dirty_grid.bits == NULL)
+    {
+        rdpRegionUnion(clientCon->dirtyRegion, clientCon->dirtyRegion, reg);
+    }
+    else
+    {
+        rects = REGION_RECTS(reg);
+        num_rects = REGION_NUM_RECTS(reg);
+        for (index = 0; index < num_rects; index++)
+        {
+            if (!rdpClientConDirtyGridAdd(clientCon, rects + index))
+            {
+                rdpRegionUnionRect(clientCon->dirtyRegion, rects + index);
+            }
+        }
+    }
     rdpScheduleDeferredUpdate(clientCon);
     return 0;
 }
@@ -3072,11 +5305,11 @@ int
 rdpClientConAddDirtyScreenBox(rdpPtr dev, rdpClientCon *clientCon,
                               BoxPtr box)
 {
-    RegionPtr reg;
-
-    reg = rdpRegionCreate(box, 0);
-    rdpClientConAddDirtyScreenReg(dev, clientCon, reg);
-    rdpRegionDestroy(reg);
+    if (!rdpClientConDirtyGridAdd(clientCon, box))
+    {
+        rdpRegionUnionRect(clientCon->dirtyRegion, box);
+    }
+    rdpScheduleDeferredUpdate(clientCon);
     return 0;
 }
 
@@ -3114,6 +5347,14 @@ rdpClientConGetScreenImageRect(rdpPtr dev, rdpClientCon *clientCon,
     id->shmem_bytes = clientCon->shmem_bytes;
     id->shmem_offset = 0;
     id->shmem_lineBytes = clientCon->shmem_lineBytes;
+    if (clientCon->cap_from_fb)
+    {
+        /* rdpCapture0 sees shmem_pixels == pixels and does not copy */
+        id->shmem_pixels = dev->pfbMemory;
+        id->shmem_fd = dev->pfbMemory_fd;
+        id->shmem_bytes = dev->pfbMemory_bytes;
+        id->shmem_lineBytes = dev->paddedWidthInBytes;
+    }
 }
 
 /******************************************************************************/
@@ -60,6 +60,83 @@ enum shared_memory_status {
     SHM_H264_ACTIVE
 };
 
+/* most capture buffers, and frames in flight, for each client */
+#define RDP_MAX_SHM_BUFS 4
+
+/* most monitors or bands in one frame */
+#define RDP_MAX_CAP_PARTS 16
+
+/* a monitor or band of the frame rdpDeferredUpdateCallback is capturing */
+struct rdp_cap_part
+{
+    BoxRec cap_rect;
+    int mon;
+    struct image_data id;
+};
+
+/* a message, or the rest of one, waiting for the socket to take it */
+struct rdp_out_msg
+{
+    struct rdp_out_msg *next;
+    char *data;
+    int len;
+    int offset; /* sent so far */
+    int fd; /* a dup, goes with the first byte, -1 if none */
+};
+
+/* frames whose send time is kept for pacing, by rect_id */
+#define RDP_PACE_SLOTS 16
+
+/* frame pacing state, see rdpClientConPaceAcked */
+struct rdp_pace
+{
+    CARD32 send_time[RDP_PACE_SLOTS];
+    int send_pixels[RDP_PACE_SLOTS];
+    int frame_pixels; /* gfx frame not sent yet */
+    int ack_ms8; /* smoothed send to ack time, times 8 */
+    int ack_ms_min; /* best lately */
+    int acks;
+    int px_per_ms; /* smoothed damage xrdp gets through */
+    int frame_ms; /* interval between captures */
+    /* key press or click at input_time, damage is captured right away
+       for RDP_PACE_INPUT_MS after it */
+    CARD32 input_time;
+    int input_fast;
+    int input_armed; /* updateTimer was moved up for it */
+    /* for rdpClientConLogStats, since stats_time */
+    CARD32 stats_time;
+    int stats_frames;
+    int stats_acks;
+    int stats_pixels;
+};
+
+/* damage in cells the size of what the capture code converts, marking
+   a cell is a few bit sets where a region union grows with the region,
+   rdpClientConDirtyGridFlush moves the cells to dirtyRegion for capture */
+struct rdp_dirty_grid
+{
+    uint32_t *bits; /* one per cell, rows of words_per_row */
+    int cell_shift; /* 0 when damage goes to dirtyRegion right away */
+    int width; /* of the screen the grid covers */
+    int height;
+    int cols;
+    int rows;
+    int words_per_row;
+    int row1; /* rows with bits set, row2 is exclusive */
+    int row2;
+    xRectangle *rects; /* rdpClientConDirtyGridFlush */
+    int rects_alloc;
+};
+
+/* one capture buffer of the ring */
+struct rdp_shm_buf
+{
+    uint8_t *ptr;
+    int fd;
+    int bytes;
+    RegionPtr stale; /* painted from the other buffers since */
+};
+
 /* one of these for each client */
 struct _rdpClientCon
 {
@@ -69,9 +146,18 @@ struct _rdpClientCon
     int sckControlListener;
     int sckControl;
     struct stream *out_s;
-    struct stream *in_s;
+    struct stream *in_s; /* also the receive buffer */
+    int recv_start; /* first byte in in_s not processed */
+    int recv_end;
+    int recv_need; /* size of the partial message at recv_start */
+    /* what sck did not take yet, sent when it is writable */
+    struct rdp_out_msg *out_head;
+    struct rdp_out_msg *out_tail;
+    int out_bytes;
+    OsTimerPtr out_timer; /* servers without write notify */
 
     int connected; /* boolean. Set to False when I/O fails */
+    OsTimerPtr remove_timer; /* removes it after connected went FALSE */
     int begin; /* boolean */
     int count;
     struct rdpup_os_bitmap *osBitmaps;
@@ -106,25 +192,84 @@ struct _rdpClientCon
 
     struct xrdp_client_info client_info;
 
+    /* the capture buffer in use, one of shm_bufs */
     uint8_t *shmemptr;
     int shmemfd;
     int shmem_bytes;
+    struct rdp_shm_buf shm_bufs[RDP_MAX_SHM_BUFS];
+    int num_shm_bufs;
+    int shm_buf_index;
+    int shm_generation; /* of the shm_bufs xrdp has, message 65 */
+    /* parts of the buffer in use that rdpCapture has to bring up to date
+       before the paint, H264 encodes the whole buffer */
+    BoxPtr cap_stale_rects;
+    int num_cap_stale_rects;
+    int cap_stale_rects_alloc;
     int shmem_lineBytes;
     RegionPtr shmRegion;
     int rect_id;
     int rect_id_ack;
+    int fb_generation_sent; /* dev->fb_generation xrdp has the fd of */
+    Bool cap_from_fb; /* rdpClientConFbShared at the last resize */
     enum shared_memory_status shmemstatus;
 
     OsTimerPtr updateTimer;
     CARD32 lastUpdateTime; /* millisecond timestamp */
     int updateScheduled; /* boolean */
     int updateRetries;
+    struct rdp_pace pace;
 
     RegionPtr dirtyRegion;
+    struct rdp_dirty_grid dirty_grid;
+    /* rdpClientConSimplifyRegion scratch, 3 boxes and a rect per rect */
+    BoxPtr simplify_boxes;
+    xRectangle *simplify_rects;
+    int simplify_alloc;
+
+    /* NULL when capture runs on the X server thread */
+    struct rdp_cap_async *cap_async;
+    /* what rdpCapture works on, only one capture runs at a time, with
+       a capture thread the region and arena are its until the capture
+       is done */
+    RegionRec cap_dirty;
+    /* rdpCapture scratch and out_rects, reset after each capture */
+    struct rdp_arena *cap_arena;
 
-    int num_rfx_crcs_alloc[16];
-    int *rfx_crcs[16];
+    /* per monitor, one hash per 64x64 tile, from dev->tile_hash */
+    int num_rfx_tile_hashes_alloc[16];
+    uint64_t *rfx_tile_hashes[16];
     int send_key_frame[16];
+    /* per monitor, where its tiles start in the RFX capture buffer */
+    int rfx_shmem_offsets[16];
+
+    /* capture codes 3 and 5, per monitor, one hash per 16x16 macroblock */
+    int num_mb_hashes_alloc[16];
+    uint64_t *mb_hashes[16];
+    /* macroblocks the last capture converted, one bit each, row major with
+       rows padded to bytes, sent in WIRETOSURFACE_1 */
+    uint8_t *mb_changed;
+    int mb_changed_alloc;
+    int mb_changed_bytes;
+    int mb_cols;
+    int mb_rows;
+
+    int xrdp_caps; /* one bit for each RDP_XUP_CAP_ xrdp takes */
+    /* rdpClientConTileMap, one byte per cell and the coded map */
+    uint8_t *tile_cells;
+    int tile_cells_alloc;
+    uint8_t *tile_map;
+    int tile_map_alloc;
+
+    /* the frame being captured, its parts go out before any ack is
+       waited for and the gfx surface commands of all of them go out
+       between one STARTFRAME and ENDFRAME, see rdpCapFrameRun */
+    struct rdp_cap_part cap_parts[RDP_MAX_CAP_PARTS];
+    int num_cap_parts;
+    int cap_part_index;
+    struct stream *frame_s; /* surface commands not sent yet */
+    RegionPtr frame_dirty; /* what they paint */
+    int frame_shmem_bytes;
+    int frame_shmem_fd;
 
     /* true = skip drawing */
     int suppress_output;
@@ -78,6 +78,13 @@ rdpCopyArea(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
     box.y1 = dsty + pDst->y;
     box.x2 = box.x1 + w;
     box.y2 = box.y1 + h;
+    if (rdpDrawBoxInClip(dev, &box, pDst, pGC))
+    {
+        /* do original call */
+        rv = rdpCopyAreaOrg(pSrc, pDst, pGC, srcx, srcy, w, h, dstx, dsty);
+        rdpClientConAddAllBox(dev, &box, pDst);
+        return rv;
+    }
     rdpRegionInit(&reg, &box, 0);
     rdpRegionInit(&clip_reg, NullBox, 0);
     cd = rdpDrawGetClip(dev, &clip_reg, pDst, pGC);
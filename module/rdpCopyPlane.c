@@ -80,7 +80,15 @@ rdpCopyPlane(DrawablePtr pSrc, DrawablePtr pDst,
     box.x1 = pDst->x + dstx;
     box.y1 = pDst->y + dsty;
     box.x2 = box.x1 + w;
-    box.y2 = box.x1 + h;
+    box.y2 = box.y1 + h;
+    if (rdpDrawBoxInClip(dev, &box, pDst, pGC))
+    {
+        /* do original call */
+        rv = rdpCopyPlaneOrg(pSrc, pDst, pGC, srcx, srcy, w, h,
+                             dstx, dsty, bitPlane);
+        rdpClientConAddAllBox(dev, &box, pDst);
+        return rv;
+    }
     rdpRegionInit(&reg, &box, 0);
     rdpRegionInit(&clip_reg, NullBox, 0);
     cd = rdpDrawGetClip(dev, &clip_reg, pDst, pGC);
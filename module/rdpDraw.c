@@ -161,6 +161,87 @@ rdpDrawGetClip(rdpPtr dev, RegionPtr pRegion, DrawablePtr pDrawable, GCPtr pGC)
     return rv;
 }
 
+/******************************************************************************/
+/* the fast path of rdpDrawGetClip for an op that draws inside box, box in
+   screen coordinates, most top level window drawing
+   returns TRUE if the clip is one rect holding all of box, then box is
+   the damage and no region is needed */
+Bool
+rdpDrawBoxInClip(rdpPtr dev, BoxPtr box, DrawablePtr pDrawable, GCPtr pGC)
+{
+    WindowPtr pWindow;
+    RegionPtr clip;
+    BoxRec clip_box;
+
+    if ((box->x1 >= box->x2) || (box->y1 >= box->y2) ||
+        is_clientClip_region(pGC))
+    {
+        return FALSE;
+    }
+    if (pDrawable->type == DRAWABLE_PIXMAP)
+    {
+        clip_box.x1 = 0;
+        clip_box.y1 = 0;
+        clip_box.x2 = pDrawable->width;
+        clip_box.y2 = pDrawable->height;
+    }
+    else if (pDrawable->type == DRAWABLE_WINDOW)
+    {
+        pWindow = (WindowPtr)pDrawable;
+        if (!pWindow->viewable)
+        {
+            return FALSE;
+        }
+        if (pGC->subWindowMode == IncludeInferiors)
+        {
+            clip = &pWindow->borderClip;
+        }
+        else
+        {
+            clip = &pWindow->clipList;
+        }
+        if (REGION_NUM_RECTS(clip) != 1)
+        {
+            return FALSE;
+        }
+        clip_box = *rdpRegionExtents(clip);
+    }
+    else
+    {
+        return FALSE;
+    }
+    return (box->x1 >= clip_box.x1) && (box->y1 >= clip_box.y1) &&
+           (box->x2 <= clip_box.x2) && (box->y2 <= clip_box.y2);
+}
+
+/******************************************************************************/
+/* screen extents of nspans spans, nspans > 0, for FillSpans and SetSpans */
+void
+rdpDrawSpansExtents(DrawablePtr pDrawable, GCPtr pGC, int nspans,
+                    DDXPointPtr ppt, int *pwidth, BoxPtr box)
+{
+    int index;
+
+    box->x1 = ppt[0].x;
+    box->y1 = ppt[0].y;
+    box->x2 = ppt[0].x + pwidth[0];
+    box->y2 = ppt[0].y + 1;
+    for (index = 1; index < nspans; index++)
+    {
+        box->x1 = RDPMIN(box->x1, ppt[index].x);
+        box->y1 = RDPMIN(box->y1, ppt[index].y);
+        box->x2 = RDPMAX(box->x2, ppt[index].x + pwidth[index]);
+        box->y2 = RDPMAX(box->y2, ppt[index].y + 1);
+    }
+    if (!pGC->miTranslate)
+    {
+        box->x1 += pDrawable->x;
+        box->y1 += pDrawable->y;
+        box->x2 += pDrawable->x;
+        box->y2 += pDrawable->y;
+    }
+}
+
 /******************************************************************************/
 void
 GetTextBoundingBox(DrawablePtr pDrawable, FontPtr font, int x, int y,
@@ -393,6 +474,51 @@ rdpCloseScreen(ScreenPtr pScreen)
 
 #endif
 
+/******************************************************************************/
+/* frees dev->pfbMemory, from either rdpAllocFramebuffer path */
+void
+rdpFreeFramebuffer(rdpPtr dev)
+{
+    if (dev->pfbMemory_fd >= 0)
+    {
+        g_free_unmap_fd(dev->pfbMemory, dev->pfbMemory_fd,
+                        dev->pfbMemory_bytes);
+        dev->pfbMemory_fd = -1;
+        dev->pfbMemory_bytes = 0;
+    }
+    free(dev->pfbMemory_alloc);
+    dev->pfbMemory_alloc = NULL;
+    dev->pfbMemory = NULL;
+}
+
+/******************************************************************************/
+/* allocates dev->pfbMemory for dev->sizeInBytes, with FramebufferShared it
+   is a memfd mapping xrdp can map so capture code 0 does not copy */
+void
+rdpAllocFramebuffer(rdpPtr dev)
+{
+    void *addr;
+
+    rdpFreeFramebuffer(dev);
+    dev->fb_generation++;
+    if (dev->fb_shared)
+    {
+        if (g_alloc_memfd_map_fd(&addr, &(dev->pfbMemory_fd),
+                                 dev->sizeInBytes) == 0)
+        {
+            dev->pfbMemory = (uint8_t *) addr;
+            dev->pfbMemory_bytes = dev->sizeInBytes;
+            LLOGLN(0, ("rdpAllocFramebuffer: shared pfbMemory fd %d",
+                   dev->pfbMemory_fd));
+            return;
+        }
+        LLOGLN(0, ("rdpAllocFramebuffer: g_alloc_memfd_map_fd failed"));
+        dev->pfbMemory_fd = -1;
+    }
+    dev->pfbMemory_alloc = g_new0(uint8_t, dev->sizeInBytes + 16);
+    dev->pfbMemory = (uint8_t *) RDPALIGN(dev->pfbMemory_alloc, 16);
+}
+
 /******************************************************************************/
 WindowPtr
 rdpGetRootWindowPtr(ScreenPtr pScreen)
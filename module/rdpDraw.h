@@ -84,6 +84,11 @@ extern GCOps g_rdpGCOps; /* in rdpGC.c */
 
 extern _X_EXPORT int
 rdpDrawGetClip(rdpPtr dev, RegionPtr pRegion, DrawablePtr pDrawable, GCPtr pGC);
+extern _X_EXPORT Bool
+rdpDrawBoxInClip(rdpPtr dev, BoxPtr box, DrawablePtr pDrawable, GCPtr pGC);
+extern _X_EXPORT void
+rdpDrawSpansExtents(DrawablePtr pDrawable, GCPtr pGC, int nspans,
+                    DDXPointPtr ppt, int *pwidth, BoxPtr box);
 extern _X_EXPORT void
 GetTextBoundingBox(DrawablePtr pDrawable, FontPtr font, int x, int y,
                    int n, BoxPtr pbox);
@@ -104,6 +109,10 @@ rdpCloseScreen(ScreenPtr pScreen);
 #endif
 extern _X_EXPORT WindowPtr
 rdpGetRootWindowPtr(ScreenPtr pScreen);
+extern _X_EXPORT void
+rdpFreeFramebuffer(rdpPtr dev);
+extern _X_EXPORT void
+rdpAllocFramebuffer(rdpPtr dev);
 extern _X_EXPORT rdpPtr
 rdpGetDevFromScreen(ScreenPtr pScreen);
 
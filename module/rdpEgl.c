@@ -569,14 +569,14 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
     /* check crc list size */
     crc_stride = (id->width + 63) / 64;
     num_crcs = crc_stride * ((id->height + 63) / 64);
-    if (num_crcs != clientCon->num_rfx_crcs_alloc[mon_index])
+    if (num_crcs != clientCon->num_rfx_tile_hashes_alloc[mon_index])
     {
         LLOGLN(0, ("rdpEglOut: resize the crc list was %d now %d",
-               clientCon->num_rfx_crcs_alloc[mon_index], num_crcs));
+               clientCon->num_rfx_tile_hashes_alloc[mon_index], num_crcs));
         /* resize the crc list */
-        clientCon->num_rfx_crcs_alloc[mon_index] = num_crcs;
-        free(clientCon->rfx_crcs[mon_index]);
-        clientCon->rfx_crcs[mon_index] = g_new0(int, num_crcs);
+        clientCon->num_rfx_tile_hashes_alloc[mon_index] = num_crcs;
+        free(clientCon->rfx_tile_hashes[mon_index]);
+        clientCon->rfx_tile_hashes[mon_index] = g_new0(uint64_t, num_crcs);
     }
     tile_extents_stride = (tile_extents_rect->x2 - tile_extents_rect->x1) / 64;
     out_rect_index = 0;
@@ -621,7 +621,9 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
 #endif
                 crc = crcs[(ly / 64) * tile_extents_stride + (lx / 64)];
                 crc_offset = (y / 64) * crc_stride + (x / 64);
-                if (crc == clientCon->rfx_crcs[mon_index][crc_offset])
+                /* the gpu only does the 32 bit crc */
+                if ((uint32_t) crc ==
+                    clientCon->rfx_tile_hashes[mon_index][crc_offset])
                 {
                     LLOGLN(10, ("rdpEglOut: crc skip at x %d y %d", x, y));
                     rdpRegionInit(&tile_reg, &rect, 0);
@@ -632,7 +634,8 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
                 {
                     glReadPixels(lx, ly, 64, 64, GL_BGRA,
                                  GL_UNSIGNED_INT_8_8_8_8_REV, tile_dst);
-                    clientCon->rfx_crcs[mon_index][crc_offset] = crc;
+                    clientCon->rfx_tile_hashes[mon_index][crc_offset] =
+                        (uint32_t) crc;
                     out_rects[out_rect_index] = rect;
                     if (out_rect_index < RDP_MAX_TILES)
                     {
@@ -707,11 +710,7 @@ rdpEglCaptureRfx(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     {
         return FALSE;
     }
-    *out_rects = g_new(BoxRec, RDP_MAX_TILES);
-    if (*out_rects == NULL)
-    {
-        return FALSE;
-    }
+    *out_rects = rdpArenaNew(clientCon->cap_arena, BoxRec, RDP_MAX_TILES);
 
     rdpRegionTranslate(in_reg, -id->left, -id->top);
 
@@ -723,12 +722,8 @@ rdpEglCaptureRfx(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     width = tile_extents_rect.x2 - tile_extents_rect.x1;
     height = tile_extents_rect.y2 - tile_extents_rect.y1;
     LLOGLN(10, ("rdpEglCaptureRfx: width %d height %d", width, height));
-    crcs = g_new(int, (width / 64) * (height / 64));
-    if (crcs == NULL)
-    {
-        free(out_rects);
-        return FALSE;
-    }
+    crcs = rdpArenaNew(clientCon->cap_arena, int,
+                       (width / 64) * (height / 64));
     rfxGC = GetScratchGC(dev->depth, pScreen);
     if (rfxGC != NULL)
     {
@@ -792,6 +787,5 @@ rdpEglCaptureRfx(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     {
         LLOGLN(0, ("rdpEglCaptureRfx: GetScratchGC failed"));
     }
-    free(crcs);
     return TRUE;
 }
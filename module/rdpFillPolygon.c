@@ -104,6 +104,13 @@ rdpFillPolygon(DrawablePtr pDrawable, GCPtr pGC,
         box.x2 = pDrawable->x + maxx + 1;
         box.y2 = pDrawable->y + maxy + 1;
     }
+    if (rdpDrawBoxInClip(dev, &box, pDrawable, pGC))
+    {
+        /* do original call */
+        rdpFillPolygonOrg(pDrawable, pGC, shape, mode, count, pPts);
+        rdpClientConAddAllBox(dev, &box, pDrawable);
+        return;
+    }
     rdpRegionInit(&reg, &box, 0);
     rdpRegionInit(&clip_reg, NullBox, 0);
     cd = rdpDrawGetClip(dev, &clip_reg, pDrawable, pGC);
@@ -74,6 +74,13 @@ rdpImageGlyphBlt(DrawablePtr pDrawable, GCPtr pGC,
     dev = rdpGetDevFromScreen(pGC->pScreen);
     dev->counts.rdpImageGlyphBltCallCount++;
     GetTextBoundingBox(pDrawable, pGC->font, x, y, nglyph, &box);
+    if (rdpDrawBoxInClip(dev, &box, pDrawable, pGC))
+    {
+        /* do original call */
+        rdpImageGlyphBltOrg(pDrawable, pGC, x, y, nglyph, ppci, pglyphBase);
+        rdpClientConAddAllBox(dev, &box, pDrawable);
+        return;
+    }
     rdpRegionInit(&reg, &box, 0);
     rdpRegionInit(&clip_reg, NullBox, 0);
     cd = rdpDrawGetClip(dev, &clip_reg, pDrawable, pGC);
@@ -72,6 +72,13 @@ rdpImageText8(DrawablePtr pDrawable, GCPtr pGC,
     dev = rdpGetDevFromScreen(pGC->pScreen);
     dev->counts.rdpImageText8CallCount++;
     GetTextBoundingBox(pDrawable, pGC->font, x, y, count, &box);
+    if (rdpDrawBoxInClip(dev, &box, pDrawable, pGC))
+    {
+        /* do original call */
+        rdpImageText8Org(pDrawable, pGC, x, y, count, chars);
+        rdpClientConAddAllBox(dev, &box, pDrawable);
+        return;
+    }
     rdpRegionInit(&reg, &box, 0);
     rdpRegionInit(&clip_reg, NullBox, 0);
     cd = rdpDrawGetClip(dev, &clip_reg, pDrawable, pGC);
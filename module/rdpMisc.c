@@ -21,6 +21,11 @@ the rest
 
 */
 
+#if defined(__linux__)
+/* memfd_create */
+#define _GNU_SOURCE
+#endif
+
 #if defined(HAVE_CONFIG_H)
 #include "config_ac.h"
 #endif
@@ -135,6 +140,64 @@ crc_end(int crc)
     return crc;
 }
 
+#define HASH64_P1 0x9E3779B185EBCA87ULL
+#define HASH64_P2 0xC2B2AE3D27D4EB4FULL
+#define HASH64_P3 0x165667B19E3779F9ULL
+#define HASH64_ROTL(_val, _bits) (((_val) << (_bits)) | ((_val) >> (64 - (_bits))))
+#define HASH64_ROUND(_acc, _val) \
+    (_acc) = HASH64_ROTL((_acc) + (_val) * HASH64_P2, 31) * HASH64_P1
+
+/******************************************************************************/
+/* 64 bit non cryptographic hash, 4 lanes of 8 bytes like xxh64, not
+   compatible with it, pass 0 to start, the return can be passed back in
+   to hash more data */
+uint64_t
+tile_hash64(uint64_t hash, const void *data, int data_bytes)
+{
+    const uint8_t *data8;
+    uint64_t val[4];
+    uint64_t acc[4];
+
+    data8 = data;
+    acc[0] = hash + HASH64_P1 + HASH64_P2;
+    acc[1] = hash + HASH64_P2;
+    acc[2] = hash;
+    acc[3] = hash - HASH64_P1;
+    while (data_bytes >= 32)
+    {
+        memcpy(val, data8, 32);
+        HASH64_ROUND(acc[0], val[0]);
+        HASH64_ROUND(acc[1], val[1]);
+        HASH64_ROUND(acc[2], val[2]);
+        HASH64_ROUND(acc[3], val[3]);
+        data8 += 32;
+        data_bytes -= 32;
+    }
+    hash = HASH64_ROTL(acc[0], 1) + HASH64_ROTL(acc[1], 7) +
+           HASH64_ROTL(acc[2], 12) + HASH64_ROTL(acc[3], 18);
+    while (data_bytes >= 8)
+    {
+        memcpy(val, data8, 8);
+        hash ^= HASH64_ROTL(val[0] * HASH64_P2, 31) * HASH64_P1;
+        hash = HASH64_ROTL(hash, 27) * HASH64_P1 + HASH64_P3;
+        data8 += 8;
+        data_bytes -= 8;
+    }
+    while (data_bytes > 0)
+    {
+        hash ^= *data8 * HASH64_P3;
+        hash = HASH64_ROTL(hash, 11) * HASH64_P1;
+        data8++;
+        data_bytes--;
+    }
+    hash ^= hash >> 33;
+    hash *= HASH64_P2;
+    hash ^= hash >> 29;
+    hash *= HASH64_P3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
 /******************************************************************************/
 int
 rdpBitsPerPixel(int depth)
@@ -594,6 +657,40 @@ g_alloc_shm_map_fd(void **addr, int *fd, size_t size)
     return 0;
 }
 
+/******************************************************************************/
+/* like g_alloc_shm_map_fd but anonymous, falls back to g_alloc_shm_map_fd
+   if there is no memfd_create */
+int
+g_alloc_memfd_map_fd(void **addr, int *fd, size_t size)
+{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    int lfd;
+    void *laddr;
+
+    lfd = memfd_create("xorgxrdp", MFD_CLOEXEC);
+    if (lfd == -1)
+    {
+        return g_alloc_shm_map_fd(addr, fd, size);
+    }
+    if (ftruncate(lfd, size) == -1)
+    {
+        close(lfd);
+        return 2;
+    }
+    laddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, lfd, 0);
+    if (laddr == MAP_FAILED)
+    {
+        close(lfd);
+        return 3;
+    }
+    *addr = laddr;
+    *fd = lfd;
+    return 0;
+#else
+    return g_alloc_shm_map_fd(addr, fd, size);
+#endif
+}
+
 /******************************************************************************/
 int
 g_alloc_map_fd(void **addr, int *fd, size_t size)
@@ -634,3 +731,71 @@ g_free_unmap_fd(void *addr, int fd, size_t size)
     munmap(addr, size);
     close(fd);
 }
+
+/******************************************************************************/
+/* keeps the 16 byte alignment of malloc for everything handed out */
+#define RDP_ARENA_ALIGN(_bytes) (((_bytes) + 15) & ~((size_t) 15))
+
+struct rdp_arena_block
+{
+    struct rdp_arena_block *next;
+    uint8_t pad[16 - sizeof(void *)];
+};
+
+/******************************************************************************/
+void *
+rdpArenaAlloc(struct rdp_arena *arena, size_t bytes)
+{
+    struct rdp_arena_block *block;
+    void *rv;
+
+    bytes = RDP_ARENA_ALIGN(bytes == 0 ? 1 : bytes);
+    arena->need += bytes;
+    if (arena->used + bytes <= arena->size)
+    {
+        rv = arena->data + arena->used;
+        arena->used += bytes;
+        return rv;
+    }
+    block = (struct rdp_arena_block *)
+            xnfalloc(sizeof(struct rdp_arena_block) + bytes);
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->heap_allocs++;
+    return block + 1;
+}
+
+/******************************************************************************/
+void
+rdpArenaReset(struct rdp_arena *arena)
+{
+    struct rdp_arena_block *block;
+
+    while (arena->blocks != NULL)
+    {
+        block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+    if (arena->need > arena->size)
+    {
+        /* room for a quarter more than this time */
+        free(arena->data);
+        arena->size = RDP_ARENA_ALIGN(arena->need + arena->need / 4);
+        arena->data = g_new(uint8_t, arena->size);
+        arena->heap_allocs++;
+    }
+    arena->used = 0;
+    arena->need = 0;
+}
+
+/******************************************************************************/
+void
+rdpArenaDelete(struct rdp_arena *arena)
+{
+    arena->need = 0;
+    rdpArenaReset(arena);
+    free(arena->data);
+    arena->data = NULL;
+    arena->size = 0;
+}
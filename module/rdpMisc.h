@@ -46,6 +46,8 @@ extern _X_EXPORT int
 crc_process_data(int crc, const void *data, int data_bytes);
 extern _X_EXPORT int
 crc_end(int crc);
+extern _X_EXPORT uint64_t
+tile_hash64(uint64_t hash, const void *data, int data_bytes);
 
 extern _X_EXPORT int
 rdpBitsPerPixel(int depth);
@@ -103,6 +105,8 @@ g_sck_send_fd_set(int sck, const void *ptr, unsigned int len,
 extern _X_EXPORT int
 g_alloc_shm_map_fd(void **addr, int *fd, size_t size);
 extern _X_EXPORT int
+g_alloc_memfd_map_fd(void **addr, int *fd, size_t size);
+extern _X_EXPORT int
 g_alloc_map_fd(void **addr, int *fd, size_t size);
 extern _X_EXPORT void
 g_free_unmap_fd(void *addr, int fd, size_t size);
@@ -113,6 +117,35 @@ g_free_unmap_fd(void *addr, int fd, size_t size);
 #define g_new0(struct_type, n_structs) \
     (struct_type *) xnfcalloc((n_structs), sizeof(struct_type))
 
+struct rdp_arena_block;
+
+/* scratch memory handed out in order and all taken back by
+   rdpArenaReset, what did not fit goes on the heap until the reset,
+   which then grows the arena to fit it all next time */
+struct rdp_arena
+{
+    uint8_t *data;
+    size_t size;
+    size_t used;
+    size_t need; /* bytes asked for since the last reset */
+    struct rdp_arena_block *blocks; /* the ones on the heap */
+    int heap_allocs; /* for stats, whoever logs it zeros it */
+};
+
+extern _X_EXPORT void *
+rdpArenaAlloc(struct rdp_arena *arena, size_t bytes);
+extern _X_EXPORT void
+rdpArenaReset(struct rdp_arena *arena);
+extern _X_EXPORT void
+rdpArenaDelete(struct rdp_arena *arena);
+
+#define rdpArenaNew(arena, struct_type, n_structs) \
+    (struct_type *) rdpArenaAlloc((arena), \
+                                  sizeof(struct_type) * (n_structs))
+#define rdpArenaNew0(arena, struct_type, n_structs) \
+    (struct_type *) memset(rdpArenaNew(arena, struct_type, n_structs), 0, \
+                           sizeof(struct_type) * (n_structs))
+
 
 #if defined(X_BYTE_ORDER)
 #  if X_BYTE_ORDER == X_LITTLE_ENDIAN
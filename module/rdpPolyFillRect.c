@@ -66,10 +66,25 @@ rdpPolyFillRect(DrawablePtr pDrawable, GCPtr pGC, int nrectFill,
     RegionRec clip_reg;
     RegionPtr reg;
     int cd;
+    BoxRec box;
 
     LLOGLN(10, ("rdpPolyFillRect:"));
     dev = rdpGetDevFromScreen(pGC->pScreen);
     dev->counts.rdpPolyFillRectCallCount++;
+    if (nrectFill == 1)
+    {
+        box.x1 = prectInit->x + pDrawable->x;
+        box.y1 = prectInit->y + pDrawable->y;
+        box.x2 = box.x1 + prectInit->width;
+        box.y2 = box.y1 + prectInit->height;
+        if (rdpDrawBoxInClip(dev, &box, pDrawable, pGC))
+        {
+            /* do original call */
+            rdpPolyFillRectOrg(pDrawable, pGC, nrectFill, prectInit);
+            rdpClientConAddAllBox(dev, &box, pDrawable);
+            return;
+        }
+    }
     /* make a copy of rects */
     reg = rdpRegionFromRects(nrectFill, prectInit, CT_NONE);
     rdpRegionTranslate(reg, pDrawable->x, pDrawable->y);
@@ -75,6 +75,13 @@ rdpPolyText16(DrawablePtr pDrawable, GCPtr pGC,
     dev = rdpGetDevFromScreen(pGC->pScreen);
     dev->counts.rdpPolyText16CallCount++;
     GetTextBoundingBox(pDrawable, pGC->font, x, y, count, &box);
+    if (rdpDrawBoxInClip(dev, &box, pDrawable, pGC))
+    {
+        /* do original call */
+        rv = rdpPolyText16Org(pDrawable, pGC, x, y, count, chars);
+        rdpClientConAddAllBox(dev, &box, pDrawable);
+        return rv;
+    }
     rdpRegionInit(&reg, &box, 0);
     rdpRegionInit(&clip_reg, NullBox, 0);
     cd = rdpDrawGetClip(dev, &clip_reg, pDrawable, pGC);
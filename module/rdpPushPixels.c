@@ -37,6 +37,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "rdp.h"
 #include "rdpDraw.h"
+#include "rdpClientCon.h"
+#include "rdpReg.h"
 #include "rdpPushPixels.h"
 
 #define LOG_LEVEL 1
@@ -60,7 +62,44 @@ void
 rdpPushPixels(GCPtr pGC, PixmapPtr pBitMap, DrawablePtr pDst,
               int w, int h, int x, int y)
 {
-    LLOGLN(0, ("rdpPushPixels:"));
+    rdpPtr dev;
+    RegionRec clip_reg;
+    RegionRec reg;
+    int cd;
+    BoxRec box;
+
+    LLOGLN(10, ("rdpPushPixels:"));
+    dev = rdpGetDevFromScreen(pGC->pScreen);
+    box.x1 = x;
+    box.y1 = y;
+    if (!pGC->miTranslate)
+    {
+        box.x1 += pDst->x;
+        box.y1 += pDst->y;
+    }
+    box.x2 = box.x1 + w;
+    box.y2 = box.y1 + h;
+    if (rdpDrawBoxInClip(dev, &box, pDst, pGC))
+    {
+        /* do original call */
+        rdpPushPixelsOrg(pGC, pBitMap, pDst, w, h, x, y);
+        rdpClientConAddAllBox(dev, &box, pDst);
+        return;
+    }
+    rdpRegionInit(&reg, &box, 0);
+    rdpRegionInit(&clip_reg, NullBox, 0);
+    cd = rdpDrawGetClip(dev, &clip_reg, pDst, pGC);
+    LLOGLN(10, ("rdpPushPixels: cd %d", cd));
+    if (cd == XRDP_CD_CLIP)
+    {
+        rdpRegionIntersect(&reg, &clip_reg, &reg);
+    }
     /* do original call */
     rdpPushPixelsOrg(pGC, pBitMap, pDst, w, h, x, y);
+    if (cd != XRDP_CD_NODRAW)
+    {
+        rdpClientConAddAllReg(dev, &reg, pDst);
+    }
+    rdpRegionUninit(&clip_reg);
+    rdpRegionUninit(&reg);
 }
@@ -76,6 +76,13 @@ rdpPutImage(DrawablePtr pDst, GCPtr pGC, int depth, int x, int y,
     box.y1 = y + pDst->y;
     box.x2 = box.x1 + w;
     box.y2 = box.y1 + h;
+    if (rdpDrawBoxInClip(dev, &box, pDst, pGC))
+    {
+        /* do original call */
+        rdpPutImageOrg(pDst, pGC, depth, x, y, w, h, leftPad, format, pBits);
+        rdpClientConAddAllBox(dev, &box, pDst);
+        return;
+    }
     rdpRegionInit(&reg, &box, 0);
     rdpRegionInit(&clip_reg, NullBox, 0);
     cd = rdpDrawGetClip(dev, &clip_reg, pDst, pGC);
@@ -53,6 +53,7 @@ miRegionCreate    ->      RegionCreate
 miUnion           ->      RegionUnion
 miRegionExtents   ->      RegionExtents
 miRegionReset     ->      RegionReset
+miRegionEmpty     ->      RegionEmpty
 miRegionBreak     ->      RegionBreak
 */
 
@@ -229,6 +230,17 @@ rdpRegionReset(RegionPtr pReg, BoxPtr pBox)
 #endif
 }
 
+/*****************************************************************************/
+void
+rdpRegionEmpty(RegionPtr pReg)
+{
+#if XRDP_REG == 1
+    miRegionEmpty(pReg);
+#else
+    RegionEmpty(pReg);
+#endif
+}
+
 /*****************************************************************************/
 Bool
 rdpRegionBreak(RegionPtr pReg)
@@ -58,6 +58,8 @@ extern _X_EXPORT BoxPtr
 rdpRegionExtents(RegionPtr pReg);
 extern _X_EXPORT void
 rdpRegionReset(RegionPtr pReg, BoxPtr pBox);
+extern _X_EXPORT void
+rdpRegionEmpty(RegionPtr pReg);
 extern _X_EXPORT Bool
 rdpRegionBreak(RegionPtr pReg);
 extern _X_EXPORT void
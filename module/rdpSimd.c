@@ -28,6 +28,8 @@ SIMD function assigning
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 /* this should be before all X11 .h files */
 #include <xorg-server.h>
@@ -39,6 +41,7 @@ SIMD function assigning
 
 #include "rdp.h"
 #include "rdpXv.h"
+#include "rdpMisc.h"
 #include "rdpCapture.h"
 #include "rdpSimd.h"
 
@@ -62,11 +65,250 @@ int g_simd_use_accel = 1;
 #define LLOGLN(_level, _args) \
     do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
 
+/* sizes rdpSimdTimeNT tries, and how much slower, in percent, the non
+   temporal copy can be on its own, what it saves is cache for the X server
+   and the other sessions on the socket, the benchmark can not see that
+   the rects are 1920 pixels wide in a 4096 pixel wide framebuffer */
+#define RDP_NT_TUNE_MIN_BYTES (256 * 1024)
+#define RDP_NT_TUNE_MAX_BYTES (8 * 1024 * 1024)
+#define RDP_NT_TUNE_SLACK 125
+#define RDP_NT_TUNE_ROW_BYTES (1920 * 4)
+#define RDP_NT_TUNE_STRIDE (4096 * 4)
+
+/* CaptureNTBytes "auto" is timed once, off the X server thread, see
+   rdpSimdTuneNT */
+static pthread_once_t g_nt_tune_once = PTHREAD_ONCE_INIT;
+static rdpPtr g_nt_tune_dev = NULL;
+static int g_nt_tuned_bytes = -1;
+static int g_nt_tune_logged = 0;
+
+/*****************************************************************************/
+/* returns -1 if level is not known */
+int
+rdpSimdLevelFromString(const char *level)
+{
+    if ((strcmp(level, "avx512") == 0) || (strcmp(level, "AVX512") == 0))
+    {
+        return RDP_SIMD_AVX512;
+    }
+    if ((strcmp(level, "avx2") == 0) || (strcmp(level, "AVX2") == 0))
+    {
+        return RDP_SIMD_AVX2;
+    }
+    if ((strcmp(level, "sse2") == 0) || (strcmp(level, "SSE2") == 0))
+    {
+        return RDP_SIMD_SSE2;
+    }
+    if ((strcmp(level, "none") == 0) || (strcmp(level, "NONE") == 0))
+    {
+        return RDP_SIMD_NONE;
+    }
+    return -1;
+}
+
+/*****************************************************************************/
+const char *
+rdpSimdLevelToString(int level)
+{
+    switch (level)
+    {
+        case RDP_SIMD_AVX512:
+            return "avx512";
+        case RDP_SIMD_AVX2:
+            return "avx2";
+        case RDP_SIMD_SSE2:
+            return "sse2";
+    }
+    return "none";
+}
+
+#if SIMD_USE_ACCEL
+/*****************************************************************************/
+/* highest tier the cpu and os support, sse42 is set if the crc32
+   instruction is there */
+static int
+rdpSimdGetCpuLevel(int *sse42)
+{
+    int level;
+    int ax, bx, cx, dx;
+#if defined(__x86_64__) || defined(__AMD64__) || defined (_M_AMD64)
+    int max_leaf;
+    int xcr0_lo, xcr0_hi;
+#endif
+
+    level = RDP_SIMD_NONE;
+    *sse42 = 0;
+#if defined(__x86_64__) || defined(__AMD64__) || defined (_M_AMD64)
+    cpuid_amd64(0, 0, &ax, &bx, &cx, &dx);
+    max_leaf = ax;
+    cpuid_amd64(1, 0, &ax, &bx, &cx, &dx);
+    LLOGLN(0, ("rdpSimdGetCpuLevel: cpuid ax 1 cx 0 return ax 0x%8.8x bx "
+           "0x%8.8x cx 0x%8.8x dx 0x%8.8x", ax, bx, cx, dx));
+    if (dx & (1 << 26)) /* SSE 2 */
+    {
+        level = RDP_SIMD_SSE2;
+    }
+    if (cx & (1 << 20)) /* SSE 4.2 */
+    {
+        *sse42 = 1;
+    }
+    /* AVX state needs OSXSAVE and the os saving xmm and ymm, XCR0 bits 1, 2 */
+    if ((cx & (1 << 27)) && (cx & (1 << 28)) && (max_leaf >= 7))
+    {
+        xgetbv_amd64(0, &xcr0_lo, &xcr0_hi);
+        cpuid_amd64(7, 0, &ax, &bx, &cx, &dx);
+        LLOGLN(0, ("rdpSimdGetCpuLevel: cpuid ax 7 cx 0 return ax 0x%8.8x bx "
+               "0x%8.8x cx 0x%8.8x dx 0x%8.8x xcr0 0x%8.8x",
+               ax, bx, cx, dx, xcr0_lo));
+        if (((xcr0_lo & 0x06) == 0x06) && (bx & (1 << 5))) /* AVX2 */
+        {
+            level = RDP_SIMD_AVX2;
+            /* AVX-512 F and BW, os saves opmask and zmm, XCR0 bits 5, 6, 7 */
+            if (((xcr0_lo & 0xE6) == 0xE6) &&
+                (bx & (1 << 16)) && (bx & (1 << 30)))
+            {
+                level = RDP_SIMD_AVX512;
+            }
+        }
+    }
+#elif defined(__x86__) || defined(_M_IX86) || defined(__i386__)
+    /* only SSE2 kernels for x86 */
+    cpuid_x86(1, 0, &ax, &bx, &cx, &dx);
+    LLOGLN(0, ("rdpSimdGetCpuLevel: cpuid ax 1 cx 0 return ax 0x%8.8x bx "
+           "0x%8.8x cx 0x%8.8x dx 0x%8.8x", ax, bx, cx, dx));
+    if (dx & (1 << 26)) /* SSE 2 */
+    {
+        level = RDP_SIMD_SSE2;
+    }
+    if (cx & (1 << 20)) /* SSE 4.2 */
+    {
+        *sse42 = 1;
+    }
+#endif
+    return level;
+}
+#endif
+
+/*****************************************************************************/
+static uint64_t
+rdpSimdGetTimeNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/*****************************************************************************/
+/* times rows copied with g_memcpy, like rdpCopyBox_a8r8g8b8_to_a8r8g8b8,
+   and a8r8g8b8_to_a8r8g8b8_box_nt on growing rects, the rects are
+   narrower than the stride as damage is
+   returns the smallest size where the non temporal copy is within
+   RDP_NT_TUNE_SLACK, 0 if there is none */
+static int
+rdpSimdTimeNT(rdpPtr dev)
+{
+    uint8_t *src;
+    uint8_t *dst;
+    uint64_t start;
+    uint64_t cached_ns;
+    uint64_t nt_ns;
+    int alloc_bytes;
+    int bytes;
+    int lines;
+    int reps;
+    int index;
+    int jndex;
+    int rv;
+
+    alloc_bytes = RDP_NT_TUNE_MAX_BYTES / RDP_NT_TUNE_ROW_BYTES *
+                  RDP_NT_TUNE_STRIDE;
+    src = g_new0(uint8_t, alloc_bytes);
+    dst = g_new0(uint8_t, alloc_bytes);
+    rv = 0;
+    for (bytes = RDP_NT_TUNE_MIN_BYTES; bytes <= RDP_NT_TUNE_MAX_BYTES;
+         bytes *= 2)
+    {
+        lines = bytes / RDP_NT_TUNE_ROW_BYTES;
+        reps = RDP_NT_TUNE_MAX_BYTES * 2 / bytes;
+        start = rdpSimdGetTimeNs();
+        for (index = 0; index < reps; index++)
+        {
+            for (jndex = 0; jndex < lines; jndex++)
+            {
+                g_memcpy(dst + jndex * RDP_NT_TUNE_STRIDE,
+                         src + jndex * RDP_NT_TUNE_STRIDE,
+                         RDP_NT_TUNE_ROW_BYTES);
+            }
+        }
+        cached_ns = rdpSimdGetTimeNs() - start;
+        start = rdpSimdGetTimeNs();
+        for (index = 0; index < reps; index++)
+        {
+            dev->a8r8g8b8_to_a8r8g8b8_box_nt(src, RDP_NT_TUNE_STRIDE,
+                                             dst, RDP_NT_TUNE_STRIDE,
+                                             RDP_NT_TUNE_ROW_BYTES / 4,
+                                             lines);
+        }
+        nt_ns = rdpSimdGetTimeNs() - start;
+        if (nt_ns * 100 <= cached_ns * RDP_NT_TUNE_SLACK)
+        {
+            rv = bytes;
+            break;
+        }
+    }
+    free(src);
+    free(dst);
+    return rv;
+}
+
+/*****************************************************************************/
+static void
+rdpSimdTuneNTOnce(void)
+{
+    rdpPtr dev;
+
+    dev = g_nt_tune_dev;
+    if ((dev != NULL) && (dev->capture_nt_bytes < 0))
+    {
+        g_nt_tuned_bytes = rdpSimdTimeNT(dev);
+        dev->capture_nt_bytes = g_nt_tuned_bytes;
+    }
+}
+
+/*****************************************************************************/
+/* CaptureNTBytes "auto", each capture thread calls this before its first
+   capture, the first one times the copies, the others wait for it, the
+   X server thread is not held up and the result is kept for the next
+   server generation
+   no logging here, see rdpSimdTuneNTLog */
+void
+rdpSimdTuneNT(void)
+{
+    pthread_once(&g_nt_tune_once, rdpSimdTuneNTOnce);
+}
+
+/*****************************************************************************/
+/* X server thread, after a capture from a capture thread, logs what
+   rdpSimdTuneNT found, once */
+void
+rdpSimdTuneNTLog(void)
+{
+    if (!g_nt_tune_logged && (g_nt_tuned_bytes >= 0))
+    {
+        g_nt_tune_logged = 1;
+        LLOGLN(0, ("rdpSimdTuneNTLog: non temporal copies from %d bytes, "
+               "0 is never", g_nt_tuned_bytes));
+    }
+}
+
 /*****************************************************************************/
 Bool
 rdpSimdInit(ScreenPtr pScreen, ScrnInfoPtr pScrn)
 {
     rdpPtr dev;
+    int level;
+    int sse42;
 
     dev = XRDPPTR(pScrn);
     /* assign functions */
@@ -76,43 +318,103 @@ rdpSimdInit(ScreenPtr pScreen, ScrnInfoPtr pScrn)
     dev->yuy2_to_rgb32 = YUY2_to_RGB32;
     dev->uyvy_to_rgb32 = UYVY_to_RGB32;
     dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box;
+    dev->a8r8g8b8_to_a8r8g8b8_box_nt = NULL;
     dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box;
+    dev->a8r8g8b8_to_avc444_box = a8r8g8b8_to_avc444_box;
+    dev->a8r8g8b8_to_yuvalp_box = a8r8g8b8_to_yuvalp_box;
+    dev->a8r8g8b8_to_r5g6b5_box = a8r8g8b8_to_r5g6b5_box;
+    dev->a8r8g8b8_to_a1r5g5b5_box = a8r8g8b8_to_a1r5g5b5_box;
+    dev->a8r8g8b8_to_r3g3b2_box = a8r8g8b8_to_r3g3b2_box;
+    dev->tile_hash = tile_hash64;
+    level = RDP_SIMD_NONE;
+    sse42 = 0;
 #if SIMD_USE_ACCEL
     if (g_simd_use_accel)
     {
+        level = rdpSimdGetCpuLevel(&sse42);
+        LLOGLN(0, ("rdpSimdInit: cpu supports %s, xorg.conf allows %s",
+               rdpSimdLevelToString(level),
+               rdpSimdLevelToString(dev->simd_level_max)));
+        level = RDPMIN(level, dev->simd_level_max);
 #if defined(__x86_64__) || defined(__AMD64__) || defined (_M_AMD64)
-        int ax, bx, cx, dx;
-        cpuid_amd64(1, 0, &ax, &bx, &cx, &dx);
-        LLOGLN(0, ("rdpSimdInit: cpuid ax 1 cx 0 return ax 0x%8.8x bx "
-               "0x%8.8x cx 0x%8.8x dx 0x%8.8x", ax, bx, cx, dx));
-        if (dx & (1 << 26)) /* SSE 2 */
+        if (level >= RDP_SIMD_SSE2)
         {
             dev->yv12_to_rgb32 = yv12_to_rgb32_amd64_sse2;
             dev->i420_to_rgb32 = i420_to_rgb32_amd64_sse2;
             dev->yuy2_to_rgb32 = yuy2_to_rgb32_amd64_sse2;
             dev->uyvy_to_rgb32 = uyvy_to_rgb32_amd64_sse2;
             dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box_amd64_sse2;
+            dev->a8r8g8b8_to_a8r8g8b8_box_nt = a8r8g8b8_to_a8r8g8b8_box_nt_amd64_sse2;
             dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box_amd64_sse2;
+            dev->a8r8g8b8_to_avc444_box = a8r8g8b8_to_avc444_box_amd64_sse2;
+            dev->a8r8g8b8_to_yuvalp_box = a8r8g8b8_to_yuvalp_box_amd64_sse2;
+            dev->a8r8g8b8_to_r5g6b5_box = a8r8g8b8_to_r5g6b5_box_amd64_sse2;
+            dev->a8r8g8b8_to_a1r5g5b5_box = a8r8g8b8_to_a1r5g5b5_box_amd64_sse2;
+            dev->a8r8g8b8_to_r3g3b2_box = a8r8g8b8_to_r3g3b2_box_amd64_sse2;
             LLOGLN(0, ("rdpSimdInit: sse2 amd64 yuv functions assigned"));
         }
+        if (level >= RDP_SIMD_AVX2)
+        {
+            dev->yv12_to_rgb32 = yv12_to_rgb32_amd64_avx2;
+            dev->i420_to_rgb32 = i420_to_rgb32_amd64_avx2;
+            dev->yuy2_to_rgb32 = yuy2_to_rgb32_amd64_avx2;
+            dev->uyvy_to_rgb32 = uyvy_to_rgb32_amd64_avx2;
+            dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box_amd64_avx2;
+            dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box_amd64_avx2;
+            dev->a8r8g8b8_to_avc444_box = a8r8g8b8_to_avc444_box_amd64_avx2;
+            dev->a8r8g8b8_to_yuvalp_box = a8r8g8b8_to_yuvalp_box_amd64_avx2;
+            LLOGLN(0, ("rdpSimdInit: avx2 amd64 yuv functions assigned"));
+        }
+        if (level >= RDP_SIMD_AVX512)
+        {
+            /* the yuv to rgb32 ones are Xv only, avx2 is plenty there */
+            dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box_amd64_avx512;
+            dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box_amd64_avx512;
+            LLOGLN(0, ("rdpSimdInit: avx512 amd64 yuv functions assigned"));
+        }
+        if (sse42 && (dev->simd_level_max > RDP_SIMD_NONE))
+        {
+            dev->tile_hash = tile_hash_crc32c_amd64_sse42;
+            LLOGLN(0, ("rdpSimdInit: sse4.2 amd64 tile hash assigned"));
+        }
 #elif defined(__x86__) || defined(_M_IX86) || defined(__i386__)
-        int ax, bx, cx, dx;
-        cpuid_x86(1, 0, &ax, &bx, &cx, &dx);
-        LLOGLN(0, ("rdpSimdInit: cpuid ax 1 cx 0 return ax 0x%8.8x bx "
-               "0x%8.8x cx 0x%8.8x dx 0x%8.8x", ax, bx, cx, dx));
-        if (dx & (1 << 26)) /* SSE 2 */
+        if (level >= RDP_SIMD_SSE2)
         {
             dev->yv12_to_rgb32 = yv12_to_rgb32_x86_sse2;
             dev->i420_to_rgb32 = i420_to_rgb32_x86_sse2;
             dev->yuy2_to_rgb32 = yuy2_to_rgb32_x86_sse2;
             dev->uyvy_to_rgb32 = uyvy_to_rgb32_x86_sse2;
             dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box_x86_sse2;
+            dev->a8r8g8b8_to_a8r8g8b8_box_nt = a8r8g8b8_to_a8r8g8b8_box_nt_x86_sse2;
             dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box_x86_sse2;
+            dev->a8r8g8b8_to_avc444_box = a8r8g8b8_to_avc444_box_x86_sse2;
+            dev->a8r8g8b8_to_yuvalp_box = a8r8g8b8_to_yuvalp_box_x86_sse2;
+            dev->a8r8g8b8_to_r5g6b5_box = a8r8g8b8_to_r5g6b5_box_x86_sse2;
+            dev->a8r8g8b8_to_a1r5g5b5_box = a8r8g8b8_to_a1r5g5b5_box_x86_sse2;
+            dev->a8r8g8b8_to_r3g3b2_box = a8r8g8b8_to_r3g3b2_box_x86_sse2;
             LLOGLN(0, ("rdpSimdInit: sse2 x86 yuv functions assigned"));
         }
+        if (sse42 && (dev->simd_level_max > RDP_SIMD_NONE))
+        {
+            dev->tile_hash = tile_hash_crc32c_x86_sse42;
+            LLOGLN(0, ("rdpSimdInit: sse4.2 x86 tile hash assigned"));
+        }
 #endif
     }
 #endif
+    dev->simd_level = level;
+    if (dev->a8r8g8b8_to_a8r8g8b8_box_nt == NULL)
+    {
+        dev->capture_nt_bytes = 0;
+    }
+    else if (dev->capture_nt_bytes < 0)
+    {
+        /* timed by the first capture thread, until then no non temporal
+           copies, without a capture thread none at all */
+        dev->capture_nt_bytes = g_nt_tuned_bytes;
+        g_nt_tune_dev = dev;
+    }
+    LLOGLN(0, ("rdpSimdInit: non temporal copies from %d bytes, 0 is never, "
+           "-1 is not timed yet", dev->capture_nt_bytes));
     return 1;
 }
-
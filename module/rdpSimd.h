@@ -28,7 +28,21 @@ SIMD function assigning
 #include <xorgVersion.h>
 #include <xf86.h>
 
+/* tiers, each one includes the ones below it */
+#define RDP_SIMD_NONE   0
+#define RDP_SIMD_SSE2   1
+#define RDP_SIMD_AVX2   2
+#define RDP_SIMD_AVX512 3
+
+extern _X_EXPORT int
+rdpSimdLevelFromString(const char *level);
+extern _X_EXPORT const char *
+rdpSimdLevelToString(int level);
 extern _X_EXPORT Bool
 rdpSimdInit(ScreenPtr pScreen, ScrnInfoPtr pScrn);
+extern _X_EXPORT void
+rdpSimdTuneNT(void);
+extern _X_EXPORT void
+rdpSimdTuneNTLog(void);
 
 #endif
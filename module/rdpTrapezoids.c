@@ -94,3 +94,65 @@ rdpTrapezoids(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
     rdpClientConAddAllReg(dev, &reg, pDst->pDrawable);
     rdpRegionUninit(&reg);
 }
+
+/******************************************************************************/
+static void
+rdpAddTrapsOrg(PictureScreenPtr ps, rdpPtr dev, PicturePtr pPicture,
+               INT16 xOff, INT16 yOff, int ntrap, xTrap *traps)
+{
+    ps->AddTraps = dev->AddTraps;
+    ps->AddTraps(pPicture, xOff, yOff, ntrap, traps);
+    ps->AddTraps = rdpAddTraps;
+}
+
+/******************************************************************************/
+/* fb draws these itself, no Composite call the wrappers see */
+void
+rdpAddTraps(PicturePtr pPicture, INT16 xOff, INT16 yOff, int ntrap,
+            xTrap *traps)
+{
+    ScreenPtr pScreen;
+    rdpPtr dev;
+    PictureScreenPtr ps;
+    BoxRec box;
+    RegionRec reg;
+    int index;
+    int x1;
+    int x2;
+
+    LLOGLN(10, ("rdpAddTraps:"));
+    pScreen = pPicture->pDrawable->pScreen;
+    dev = rdpGetDevFromScreen(pScreen);
+    ps = GetPictureScreen(pScreen);
+    if (ntrap < 1)
+    {
+        rdpAddTrapsOrg(ps, dev, pPicture, xOff, yOff, ntrap, traps);
+        return;
+    }
+    box.x1 = 32767;
+    box.y1 = 32767;
+    box.x2 = -32767;
+    box.y2 = -32767;
+    for (index = 0; index < ntrap; index++)
+    {
+        x1 = RDPMIN(traps[index].top.l, traps[index].bot.l) >> 16;
+        x2 = (RDPMAX(traps[index].top.r, traps[index].bot.r) + 0xFFFF) >> 16;
+        box.x1 = RDPMIN(box.x1, x1);
+        box.x2 = RDPMAX(box.x2, x2);
+        box.y1 = RDPMIN(box.y1, traps[index].top.y >> 16);
+        box.y2 = RDPMAX(box.y2, (traps[index].bot.y + 0xFFFF) >> 16);
+    }
+    box.x1 += xOff + pPicture->pDrawable->x;
+    box.y1 += yOff + pPicture->pDrawable->y;
+    box.x2 += xOff + pPicture->pDrawable->x;
+    box.y2 += yOff + pPicture->pDrawable->y;
+    rdpRegionInit(&reg, &box, 0);
+    if (pPicture->pCompositeClip != NULL)
+    {
+        rdpRegionIntersect(&reg, pPicture->pCompositeClip, &reg);
+    }
+    /* do original call */
+    rdpAddTrapsOrg(ps, dev, pPicture, xOff, yOff, ntrap, traps);
+    rdpClientConAddAllReg(dev, &reg, pPicture->pDrawable);
+    rdpRegionUninit(&reg);
+}
@@ -30,5 +30,8 @@ extern _X_EXPORT void
 rdpTrapezoids(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
               PictFormatPtr maskFormat, INT16 xSrc, INT16 ySrc,
               int ntrap, xTrapezoid *traps);
+extern _X_EXPORT void
+rdpAddTraps(PicturePtr pPicture, INT16 xOff, INT16 yOff, int ntrap,
+            xTrap *traps);
 
 #endif
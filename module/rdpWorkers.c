@@ -0,0 +1,353 @@
+/*
+Copyright 2026 The xorgxrdp project
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+worker threads for capture
+
+the X server thread posts a job, a proc and a count of items, wakes the
+workers and runs items itself until they are all taken, then waits for
+the workers to finish theirs
+
+*/
+
+#if defined(__linux__)
+/* sched_getcpu, pthread_setaffinity_np */
+#define _GNU_SOURCE
+#endif
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include "rdp.h"
+#include "rdpMisc.h"
+#include "rdpWorkers.h"
+
+#define LOG_LEVEL 1
+#define LLOGLN(_level, _args) \
+    do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
+
+/* when num_threads is 0 */
+#define RDP_WORKERS_AUTO_MAX 4
+
+struct rdp_workers
+{
+    int num_threads; /* not counting the X server thread */
+    pthread_t *threads;
+    pthread_mutex_t run_mutex; /* one job at a time */
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond; /* new job posted or shutdown */
+    pthread_cond_t done_cond; /* last worker done with the job */
+    int generation; /* bumped for each job */
+    int busy; /* workers not done with the current job */
+    int shutdown;
+    /* current job */
+    rdp_work_proc proc;
+    void *arg;
+    int num_items;
+    int next_item; /* atomic */
+};
+
+/*****************************************************************************/
+static void
+rdpWorkersRunItems(struct rdp_workers *workers)
+{
+    int index;
+
+    for (;;)
+    {
+        index = __sync_fetch_and_add(&(workers->next_item), 1);
+        if (index >= workers->num_items)
+        {
+            break;
+        }
+        workers->proc(workers->arg, index);
+    }
+}
+
+/*****************************************************************************/
+static void *
+rdpWorkersThread(void *arg)
+{
+    struct rdp_workers *workers;
+    int generation;
+
+    workers = (struct rdp_workers *) arg;
+    generation = 0;
+    pthread_mutex_lock(&(workers->mutex));
+    for (;;)
+    {
+        while (!workers->shutdown && (workers->generation == generation))
+        {
+            pthread_cond_wait(&(workers->work_cond), &(workers->mutex));
+        }
+        if (workers->shutdown)
+        {
+            break;
+        }
+        generation = workers->generation;
+        pthread_mutex_unlock(&(workers->mutex));
+        rdpWorkersRunItems(workers);
+        pthread_mutex_lock(&(workers->mutex));
+        workers->busy--;
+        if (workers->busy == 0)
+        {
+            pthread_cond_signal(&(workers->done_cond));
+        }
+    }
+    pthread_mutex_unlock(&(workers->mutex));
+    return NULL;
+}
+
+#if defined(__linux__)
+/*****************************************************************************/
+/* the cpus of the numa node the calling thread is on
+   returns the number of cpus, 0 if it can not tell */
+static int
+rdpWorkersGetNodeCpus(cpu_set_t *cpus)
+{
+    char path[256];
+    char text[1024];
+    char *ptext;
+    char *endptr;
+    FILE *file;
+    int cpu;
+    int node;
+    int first;
+    int last;
+
+    CPU_ZERO(cpus);
+    cpu = sched_getcpu();
+    if (cpu < 0)
+    {
+        return 0;
+    }
+    for (node = 0; node < 1024; node++)
+    {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0)
+        {
+            break;
+        }
+    }
+    if (node >= 1024)
+    {
+        return 0;
+    }
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/node/node%d/cpulist", node);
+    file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    ptext = fgets(text, sizeof(text), file);
+    fclose(file);
+    if (ptext == NULL)
+    {
+        return 0;
+    }
+    /* like 0-7,16-23 */
+    while (*ptext >= '0' && *ptext <= '9')
+    {
+        first = strtol(ptext, &endptr, 10);
+        last = first;
+        ptext = endptr;
+        if (*ptext == '-')
+        {
+            last = strtol(ptext + 1, &endptr, 10);
+            ptext = endptr;
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++)
+        {
+            CPU_SET(first, cpus);
+        }
+        if (*ptext == ',')
+        {
+            ptext++;
+        }
+    }
+    LLOGLN(0, ("rdpWorkersGetNodeCpus: cpu %d is on node %d with %d cpus",
+           cpu, node, CPU_COUNT(cpus)));
+    return CPU_COUNT(cpus);
+}
+#endif
+
+/*****************************************************************************/
+struct rdp_workers *
+rdpWorkersCreate(int num_threads, int numa)
+{
+    struct rdp_workers *workers;
+    sigset_t new_mask;
+    sigset_t old_mask;
+    int num_cpus;
+    int index;
+#if defined(__linux__)
+    cpu_set_t cpus;
+    int num_node_cpus;
+#endif
+
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#if defined(__linux__)
+    num_node_cpus = 0;
+    if (numa)
+    {
+        num_node_cpus = rdpWorkersGetNodeCpus(&cpus);
+        if (num_node_cpus > 0)
+        {
+            num_cpus = num_node_cpus;
+        }
+    }
+#endif
+    if (num_threads < 1)
+    {
+        num_threads = RDPCLAMP(num_cpus, 1, RDP_WORKERS_AUTO_MAX);
+    }
+    LLOGLN(0, ("rdpWorkersCreate: %d cpus, using %d capture threads",
+           num_cpus, num_threads));
+    if (num_threads < 2)
+    {
+        return NULL;
+    }
+    workers = g_new0(struct rdp_workers, 1);
+    workers->threads = g_new0(pthread_t, num_threads - 1);
+    pthread_mutex_init(&(workers->run_mutex), NULL);
+    pthread_mutex_init(&(workers->mutex), NULL);
+    pthread_cond_init(&(workers->work_cond), NULL);
+    pthread_cond_init(&(workers->done_cond), NULL);
+    /* signals go to the X server thread, the threads get this mask */
+    sigfillset(&new_mask);
+    pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
+    for (index = 0; index < num_threads - 1; index++)
+    {
+        if (pthread_create(workers->threads + index, NULL,
+                           rdpWorkersThread, workers) != 0)
+        {
+            LLOGLN(0, ("rdpWorkersCreate: pthread_create failed"));
+            break;
+        }
+#if defined(__linux__)
+        if (num_node_cpus > 0)
+        {
+            pthread_setaffinity_np(workers->threads[index],
+                                   sizeof(cpus), &cpus);
+        }
+#endif
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    workers->num_threads = index;
+    if (workers->num_threads < 1)
+    {
+        rdpWorkersDelete(workers);
+        return NULL;
+    }
+    return workers;
+}
+
+/*****************************************************************************/
+void
+rdpWorkersDelete(struct rdp_workers *workers)
+{
+    int index;
+
+    if (workers == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&(workers->mutex));
+    workers->shutdown = 1;
+    pthread_cond_broadcast(&(workers->work_cond));
+    pthread_mutex_unlock(&(workers->mutex));
+    for (index = 0; index < workers->num_threads; index++)
+    {
+        pthread_join(workers->threads[index], NULL);
+    }
+    pthread_cond_destroy(&(workers->done_cond));
+    pthread_cond_destroy(&(workers->work_cond));
+    pthread_mutex_destroy(&(workers->mutex));
+    pthread_mutex_destroy(&(workers->run_mutex));
+    free(workers->threads);
+    free(workers);
+}
+
+/*****************************************************************************/
+int
+rdpWorkersGetCount(struct rdp_workers *workers)
+{
+    if (workers == NULL)
+    {
+        return 1;
+    }
+    return workers->num_threads + 1;
+}
+
+/*****************************************************************************/
+int
+rdpWorkersRun(struct rdp_workers *workers, rdp_work_proc proc, void *arg,
+              int num_items)
+{
+    int index;
+
+    if ((workers == NULL) || (num_items < 2))
+    {
+        for (index = 0; index < num_items; index++)
+        {
+            proc(arg, index);
+        }
+        return 0;
+    }
+    /* each client's capture thread can call this */
+    pthread_mutex_lock(&(workers->run_mutex));
+    pthread_mutex_lock(&(workers->mutex));
+    workers->proc = proc;
+    workers->arg = arg;
+    workers->num_items = num_items;
+    workers->next_item = 0;
+    workers->busy = workers->num_threads;
+    workers->generation++;
+    pthread_cond_broadcast(&(workers->work_cond));
+    pthread_mutex_unlock(&(workers->mutex));
+    rdpWorkersRunItems(workers);
+    pthread_mutex_lock(&(workers->mutex));
+    while (workers->busy > 0)
+    {
+        pthread_cond_wait(&(workers->done_cond), &(workers->mutex));
+    }
+    pthread_mutex_unlock(&(workers->mutex));
+    pthread_mutex_unlock(&(workers->run_mutex));
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+Copyright 2026 The xorgxrdp project
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+worker threads for capture
+
+*/
+
+#ifndef __RDPWORKERS_H
+#define __RDPWORKERS_H
+
+#include <xorg-server.h>
+#include <xorgVersion.h>
+#include <xf86.h>
+
+struct rdp_workers;
+
+/* called once for each index in 0 .. num_items - 1, from any thread
+   no X server calls, no allocs from the X server pools, no logging */
+typedef void (*rdp_work_proc)(void *arg, int index);
+
+/* num_threads counts the X server thread, 0 means pick from the cpu
+   count, 1 means no worker threads
+   numa keeps the worker threads on the node the X server is running on
+   returns NULL if no worker threads were started */
+extern _X_EXPORT struct rdp_workers *
+rdpWorkersCreate(int num_threads, int numa);
+extern _X_EXPORT void
+rdpWorkersDelete(struct rdp_workers *workers);
+/* threads that run items, including the X server thread
+   workers can be NULL */
+extern _X_EXPORT int
+rdpWorkersGetCount(struct rdp_workers *workers);
+/* runs proc for all items and waits for them, the calling thread
+   runs items too, calls from different threads take turns
+   workers can be NULL, then all items run on the calling thread */
+extern _X_EXPORT int
+rdpWorkersRun(struct rdp_workers *workers, rdp_work_proc proc, void *arg,
+              int num_items);
+
+#endif
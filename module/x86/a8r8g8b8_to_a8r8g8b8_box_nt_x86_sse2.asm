@@ -0,0 +1,134 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to ARGB copy with non temporal stores
+;x86 SSE2
+;
+; see a8r8g8b8_to_a8r8g8b8_box_nt_amd64_sse2.asm
+;
+; notes
+;   s8 and d8 do not need to be aligned, d8 should be 4 byte aligned
+;   width and height can be anything >= 0
+
+%include "common.asm"
+
+%define LS8            [esp + 20] ; s8
+%define LSRC_STRIDE    [esp + 24] ; src_stride
+%define LD8            [esp + 28] ; d8
+%define LDST_STRIDE    [esp + 32] ; dst_stride
+%define LWIDTH         [esp + 36] ; width
+%define LHEIGHT        [esp + 40] ; height
+
+;int
+;a8r8g8b8_to_a8r8g8b8_box_nt_x86_sse2(const char *s8, int src_stride,
+;                                     char *d8, int dst_stride,
+;                                     int width, int height);
+PROC a8r8g8b8_to_a8r8g8b8_box_nt_x86_sse2
+    push ebx
+    push esi
+    push edi
+    push ebp
+
+    mov ebp, LHEIGHT           ; ebp = height
+    cmp dword LWIDTH, 0
+    jle done_row_loop1
+    cmp ebp, 0
+    jle done_row_loop1
+
+row_loop1:
+    mov esi, LS8               ; s8
+    mov edi, LD8               ; d8
+    mov ecx, LWIDTH            ; pixels left in line
+
+head_loop1:
+    ; single pixels until d8 is 16 byte aligned
+    test edi, 15
+    jz done_head_loop1
+    mov eax, [esi]
+    movnti [edi], eax
+    lea esi, [esi + 4]
+    lea edi, [edi + 4]
+    dec ecx
+    jnz head_loop1
+    jmp done_tail_loop1
+
+done_head_loop1:
+    cmp ecx, 16
+    jb done_loop1
+
+loop1:
+    ; 16 pixels, 64 bytes, one cache line at a time
+    prefetchnta [esi + 512]
+    movdqu xmm0, [esi]
+    movdqu xmm1, [esi + 16]
+    movdqu xmm2, [esi + 32]
+    movdqu xmm3, [esi + 48]
+    movntdq [edi], xmm0
+    movntdq [edi + 16], xmm1
+    movntdq [edi + 32], xmm2
+    movntdq [edi + 48], xmm3
+    lea esi, [esi + 64]
+    lea edi, [edi + 64]
+    sub ecx, 16
+    cmp ecx, 16
+    jae loop1
+
+done_loop1:
+    cmp ecx, 4
+    jb tail_loop1
+
+loop2:
+    ; 4 pixels, 16 bytes
+    movdqu xmm0, [esi]
+    movntdq [edi], xmm0
+    lea esi, [esi + 16]
+    lea edi, [edi + 16]
+    sub ecx, 4
+    cmp ecx, 4
+    jae loop2
+
+tail_loop1:
+    test ecx, ecx
+    jz done_tail_loop1
+    mov eax, [esi]
+    movnti [edi], eax
+    lea esi, [esi + 4]
+    lea edi, [edi + 4]
+    dec ecx
+    jmp tail_loop1
+
+done_tail_loop1:
+    ; next line
+    mov eax, LSRC_STRIDE
+    add LS8, eax               ; s8 += src_stride
+    mov eax, LDST_STRIDE
+    add LD8, eax               ; d8 += dst_stride
+    dec ebp
+    jnz row_loop1
+
+    sfence                     ; order the non temporal stores
+
+done_row_loop1:
+    mov eax, 0                 ; return value
+    pop ebp
+    pop edi
+    pop esi
+    pop ebx
+    ret
+END_OF_FILE
@@ -0,0 +1,242 @@
+;
+;Copyright 2026 The xorgxrdp project
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;ARGB to AVC444 main and auxiliary NV12 views
+;x86 SSE2
+;
+; see a8r8g8b8_to_avc444_box_amd64_sse2.asm for the planes
+;
+; notes
+;   s8 does not need to be aligned
+;   width should be multiple of 8 and > 0
+;   height should be even and > 0
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+    cd255  times 4 dd 255
+    cd2    times 4 dd 2
+    cdhi   times 4 dd 0xFFFF0000
+
+    cw16   times 8 dw 16
+    cw128  times 8 dw 128
+    cw66   times 8 dw 66
+    cw129  times 8 dw 129
+    cw25   times 8 dw 25
+    cw38   times 8 dw 38
+    cw74   times 8 dw 74
+    cw112  times 8 dw 112
+    cw94   times 8 dw 94
+    cw18   times 8 dw 18
+    cw1    times 8 dw 1
+
+%define LU1            [esp +  0] ; first line U, 8 words
+%define LV1            [esp + 16] ; first line V, 8 words
+%define LU2            [esp + 32] ; second line U, 8 words
+%define LV2            [esp + 48] ; second line V, 8 words
+
+%define LS8            [esp + 84] ; s8
+%define LSRC_STRIDE    [esp + 88] ; src_stride
+%define LD8_Y          [esp + 92] ; d8_y
+%define LD8_UV         [esp + 96] ; d8_uv
+%define LD8_AUX_U      [esp + 100] ; d8_aux_u
+%define LD8_AUX_V      [esp + 104] ; d8_aux_v
+%define LD8_AUX_UV     [esp + 108] ; d8_aux_uv
+%define LDST_STRIDE    [esp + 112] ; dst_stride
+%define LWIDTH         [esp + 116] ; width
+%define LHEIGHT        [esp + 120] ; height
+
+; one line of 8 pixels at address %1
+; out, xmm1 = 8 y bytes, %2 = 8 u words, %3 = 8 v words, clamped
+%macro RGB_TO_YUV8 3
+    movdqu xmm0, [%1]          ; 4 pixels, 16 bytes
+    movdqa xmm1, xmm0          ; blue
+    pand xmm1, [lsym(cd255)]
+    movdqa xmm2, xmm0          ; green
+    psrld xmm2, 8
+    pand xmm2, [lsym(cd255)]
+    movdqa xmm3, xmm0          ; red
+    psrld xmm3, 16
+    pand xmm3, [lsym(cd255)]
+
+    movdqu xmm0, [%1 + 16]     ; 4 pixels, 16 bytes
+    movdqa xmm4, xmm0          ; blue
+    pand xmm4, [lsym(cd255)]
+    movdqa xmm5, xmm0          ; green
+    psrld xmm5, 8
+    pand xmm5, [lsym(cd255)]
+    movdqa xmm6, xmm0          ; red
+    psrld xmm6, 16
+    pand xmm6, [lsym(cd255)]
+
+    packssdw xmm1, xmm4        ; xmm1 = 8 blues
+    packssdw xmm2, xmm5        ; xmm2 = 8 greens
+    packssdw xmm3, xmm6        ; xmm3 = 8 reds
+
+    ; _U = ((-38 * _R -  74 * _G + 112 * _B + 128) >> 8) + 128;
+    movdqa xmm4, xmm1
+    pmullw xmm4, [lsym(cw112)]
+    movdqa xmm0, xmm2
+    pmullw xmm0, [lsym(cw74)]
+    psubw xmm4, xmm0
+    movdqa xmm0, xmm3
+    pmullw xmm0, [lsym(cw38)]
+    psubw xmm4, xmm0
+    paddw xmm4, [lsym(cw128)]
+    psraw xmm4, 8
+    paddw xmm4, [lsym(cw128)]
+    packuswb xmm4, xmm7        ; clamp 0 to 255
+    punpcklbw xmm4, xmm7
+    movdqu %2, xmm4
+
+    ; _V = ((112 * _R -  94 * _G -  18 * _B + 128) >> 8) + 128;
+    movdqa xmm5, xmm3
+    pmullw xmm5, [lsym(cw112)]
+    movdqa xmm0, xmm2
+    pmullw xmm0, [lsym(cw94)]
+    psubw xmm5, xmm0
+    movdqa xmm0, xmm1
+    pmullw xmm0, [lsym(cw18)]
+    psubw xmm5, xmm0
+    paddw xmm5, [lsym(cw128)]
+    psraw xmm5, 8
+    paddw xmm5, [lsym(cw128)]
+    packuswb xmm5, xmm7        ; clamp 0 to 255
+    punpcklbw xmm5, xmm7
+    movdqu %3, xmm5
+
+    ; _Y = (( 66 * _R + 129 * _G +  25 * _B + 128) >> 8) +  16;
+    pmullw xmm1, [lsym(cw25)]
+    pmullw xmm2, [lsym(cw129)]
+    pmullw xmm3, [lsym(cw66)]
+    paddw xmm1, xmm2
+    paddw xmm1, xmm3
+    paddw xmm1, [lsym(cw128)]
+    psrlw xmm1, 8
+    paddw xmm1, [lsym(cw16)]
+    packuswb xmm1, xmm7
+%endmacro
+
+;int
+;a8r8g8b8_to_avc444_box_x86_sse2(const char *s8, int src_stride,
+;                                char *d8_y, char *d8_uv,
+;                                char *d8_aux_u, char *d8_aux_v,
+;                                char *d8_aux_uv, int dst_stride,
+;                                int width, int height);
+PROC a8r8g8b8_to_avc444_box_x86_sse2
+    push ebx
+    RETRIEVE_RODATA
+    push esi
+    push edi
+    push ebp
+    sub esp, 64                ; local vars, 64 bytes
+
+    pxor xmm7, xmm7
+
+    mov ebp, LHEIGHT           ; ebp = height
+    shr ebp, 1                 ; doing 2 lines at a time
+    jz done_row_loop1
+
+row_loop1:
+    mov esi, LS8               ; s8
+    xor edi, edi               ; offset into the destination lines
+
+loop1:
+    cmp edi, LWIDTH
+    jge done_loop1
+
+    ; first line
+    RGB_TO_YUV8 esi, LU1, LV1
+    mov eax, LD8_Y
+    movq [eax + edi], xmm1     ; out 8 bytes yyyyyyyy
+
+    ; second line
+    mov edx, LSRC_STRIDE
+    RGB_TO_YUV8 esi + edx, LU2, LV2
+    add eax, LDST_STRIDE
+    movq [eax + edi], xmm1     ; out 8 bytes yyyyyyyy
+
+    ; auxiliary view
+    movdqu xmm0, LU2
+    packuswb xmm0, xmm7
+    mov eax, LD8_AUX_U
+    movq [eax + edi], xmm0     ; out 8 bytes uuuuuuuu
+    movdqu xmm0, LV2
+    packuswb xmm0, xmm7
+    mov eax, LD8_AUX_V
+    movq [eax + edi], xmm0     ; out 8 bytes vvvvvvvv
+    movdqu xmm0, LU1
+    psrld xmm0, 16             ; odd u in low words
+    movdqu xmm1, LV1
+    pand xmm1, [lsym(cdhi)]    ; odd v in high words
+    por xmm0, xmm1
+    packuswb xmm0, xmm7
+    mov eax, LD8_AUX_UV
+    movq [eax + edi], xmm0     ; out 8 bytes uvuvuvuv
+
+    ; uv add and divide(average)
+    movdqu xmm0, LU1
+    movdqu xmm1, LU2
+    paddw xmm0, xmm1
+    pmaddwd xmm0, [lsym(cw1)]  ; add pairs
+    paddd xmm0, [lsym(cd2)]    ; add 2
+    psrld xmm0, 2              ; div 4
+    movdqu xmm1, LV1
+    movdqu xmm2, LV2
+    paddw xmm1, xmm2
+    pmaddwd xmm1, [lsym(cw1)]  ; add pairs
+    paddd xmm1, [lsym(cd2)]    ; add 2
+    psrld xmm1, 2              ; div 4
+    pslld xmm1, 16
+    por xmm0, xmm1
+    packuswb xmm0, xmm7
+    mov eax, LD8_UV
+    movq [eax + edi], xmm0     ; out 8 bytes uvuvuvuv
+
+    ; move right
+    lea esi, [esi + 32]
+    lea edi, [edi + 8]
+    jmp loop1
+
+done_loop1:
+    ; update s8 and the destinations
+    mov eax, LSRC_STRIDE
+    add eax, eax
+    add LS8, eax               ; s8 += src_stride * 2
+    mov eax, LDST_STRIDE
+    add LD8_UV, eax
+    add LD8_AUX_U, eax
+    add LD8_AUX_V, eax
+    add LD8_AUX_UV, eax
+    add eax, eax
+    add LD8_Y, eax             ; d8_y += dst_stride * 2
+
+    dec ebp
+    jnz row_loop1
+
+done_row_loop1:
+    add esp, 64                ; local vars, 64 bytes
+    mov eax, 0                 ; return value
+    pop ebp
+    pop edi
+    pop esi
+    pop ebx
+    ret
+END_OF_FILE
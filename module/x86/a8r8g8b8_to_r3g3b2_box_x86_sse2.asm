@@ -0,0 +1,132 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to 8 bit BGR233
+;x86 SSE2
+;
+; notes
+;   d = (r >> 5) | ((g >> 5) << 3) | ((b >> 6) << 6)
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+cdr times 4 dd 0x00000007
+cdg times 4 dd 0x00000038
+cdb times 4 dd 0x000000C0
+
+%define LS8            [esp + 20] ; s8
+%define LSRC_STRIDE    [esp + 24] ; src_stride
+%define LD8            [esp + 28] ; d8
+%define LDST_STRIDE    [esp + 32] ; dst_stride
+%define LWIDTH         [esp + 36] ; width
+%define LHEIGHT        [esp + 40] ; height
+
+; in, %1 = 4 pixels
+; out, %1 = 4 dwords, ready for packssdw
+; %2 and %3 are temps
+%macro RGB233_4 3
+    movdqa %2, %1
+    psrld %2, 21
+    pand %2, [lsym(cdr)]       ; r
+    movdqa %3, %1
+    psrld %3, 10
+    pand %3, [lsym(cdg)]       ; g
+    por %2, %3
+    pand %1, [lsym(cdb)]       ; b
+    por %1, %2
+%endmacro
+
+;int
+;a8r8g8b8_to_r3g3b2_box_x86_sse2(const char *s8, int src_stride,
+;                                char *d8, int dst_stride,
+;                                int width, int height);
+PROC a8r8g8b8_to_r3g3b2_box_x86_sse2
+    push ebx
+    RETRIEVE_RODATA
+    push esi
+    push edi
+    push ebp
+
+    mov ebp, LHEIGHT           ; ebp = height
+    cmp ebp, 0
+    jle done_loop_y
+
+loop_y:
+    mov esi, LS8               ; s8
+    mov edi, LD8               ; d8
+    mov ecx, LWIDTH            ; ecx = width
+
+loop_x16:
+    cmp ecx, 16
+    jl done_loop_x16
+
+    movdqu xmm0, [esi]         ; 4 pixels
+    RGB233_4 xmm0, xmm4, xmm5
+    movdqu xmm1, [esi + 16]    ; 4 pixels
+    RGB233_4 xmm1, xmm4, xmm5
+    movdqu xmm2, [esi + 32]    ; 4 pixels
+    RGB233_4 xmm2, xmm4, xmm5
+    movdqu xmm3, [esi + 48]    ; 4 pixels
+    RGB233_4 xmm3, xmm4, xmm5
+    lea esi, [esi + 64]
+    packssdw xmm0, xmm1
+    packssdw xmm2, xmm3
+    packuswb xmm0, xmm2
+    movdqu [edi], xmm0         ; 16 pixels
+    lea edi, [edi + 16]
+
+    sub ecx, 16
+    jmp loop_x16
+done_loop_x16:
+
+loop_x1:
+    cmp ecx, 1
+    jl done_loop_x1
+
+    movd xmm0, [esi]           ; 1 pixel
+    RGB233_4 xmm0, xmm4, xmm5
+    lea esi, [esi + 4]
+    movd edx, xmm0
+    mov [edi], dl
+    lea edi, [edi + 1]
+
+    dec ecx
+    jmp loop_x1
+done_loop_x1:
+
+    ; update s8 and d8
+    mov eax, LS8               ; s8
+    add eax, LSRC_STRIDE       ; s8 += src_stride
+    mov LS8, eax
+    mov eax, LD8               ; d8
+    add eax, LDST_STRIDE       ; d8 += dst_stride
+    mov LD8, eax
+
+    dec ebp
+    jnz loop_y
+
+done_loop_y:
+    mov eax, 0                 ; return value
+    pop ebp
+    pop edi
+    pop esi
+    pop ebx
+    ret
+END_OF_FILE
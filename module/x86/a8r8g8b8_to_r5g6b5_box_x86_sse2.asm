@@ -0,0 +1,130 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to RGB565
+;x86 SSE2
+;
+; notes
+;   d = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+;   the words are sign extended before packssdw so it does not saturate
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+cdr times 4 dd 0x0000F800
+cdg times 4 dd 0x000007E0
+cdb times 4 dd 0x0000001F
+
+%define LS8            [esp + 20] ; s8
+%define LSRC_STRIDE    [esp + 24] ; src_stride
+%define LD8            [esp + 28] ; d8
+%define LDST_STRIDE    [esp + 32] ; dst_stride
+%define LWIDTH         [esp + 36] ; width
+%define LHEIGHT        [esp + 40] ; height
+
+; in, %1 = 4 pixels
+; out, %1 = 4 dwords, sign extended
+; %2 and %3 are temps
+%macro RGB565_4 3
+    movdqa %2, %1
+    psrld %2, 8
+    pand %2, [lsym(cdr)]       ; r
+    movdqa %3, %1
+    psrld %3, 5
+    pand %3, [lsym(cdg)]       ; g
+    por %2, %3
+    psrld %1, 3
+    pand %1, [lsym(cdb)]       ; b
+    por %1, %2
+    pslld %1, 16
+    psrad %1, 16
+%endmacro
+
+;int
+;a8r8g8b8_to_r5g6b5_box_x86_sse2(const char *s8, int src_stride,
+;                                char *d8, int dst_stride,
+;                                int width, int height);
+PROC a8r8g8b8_to_r5g6b5_box_x86_sse2
+    push ebx
+    RETRIEVE_RODATA
+    push esi
+    push edi
+    push ebp
+
+    mov ebp, LHEIGHT           ; ebp = height
+    cmp ebp, 0
+    jle done_loop_y
+
+loop_y:
+    mov esi, LS8               ; s8
+    mov edi, LD8               ; d8
+    mov ecx, LWIDTH            ; ecx = width
+
+loop_x8:
+    cmp ecx, 8
+    jl done_loop_x8
+
+    movdqu xmm0, [esi]         ; 4 pixels
+    RGB565_4 xmm0, xmm4, xmm5
+    movdqu xmm1, [esi + 16]    ; 4 pixels
+    RGB565_4 xmm1, xmm4, xmm5
+    lea esi, [esi + 32]
+    packssdw xmm0, xmm1
+    movdqu [edi], xmm0         ; 8 pixels
+    lea edi, [edi + 16]
+
+    sub ecx, 8
+    jmp loop_x8
+done_loop_x8:
+
+loop_x1:
+    cmp ecx, 1
+    jl done_loop_x1
+
+    movd xmm0, [esi]           ; 1 pixel
+    RGB565_4 xmm0, xmm4, xmm5
+    lea esi, [esi + 4]
+    movd edx, xmm0
+    mov [edi], dx
+    lea edi, [edi + 2]
+
+    dec ecx
+    jmp loop_x1
+done_loop_x1:
+
+    ; update s8 and d8
+    mov eax, LS8               ; s8
+    add eax, LSRC_STRIDE       ; s8 += src_stride
+    mov LS8, eax
+    mov eax, LD8               ; d8
+    add eax, LDST_STRIDE       ; d8 += dst_stride
+    mov LD8, eax
+
+    dec ebp
+    jnz loop_y
+
+done_loop_y:
+    mov eax, 0                 ; return value
+    pop ebp
+    pop edi
+    pop esi
+    pop ebx
+    ret
+END_OF_FILE
@@ -0,0 +1,182 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to 64x64 linear planar YUVA, RFX tile
+;x86 SSE2
+;
+; y = (r *  19595 + g *  38470 + b *   7471) >> 16
+; u = (r * -11071 + g * -21736 + b *  32807) >> 16 + 128
+; v = (r *  32756 + g * -27429 + b *  -5327) >> 16 + 128
+; 38470 and 32807 do not fit in a signed word so
+; g * 38470 = g * -27066 + (g << 16) and
+; b * 32807 = b * -32729 + (b << 16), the << 16 part is added after the shift
+;
+; notes
+;   d8 is in the Y plane, U, V and A planes follow, each 64 * 64 bytes
+;   output is bit exact with the C version
+
+%include "common.asm"
+
+PREPARE_RODATA
+cd255 times 4 dd 255
+cd128 times 4 dd 128
+cdrb times 4 dd 0x00FF00FF
+cwy_br times 4 dw 7471, 19595
+cwy_g times 4 dw -27066, 0
+cwu_br times 4 dw -32729, -11071
+cwu_g times 4 dw -21736, 0
+cwv_br times 4 dw -5327, 32756
+cwv_g times 4 dw -27429, 0
+
+%define PLANE 4096
+
+%define LS8            [esp + 20] ; s8
+%define LSRC_STRIDE    [esp + 24] ; src_stride
+%define LD8            [esp + 28] ; d8
+%define LDST_STRIDE    [esp + 32] ; dst_stride
+%define LWIDTH         [esp + 36] ; width
+%define LHEIGHT        [esp + 40] ; height
+
+; in, xmm0 = 4 pixels
+; out, xmm0 = y, xmm1 = u, xmm2 = v, xmm3 = a, 4 dwords each, not clamped
+; uses xmm4, xmm5, xmm6
+%macro YUVA4 0
+    movdqa xmm3, xmm0
+    psrld xmm3, 24             ; a
+    movdqa xmm4, xmm0
+    pand xmm4, [lsym(cd255)]   ; b
+    movdqa xmm5, xmm0
+    psrld xmm5, 8
+    pand xmm5, [lsym(cd255)]   ; g
+    pand xmm0, [lsym(cdrb)]    ; b in low word, r in high word
+
+    ; u
+    movdqa xmm1, xmm0
+    pmaddwd xmm1, [lsym(cwu_br)]
+    movdqa xmm6, xmm5
+    pmaddwd xmm6, [lsym(cwu_g)]
+    paddd xmm1, xmm6
+    psrad xmm1, 16
+    paddd xmm1, xmm4
+    paddd xmm1, [lsym(cd128)]
+
+    ; v
+    movdqa xmm2, xmm0
+    pmaddwd xmm2, [lsym(cwv_br)]
+    movdqa xmm6, xmm5
+    pmaddwd xmm6, [lsym(cwv_g)]
+    paddd xmm2, xmm6
+    psrad xmm2, 16
+    paddd xmm2, [lsym(cd128)]
+
+    ; y
+    pmaddwd xmm0, [lsym(cwy_br)]
+    movdqa xmm6, xmm5
+    pmaddwd xmm6, [lsym(cwy_g)]
+    paddd xmm0, xmm6
+    psrad xmm0, 16
+    paddd xmm0, xmm5
+
+    packssdw xmm0, xmm0
+    packuswb xmm0, xmm0
+    packssdw xmm1, xmm1
+    packuswb xmm1, xmm1
+    packssdw xmm2, xmm2
+    packuswb xmm2, xmm2
+    packssdw xmm3, xmm3
+    packuswb xmm3, xmm3
+%endmacro
+
+;int
+;a8r8g8b8_to_yuvalp_box_x86_sse2(const char *s8, int src_stride,
+;                                char *d8, int dst_stride,
+;                                int width, int height);
+PROC a8r8g8b8_to_yuvalp_box_x86_sse2
+    push ebx
+    RETRIEVE_RODATA
+    push esi
+    push edi
+    push ebp
+
+    mov ebp, LHEIGHT           ; ebp = height
+    cmp ebp, 0
+    jle done_loop_y
+
+loop_y:
+    mov esi, LS8               ; s8
+    mov edi, LD8               ; d8
+    mov ecx, LWIDTH            ; ecx = width
+
+loop_x4:
+    cmp ecx, 4
+    jl done_loop_x4
+
+    movdqu xmm0, [esi]         ; 4 pixels
+    lea esi, [esi + 16]
+    YUVA4
+    movd [edi], xmm0           ; 4 y
+    movd [edi + PLANE], xmm1   ; 4 u
+    movd [edi + PLANE * 2], xmm2 ; 4 v
+    movd [edi + PLANE * 3], xmm3 ; 4 a
+    lea edi, [edi + 4]
+
+    sub ecx, 4
+    jmp loop_x4
+done_loop_x4:
+
+loop_x1:
+    cmp ecx, 1
+    jl done_loop_x1
+
+    movd xmm0, [esi]           ; 1 pixel
+    lea esi, [esi + 4]
+    YUVA4
+    movd edx, xmm0
+    mov [edi], dl              ; y
+    movd edx, xmm1
+    mov [edi + PLANE], dl      ; u
+    movd edx, xmm2
+    mov [edi + PLANE * 2], dl  ; v
+    movd edx, xmm3
+    mov [edi + PLANE * 3], dl  ; a
+    lea edi, [edi + 1]
+
+    dec ecx
+    jmp loop_x1
+done_loop_x1:
+
+    ; update s8 and d8
+    mov eax, LS8               ; s8
+    add eax, LSRC_STRIDE       ; s8 += src_stride
+    mov LS8, eax
+    mov eax, LD8               ; d8
+    add eax, LDST_STRIDE       ; d8 += dst_stride
+    mov LD8, eax
+
+    dec ebp
+    jnz loop_y
+
+done_loop_y:
+    mov eax, 0                 ; return value
+    pop ebp
+    pop edi
+    pop esi
+    pop ebx
+    ret
+END_OF_FILE
@@ -26,6 +26,9 @@ x86 asm functions
 
 int
 cpuid_x86(int eax_in, int ecx_in, int *eax, int *ebx, int *ecx, int *edx);
+uint64_t
+tile_hash_crc32c_x86_sse42(uint64_t hash, const void *data,
+                           int data_bytes);
 int
 yv12_to_rgb32_x86_sse2(const uint8_t *yuvs, int width, int height, int *rgbs);
 int
@@ -39,10 +42,36 @@ a8r8g8b8_to_a8b8g8r8_box_x86_sse2(const uint8_t *s8, int src_stride,
                                   uint8_t *d8, int dst_stride,
                                   int width, int height);
 int
+a8r8g8b8_to_a8r8g8b8_box_nt_x86_sse2(const uint8_t *s8, int src_stride,
+                                     uint8_t *d8, int dst_stride,
+                                     int width, int height);
+int
 a8r8g8b8_to_nv12_box_x86_sse2(const uint8_t *s8, int src_stride,
                               uint8_t *d8_y, int dst_stride_y,
                               uint8_t *d8_uv, int dst_stride_uv,
                               int width, int height);
+int
+a8r8g8b8_to_avc444_box_x86_sse2(const uint8_t *s8, int src_stride,
+                                uint8_t *d8_y, uint8_t *d8_uv,
+                                uint8_t *d8_aux_u, uint8_t *d8_aux_v,
+                                uint8_t *d8_aux_uv, int dst_stride,
+                                int width, int height);
+int
+a8r8g8b8_to_yuvalp_box_x86_sse2(const uint8_t *s8, int src_stride,
+                                uint8_t *d8, int dst_stride,
+                                int width, int height);
+int
+a8r8g8b8_to_r5g6b5_box_x86_sse2(const uint8_t *s8, int src_stride,
+                                uint8_t *d8, int dst_stride,
+                                int width, int height);
+int
+a8r8g8b8_to_a1r5g5b5_box_x86_sse2(const uint8_t *s8, int src_stride,
+                                  uint8_t *d8, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_r3g3b2_box_x86_sse2(const uint8_t *s8, int src_stride,
+                                uint8_t *d8, int dst_stride,
+                                int width, int height);
 
 #endif
 
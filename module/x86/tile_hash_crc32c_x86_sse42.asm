@@ -0,0 +1,99 @@
+;
+;Copyright 2026 The xorgxrdp project
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;64 bit tile hash from four hardware CRC32C streams
+;x86 SSE4.2
+;
+; notes
+;   crc32 has a latency of 3 and a throughput of 1 so four independent
+;   streams keep the unit busy
+;   crc is linear, streams 1 and 3 add in streams 0 and 2 each round so
+;   the high 32 bits are not a function of the low 32 bits for repeating
+;   data like solid fills
+;   hash is the running hash, pass 0 to start, the return can be passed
+;   back in to hash more data
+
+%include "common.asm"
+
+%define LHASH_LO       [esp + 16] ; hash, low 32 bits
+%define LHASH_HI       [esp + 20] ; hash, high 32 bits
+%define LDATA          [esp + 24] ; data
+%define LDATA_BYTES    [esp + 28] ; data_bytes
+
+;uint64_t
+;tile_hash_crc32c_x86_sse42(uint64_t hash, const void *data,
+;                           int data_bytes);
+PROC tile_hash_crc32c_x86_sse42
+    push ebx
+    push esi
+    push edi
+
+    mov eax, LHASH_LO
+    not eax                    ; stream 0
+    mov edx, LHASH_HI
+    not edx                    ; stream 1
+    mov ebx, LHASH_LO          ; stream 2
+    mov ecx, LHASH_HI          ; stream 3
+    mov esi, LDATA
+    mov edi, LDATA_BYTES
+
+loop_x16:
+    cmp edi, 16
+    jl done_loop_x16
+    crc32 eax, dword [esi]
+    crc32 edx, dword [esi + 4]
+    crc32 ebx, dword [esi + 8]
+    crc32 ecx, dword [esi + 12]
+    add edx, eax
+    add ecx, ebx
+    lea esi, [esi + 16]
+    sub edi, 16
+    jmp loop_x16
+done_loop_x16:
+
+    ; fold stream 3 into 0 and 2 into 1, 2 into 0 would cancel for
+    ; repeating data
+    crc32 eax, ecx
+    crc32 edx, ebx
+
+loop_x4:
+    cmp edi, 4
+    jl done_loop_x4
+    crc32 eax, dword [esi]
+    lea esi, [esi + 4]
+    sub edi, 4
+    jmp loop_x4
+done_loop_x4:
+
+loop_x1:
+    cmp edi, 1
+    jl done_loop_x1
+    crc32 eax, byte [esi]
+    lea esi, [esi + 1]
+    dec edi
+    jmp loop_x1
+done_loop_x1:
+
+    not eax                    ; return value, low 32 bits
+    not edx                    ; return value, high 32 bits
+    pop edi
+    pop esi
+    pop ebx
+    ret
+END_OF_FILE
@@ -32,10 +32,22 @@ yuv to rgb speed testing
 
 #if defined(USE_SIMD_AMD64)
 #define a8r8g8b8_to_nv12_box_accel a8r8g8b8_to_nv12_box_amd64_sse2
+#define a8r8g8b8_to_yuvalp_box_accel a8r8g8b8_to_yuvalp_box_amd64_sse2
+#define a8r8g8b8_to_avc444_box_accel a8r8g8b8_to_avc444_box_amd64_sse2
+#define a8r8g8b8_to_r5g6b5_box_accel a8r8g8b8_to_r5g6b5_box_amd64_sse2
+#define a8r8g8b8_to_a1r5g5b5_box_accel a8r8g8b8_to_a1r5g5b5_box_amd64_sse2
+#define a8r8g8b8_to_r3g3b2_box_accel a8r8g8b8_to_r3g3b2_box_amd64_sse2
+#define a8r8g8b8_to_a8r8g8b8_box_nt_accel a8r8g8b8_to_a8r8g8b8_box_nt_amd64_sse2
 #endif
 
 #if defined(USE_SIMD_X86)
 #define a8r8g8b8_to_nv12_box_accel a8r8g8b8_to_nv12_box_x86_sse2
+#define a8r8g8b8_to_yuvalp_box_accel a8r8g8b8_to_yuvalp_box_x86_sse2
+#define a8r8g8b8_to_avc444_box_accel a8r8g8b8_to_avc444_box_x86_sse2
+#define a8r8g8b8_to_r5g6b5_box_accel a8r8g8b8_to_r5g6b5_box_x86_sse2
+#define a8r8g8b8_to_a1r5g5b5_box_accel a8r8g8b8_to_a1r5g5b5_box_x86_sse2
+#define a8r8g8b8_to_r3g3b2_box_accel a8r8g8b8_to_r3g3b2_box_x86_sse2
+#define a8r8g8b8_to_a8r8g8b8_box_nt_accel a8r8g8b8_to_a8r8g8b8_box_nt_x86_sse2
 #endif
 
 /******************************************************************************/
@@ -176,6 +188,241 @@ a8r8g8b8_to_nv12_box(char *s8, int src_stride,
     return 0;
 }
 
+/******************************************************************************/
+/* same as in rdpCapture.c, 64x64 linear planar YUVA */
+static int
+a8r8g8b8_to_yuvalp_box(char *s8, int src_stride,
+                       char *d8, int dst_stride,
+                       int width, int height)
+{
+    unsigned char *yptr;
+    unsigned char *uptr;
+    unsigned char *vptr;
+    unsigned char *aptr;
+    unsigned int *s32;
+    unsigned int pixel;
+    int jndex;
+    int kndex;
+    int a;
+    int r;
+    int g;
+    int b;
+    int y;
+    int u;
+    int v;
+
+    for (jndex = 0; jndex < height; jndex++)
+    {
+        s32 = (unsigned int *) s8;
+        yptr = (unsigned char *) d8;
+        uptr = yptr + 64 * 64;
+        vptr = uptr + 64 * 64;
+        aptr = vptr + 64 * 64;
+        for (kndex = 0; kndex < width; kndex++)
+        {
+            pixel = *(s32++);
+            a = (pixel >> 24) & 0xff;
+            r = (pixel >> 16) & 0xff;
+            g = (pixel >>  8) & 0xff;
+            b = (pixel >>  0) & 0xff;
+            y = (r *  19595 + g *  38470 + b *   7471) >> 16;
+            u = (r * -11071 + g * -21736 + b *  32807) >> 16;
+            v = (r *  32756 + g * -27429 + b *  -5327) >> 16;
+            u = u + 128;
+            v = v + 128;
+            *(yptr++) = RDPCLAMP(y, 0, 255);
+            *(uptr++) = RDPCLAMP(u, 0, 255);
+            *(vptr++) = RDPCLAMP(v, 0, 255);
+            *(aptr++) = a;
+        }
+        d8 += dst_stride;
+        s8 += src_stride;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* same as in rdpCapture.c, the main view is the same as
+   a8r8g8b8_to_nv12_box */
+static int
+a8r8g8b8_to_avc444_box(char *s8, int src_stride,
+                       char *d8_y, char *d8_uv,
+                       char *d8_aux_u, char *d8_aux_v,
+                       char *d8_aux_uv, int dst_stride,
+                       int width, int height)
+{
+    int index;
+    int jndex;
+    int kndex;
+    int R;
+    int G;
+    int B;
+    int Y[4];
+    int U[4];
+    int V[4];
+    int pixel;
+    int *s32a;
+    int *s32b;
+    char *d8ya;
+    char *d8yb;
+    char *d8uv;
+    char *d8au;
+    char *d8av;
+    char *d8auv;
+
+    for (jndex = 0; jndex < height; jndex += 2)
+    {
+        s32a = (int *) (s8 + src_stride * jndex);
+        s32b = (int *) (s8 + src_stride * (jndex + 1));
+        d8ya = d8_y + dst_stride * jndex;
+        d8yb = d8_y + dst_stride * (jndex + 1);
+        d8uv = d8_uv + dst_stride * (jndex / 2);
+        d8au = d8_aux_u + dst_stride * (jndex / 2);
+        d8av = d8_aux_v + dst_stride * (jndex / 2);
+        d8auv = d8_aux_uv + dst_stride * (jndex / 2);
+        for (index = 0; index < width; index += 2)
+        {
+            /* 0, 1 first line, 2, 3 second line */
+            for (kndex = 0; kndex < 4; kndex++)
+            {
+                pixel = kndex < 2 ? s32a[index + kndex] :
+                        s32b[index + kndex - 2];
+                R = (pixel >> 16) & 0xff;
+                G = (pixel >>  8) & 0xff;
+                B = (pixel >>  0) & 0xff;
+                YUV2RGB(Y[kndex], U[kndex], V[kndex], R, G, B);
+                Y[kndex] = RDPCLAMP(Y[kndex], 0, 255);
+                U[kndex] = RDPCLAMP(U[kndex], 0, 255);
+                V[kndex] = RDPCLAMP(V[kndex], 0, 255);
+            }
+            d8ya[index] = Y[0];
+            d8ya[index + 1] = Y[1];
+            d8yb[index] = Y[2];
+            d8yb[index + 1] = Y[3];
+            d8uv[index] = (U[0] + U[1] + U[2] + U[3] + 2) / 4;
+            d8uv[index + 1] = (V[0] + V[1] + V[2] + V[3] + 2) / 4;
+            d8au[index] = U[2];
+            d8au[index + 1] = U[3];
+            d8av[index] = V[2];
+            d8av[index + 1] = V[3];
+            d8auv[index] = U[1];
+            d8auv[index + 1] = V[1];
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* same as in rdp.h */
+#define COLOR8(r, g, b) \
+    ((((r) >> 5) << 0)  | (((g) >> 5) << 3) | (((b) >> 6) << 6))
+#define COLOR15(r, g, b) \
+    ((((r) >> 3) << 10) | (((g) >> 3) << 5) | (((b) >> 3) << 0))
+#define COLOR16(r, g, b) \
+    ((((r) >> 3) << 11) | (((g) >> 2) << 5) | (((b) >> 3) << 0))
+
+/******************************************************************************/
+/* same as in rdpCapture.c */
+static int
+a8r8g8b8_to_r5g6b5_box(char *s8, int src_stride,
+                       char *d8, int dst_stride,
+                       int width, int height)
+{
+    int index;
+    int jndex;
+    int red;
+    int green;
+    int blue;
+    unsigned int *s32;
+    unsigned short *d16;
+
+    for (index = 0; index < height; index++)
+    {
+        s32 = (unsigned int *) s8;
+        d16 = (unsigned short *) d8;
+        for (jndex = 0; jndex < width; jndex++)
+        {
+            red = (*s32 >> 16) & 0xff;
+            green = (*s32 >> 8) & 0xff;
+            blue = *s32 & 0xff;
+            *d16 = COLOR16(red, green, blue);
+            s32++;
+            d16++;
+        }
+        d8 += dst_stride;
+        s8 += src_stride;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* same as in rdpCapture.c */
+static int
+a8r8g8b8_to_a1r5g5b5_box(char *s8, int src_stride,
+                         char *d8, int dst_stride,
+                         int width, int height)
+{
+    int index;
+    int jndex;
+    int red;
+    int green;
+    int blue;
+    unsigned int *s32;
+    unsigned short *d16;
+
+    for (index = 0; index < height; index++)
+    {
+        s32 = (unsigned int *) s8;
+        d16 = (unsigned short *) d8;
+        for (jndex = 0; jndex < width; jndex++)
+        {
+            red = (*s32 >> 16) & 0xff;
+            green = (*s32 >> 8) & 0xff;
+            blue = *s32 & 0xff;
+            *d16 = COLOR15(red, green, blue);
+            s32++;
+            d16++;
+        }
+        d8 += dst_stride;
+        s8 += src_stride;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* same as in rdpCapture.c */
+static int
+a8r8g8b8_to_r3g3b2_box(char *s8, int src_stride,
+                       char *d8, int dst_stride,
+                       int width, int height)
+{
+    int index;
+    int jndex;
+    int red;
+    int green;
+    int blue;
+    unsigned int *s32;
+    unsigned char *ld8;
+
+    for (index = 0; index < height; index++)
+    {
+        s32 = (unsigned int *) s8;
+        ld8 = (unsigned char *) d8;
+        for (jndex = 0; jndex < width; jndex++)
+        {
+            red = (*s32 >> 16) & 0xff;
+            green = (*s32 >> 8) & 0xff;
+            blue = *s32 & 0xff;
+            *ld8 = COLOR8(red, green, blue);
+            s32++;
+            ld8++;
+        }
+        d8 += dst_stride;
+        s8 += src_stride;
+    }
+    return 0;
+}
+
 int output_params(void)
 {
     return 0;
@@ -262,13 +509,583 @@ a8r8g8b8_to_nv12_box_amd64_sse2(char *s8, int src_stride,
                                 char *d8_y, int dst_stride_y,
                                 char *d8_uv, int dst_stride_uv,
                                 int width, int height);
+int
+a8r8g8b8_to_nv12_box_amd64_avx2(char *s8, int src_stride,
+                                char *d8_y, int dst_stride_y,
+                                char *d8_uv, int dst_stride_uv,
+                                int width, int height);
+int
+a8r8g8b8_to_nv12_box_amd64_avx512(char *s8, int src_stride,
+                                  char *d8_y, int dst_stride_y,
+                                  char *d8_uv, int dst_stride_uv,
+                                  int width, int height);
+int
+a8r8g8b8_to_yuvalp_box_x86_sse2(char *s8, int src_stride,
+                                char *d8, int dst_stride,
+                                int width, int height);
+int
+a8r8g8b8_to_yuvalp_box_amd64_sse2(char *s8, int src_stride,
+                                  char *d8, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_yuvalp_box_amd64_avx2(char *s8, int src_stride,
+                                  char *d8, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_avc444_box_x86_sse2(char *s8, int src_stride,
+                                char *d8_y, char *d8_uv,
+                                char *d8_aux_u, char *d8_aux_v,
+                                char *d8_aux_uv, int dst_stride,
+                                int width, int height);
+int
+a8r8g8b8_to_avc444_box_amd64_sse2(char *s8, int src_stride,
+                                  char *d8_y, char *d8_uv,
+                                  char *d8_aux_u, char *d8_aux_v,
+                                  char *d8_aux_uv, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_avc444_box_amd64_avx2(char *s8, int src_stride,
+                                  char *d8_y, char *d8_uv,
+                                  char *d8_aux_u, char *d8_aux_v,
+                                  char *d8_aux_uv, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_r5g6b5_box_x86_sse2(char *s8, int src_stride,
+                                char *d8, int dst_stride,
+                                int width, int height);
+int
+a8r8g8b8_to_r5g6b5_box_amd64_sse2(char *s8, int src_stride,
+                                  char *d8, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_a1r5g5b5_box_x86_sse2(char *s8, int src_stride,
+                                  char *d8, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_a1r5g5b5_box_amd64_sse2(char *s8, int src_stride,
+                                    char *d8, int dst_stride,
+                                    int width, int height);
+int
+a8r8g8b8_to_r3g3b2_box_x86_sse2(char *s8, int src_stride,
+                                char *d8, int dst_stride,
+                                int width, int height);
+int
+a8r8g8b8_to_r3g3b2_box_amd64_sse2(char *s8, int src_stride,
+                                  char *d8, int dst_stride,
+                                  int width, int height);
+int
+a8r8g8b8_to_a8r8g8b8_box_nt_x86_sse2(char *s8, int src_stride,
+                                     char *d8, int dst_stride,
+                                     int width, int height);
+int
+a8r8g8b8_to_a8r8g8b8_box_nt_amd64_sse2(char *s8, int src_stride,
+                                       char *d8, int dst_stride,
+                                       int width, int height);
+int
+cpuid_amd64(int eax_in, int ecx_in, int *eax, int *ebx, int *ecx, int *edx);
+int
+xgetbv_amd64(int ecx_in, int *eax, int *edx);
+
+typedef int (*nv12_box_proc)(char *s8, int src_stride,
+                             char *d8_y, int dst_stride_y,
+                             char *d8_uv, int dst_stride_uv,
+                             int width, int height);
+
+typedef int (*yuvalp_box_proc)(char *s8, int src_stride,
+                               char *d8, int dst_stride,
+                               int width, int height);
+
+typedef int (*rgb_box_proc)(char *s8, int src_stride,
+                            char *d8, int dst_stride,
+                            int width, int height);
+
+typedef int (*avc444_box_proc)(char *s8, int src_stride,
+                               char *d8_y, char *d8_uv,
+                               char *d8_aux_u, char *d8_aux_v,
+                               char *d8_aux_uv, int dst_stride,
+                               int width, int height);
+
+#if defined(USE_SIMD_AMD64)
+/* 0 = none, 1 = sse2, 2 = avx2, 3 = avx512, same as rdpSimd.h */
+static int
+get_simd_level(void)
+{
+    int ax, bx, cx, dx;
+    int max_leaf;
+    int xcr0_lo, xcr0_hi;
+    int level;
+
+    level = 1;
+    cpuid_amd64(0, 0, &ax, &bx, &cx, &dx);
+    max_leaf = ax;
+    cpuid_amd64(1, 0, &ax, &bx, &cx, &dx);
+    if ((cx & (1 << 27)) && (cx & (1 << 28)) && (max_leaf >= 7))
+    {
+        xgetbv_amd64(0, &xcr0_lo, &xcr0_hi);
+        cpuid_amd64(7, 0, &ax, &bx, &cx, &dx);
+        if (((xcr0_lo & 0x06) == 0x06) && (bx & (1 << 5)))
+        {
+            level = 2;
+            if (((xcr0_lo & 0xE6) == 0xE6) &&
+                (bx & (1 << 16)) && (bx & (1 << 30)))
+            {
+                level = 3;
+            }
+        }
+    }
+    return level;
+}
+#endif
+
+#define NV12_BOX_WIDTH 256
+#define NV12_BOX_HEIGHT 64
+
+/* a box into a 256x64 nv12 buffer, proc does the multiple of 8 part of
+ * the width and the C version the rest, first, so a write past it shows,
+ * like rdpCopyBox_a8r8g8b8_to_nv12, proc NULL for all C */
+static void
+nv12_box(nv12_box_proc proc, char *s8, int src_stride, char *dst,
+         int x, int y, int width, int height)
+{
+    char *d8_y;
+    char *d8_uv;
+    int simd_width;
+
+    d8_y = dst + y * NV12_BOX_WIDTH + x;
+    d8_uv = dst + NV12_BOX_WIDTH * NV12_BOX_HEIGHT +
+            (y / 2) * NV12_BOX_WIDTH + x;
+    simd_width = (proc == NULL) ? 0 : width & ~7;
+    if (width > simd_width)
+    {
+        a8r8g8b8_to_nv12_box(s8 + simd_width * 4, src_stride,
+                             d8_y + simd_width, NV12_BOX_WIDTH,
+                             d8_uv + simd_width, NV12_BOX_WIDTH,
+                             width - simd_width, height);
+    }
+    if (simd_width > 0)
+    {
+        proc(s8, src_stride, d8_y, NV12_BOX_WIDTH, d8_uv, NV12_BOX_WIDTH,
+             simd_width, height);
+    }
+}
+
+/* returns 0 if the output matches yuv_data1, and the C version for
+ * narrow boxes and widths that are not a multiple of 8 */
+static int
+check_nv12(const char *name, nv12_box_proc proc, char *rgb_data,
+           char *yuv_data1, char *yuv_data2)
+{
+    char yuv1[NV12_BOX_WIDTH * NV12_BOX_HEIGHT * 3 / 2];
+    char yuv2[NV12_BOX_WIDTH * NV12_BOX_HEIGHT * 3 / 2];
+    char *s8;
+    int index;
+    int offset;
+    int stime;
+    int etime;
+    int x;
+    int y;
+    int width;
+    int height;
+
+    memset(yuv_data2, 0, 1920 * 1080 * 3 / 2);
+    stime = get_mstime();
+    for (index = 0; index < 100; index++)
+    {
+        proc(rgb_data, 1920 * 4,
+             yuv_data2, 1920,
+             yuv_data2 + 1920 * 1080, 1920,
+             1920, 1080);
+    }
+    etime = get_mstime();
+    printf("%s took %d\n", name, etime - stime);
+    if (lmemcmp(yuv_data1, yuv_data2, 1920 * 1080 * 3 / 2, &offset) != 0)
+    {
+        printf("no match at offset %d\n", offset);
+        printf("first\n");
+        hexdump(yuv_data1 + offset, 16);
+        printf("second\n");
+        hexdump(yuv_data2 + offset, 16);
+        return 1;
+    }
+    for (index = 0; index < 2000; index++)
+    {
+        /* even, as rdpCaptureEvenRect makes them */
+        x = (rand() % NV12_BOX_WIDTH) & ~1;
+        y = (rand() % NV12_BOX_HEIGHT) & ~1;
+        /* a third of them 16 or less wide */
+        width = 1 + rand() % ((index % 3 == 0) ? 16 : NV12_BOX_WIDTH - x);
+        width = (width > NV12_BOX_WIDTH - x) ? NV12_BOX_WIDTH - x : width;
+        height = 2 + ((rand() % (NV12_BOX_HEIGHT - y)) & ~1);
+        s8 = rgb_data + (rand() % 1000) * 1920 * 4 + (rand() % 1600) * 4;
+        memset(yuv1, 0, sizeof(yuv1));
+        memset(yuv2, 0, sizeof(yuv2));
+        nv12_box(NULL, s8, 1920 * 4, yuv1, x, y, width, height);
+        nv12_box(proc, s8, 1920 * 4, yuv2, x, y, width, height);
+        if (lmemcmp(yuv1, yuv2, sizeof(yuv1), &offset) != 0)
+        {
+            printf("%s no match for x %d y %d width %d height %d "
+                   "at offset %d\n", name, x, y, width, height, offset);
+            return 1;
+        }
+    }
+    printf("match\n");
+    return 0;
+}
 
 #define AL(_ptr) ((char*)((((size_t)_ptr) + 15) & ~15))
 
-int main(int argc, char** argv)
+/* returns 0 if proc matches the C version for all 64x64 tiles of
+ * rgb_data, 1920x1080, and for some partial tiles */
+static int
+check_yuvalp(const char *name, yuvalp_box_proc proc, char *rgb_data)
+{
+    char yuva1[64 * 64 * 4];
+    char yuva2[64 * 64 * 4];
+    char *s8;
+    char *d8;
+    int index;
+    int x;
+    int y;
+    int width;
+    int height;
+    int offset;
+    int stime;
+    int etime;
+
+    for (index = 0; index < 2000; index++)
+    {
+        x = index % 64;
+        y = (index * 7) % 64;
+        width = 1 + (index * 13) % (64 - x);
+        height = 1 + (index * 29) % (64 - y);
+        s8 = rgb_data + (index % 16) * 1920 * 4 * 64 + y * 1920 * 4 + x * 4;
+        memset(yuva1, 0, sizeof(yuva1));
+        memset(yuva2, 0, sizeof(yuva2));
+        a8r8g8b8_to_yuvalp_box(s8, 1920 * 4, yuva1 + y * 64 + x, 64,
+                               width, height);
+        proc(s8, 1920 * 4, yuva2 + y * 64 + x, 64, width, height);
+        if (lmemcmp(yuva1, yuva2, sizeof(yuva1), &offset) != 0)
+        {
+            printf("%s no match for x %d y %d width %d height %d "
+                   "at offset %d\n", name, x, y, width, height, offset);
+            return 1;
+        }
+    }
+    stime = get_mstime();
+    for (index = 0; index < 100; index++)
+    {
+        for (y = 0; y < 1024; y += 64)
+        {
+            for (x = 0; x < 1920; x += 64)
+            {
+                s8 = rgb_data + y * 1920 * 4 + x * 4;
+                d8 = yuva2;
+                proc(s8, 1920 * 4, d8, 64, 64, 64);
+            }
+        }
+    }
+    etime = get_mstime();
+    printf("%s took %d\n", name, etime - stime);
+    printf("match\n");
+    return 0;
+}
+
+#define AVC444_CAP_WIDTH 256
+#define AVC444_CAP_HEIGHT 64
+
+/* a box into a capture buffer laid out like the AVC444 one, see
+ * rdpCopyBox_a8r8g8b8_to_avc444_cap, each call covers at most one 16 line
+ * group, proc does the multiple of 8 part of the width and the C version
+ * the rest, first, so a write past it shows, proc NULL for all C */
+static void
+avc444_cap_box(avc444_box_proc proc, char *s8, int src_stride, char *dst,
+               int x, int y1, int width, int height)
+{
+    char *dst_uv;
+    char *dst_aux_y;
+    char *dst_aux_uv;
+    char *ls8;
+    char *d8_y;
+    char *d8_uv;
+    char *d8_aux_u;
+    char *d8_aux_v;
+    char *d8_aux_uv;
+    int plane_bytes;
+    int simd_width;
+    int pair;
+    int aux_line;
+    int y;
+    int y2;
+    int stride;
+
+    stride = AVC444_CAP_WIDTH;
+    plane_bytes = stride * AVC444_CAP_HEIGHT;
+    dst_uv = dst + plane_bytes;
+    dst_aux_y = dst_uv + plane_bytes / 2;
+    dst_aux_uv = dst_aux_y + plane_bytes;
+    simd_width = (proc == NULL) ? 0 : width & ~7;
+    for (y = y1; y < y1 + height; y = y2)
+    {
+        y2 = (y & ~15) + 16;
+        if (y2 > y1 + height)
+        {
+            y2 = y1 + height;
+        }
+        pair = y / 2;
+        aux_line = (pair & ~7) * 2 + (pair & 7);
+        ls8 = s8 + (y - y1) * src_stride;
+        d8_y = dst + y * stride + x;
+        d8_uv = dst_uv + pair * stride + x;
+        d8_aux_u = dst_aux_y + aux_line * stride + x;
+        d8_aux_v = d8_aux_u + 8 * stride;
+        d8_aux_uv = dst_aux_uv + pair * stride + x;
+        if (width > simd_width)
+        {
+            a8r8g8b8_to_avc444_box(ls8 + simd_width * 4, src_stride,
+                                   d8_y + simd_width, d8_uv + simd_width,
+                                   d8_aux_u + simd_width,
+                                   d8_aux_v + simd_width,
+                                   d8_aux_uv + simd_width, stride,
+                                   width - simd_width, y2 - y);
+        }
+        if (simd_width > 0)
+        {
+            proc(ls8, src_stride, d8_y, d8_uv, d8_aux_u, d8_aux_v,
+                 d8_aux_uv, stride, simd_width, y2 - y);
+        }
+    }
+}
+
+/* returns 0 if proc matches the C version for all of rgb_data,
+ * 1920x1080, and for boxes of any width that cross 16 line groups */
+static int
+check_avc444(const char *name, avc444_box_proc proc, char *rgb_data)
+{
+    char *yuv1;
+    char *yuv2;
+    char *s8;
+    int plane_bytes;
+    int bytes;
+    int index;
+    int x;
+    int y;
+    int width;
+    int height;
+    int offset;
+    int stime;
+    int etime;
+    int rv;
+
+    /* y, uv, aux u, aux v and aux uv */
+    plane_bytes = 1920 * 1080;
+    bytes = plane_bytes * 3;
+    yuv1 = (char *) malloc(bytes);
+    yuv2 = (char *) malloc(bytes);
+    memset(yuv1, 0, bytes);
+    memset(yuv2, 0, bytes);
+    a8r8g8b8_to_avc444_box(rgb_data, 1920 * 4,
+                           yuv1, yuv1 + plane_bytes,
+                           yuv1 + plane_bytes * 3 / 2,
+                           yuv1 + plane_bytes * 2,
+                           yuv1 + plane_bytes * 5 / 2, 1920,
+                           1920, 1080);
+    stime = get_mstime();
+    for (index = 0; index < 100; index++)
+    {
+        proc(rgb_data, 1920 * 4,
+             yuv2, yuv2 + plane_bytes,
+             yuv2 + plane_bytes * 3 / 2,
+             yuv2 + plane_bytes * 2,
+             yuv2 + plane_bytes * 5 / 2, 1920,
+             1920, 1080);
+    }
+    etime = get_mstime();
+    printf("%s took %d\n", name, etime - stime);
+    rv = 0;
+    if (lmemcmp(yuv1, yuv2, bytes, &offset) != 0)
+    {
+        printf("%s no match at offset %d\n", name, offset);
+        rv = 1;
+    }
+    bytes = AVC444_CAP_WIDTH * AVC444_CAP_HEIGHT * 3;
+    for (index = 0; (index < 2000) && (rv == 0); index++)
+    {
+        x = rand() % AVC444_CAP_WIDTH;
+        y = (rand() % AVC444_CAP_HEIGHT) & ~1;
+        width = 1 + rand() % (AVC444_CAP_WIDTH - x);
+        height = 2 + ((rand() % (AVC444_CAP_HEIGHT - y)) & ~1);
+        s8 = rgb_data + (rand() % 1000) * 1920 * 4 + (rand() % 1600) * 4;
+        memset(yuv1, 0, bytes);
+        memset(yuv2, 0, bytes);
+        avc444_cap_box(NULL, s8, 1920 * 4, yuv1, x, y, width, height);
+        avc444_cap_box(proc, s8, 1920 * 4, yuv2, x, y, width, height);
+        if (lmemcmp(yuv1, yuv2, bytes, &offset) != 0)
+        {
+            printf("%s no match for x %d y %d width %d height %d "
+                   "at offset %d\n", name, x, y, width, height, offset);
+            rv = 1;
+        }
+    }
+    free(yuv1);
+    free(yuv2);
+    if (rv == 0)
+    {
+        printf("match\n");
+    }
+    return rv;
+}
+
+/* returns 0 if proc matches c_proc, bit exact, for all of rgb_data,
+ * 1920x1080, and for boxes of any width into destinations that are not
+ * aligned, dst_Bpp is 2 or 1 */
+static int
+check_rgb(const char *name, rgb_box_proc proc, rgb_box_proc c_proc,
+          int dst_Bpp, char *rgb_data)
 {
+    char *dst1;
+    char *dst2;
+    char *s8;
+    int bytes;
     int index;
+    int dst_offset;
+    int width;
+    int height;
     int offset;
+    int stime;
+    int etime;
+    int rv;
+
+    bytes = 1920 * 1080 * dst_Bpp + 64;
+    dst1 = (char *) malloc(bytes);
+    dst2 = (char *) malloc(bytes);
+    memset(dst1, 0, bytes);
+    memset(dst2, 0, bytes);
+    c_proc(rgb_data, 1920 * 4, dst1, 1920 * dst_Bpp, 1920, 1080);
+    stime = get_mstime();
+    for (index = 0; index < 100; index++)
+    {
+        proc(rgb_data, 1920 * 4, dst2, 1920 * dst_Bpp, 1920, 1080);
+    }
+    etime = get_mstime();
+    printf("%s took %d\n", name, etime - stime);
+    rv = 0;
+    if (lmemcmp(dst1, dst2, bytes, &offset) != 0)
+    {
+        printf("%s no match at offset %d\n", name, offset);
+        rv = 1;
+    }
+    for (index = 0; (index < 2000) && (rv == 0); index++)
+    {
+        /* d8 only needs to be dst_Bpp aligned */
+        dst_offset = (rand() % 16) * dst_Bpp;
+        width = 1 + rand() % 300;
+        height = 1 + rand() % 32;
+        s8 = rgb_data + (rand() % 1000) * 1920 * 4 + (rand() % 1600) * 4;
+        memset(dst1, 0, 512 * dst_Bpp * 32 + 64);
+        memset(dst2, 0, 512 * dst_Bpp * 32 + 64);
+        c_proc(s8, 1920 * 4, dst1 + dst_offset, 512 * dst_Bpp,
+               width, height);
+        proc(s8, 1920 * 4, dst2 + dst_offset, 512 * dst_Bpp,
+             width, height);
+        if (lmemcmp(dst1, dst2, 512 * dst_Bpp * 32 + 64, &offset) != 0)
+        {
+            printf("%s no match for dst_offset %d width %d height %d "
+                   "at offset %d\n", name, dst_offset, width, height,
+                   offset);
+            rv = 1;
+        }
+    }
+    free(dst1);
+    free(dst2);
+    if (rv == 0)
+    {
+        printf("match\n");
+    }
+    return rv;
+}
+
+/* returns 0 if proc copies like memcpy, for all of rgb_data, 1920x1080,
+ * and for boxes of any size from any pixel into destinations that are
+ * only 4 byte aligned, for the head and tail loops before and after the
+ * aligned stores */
+static int
+check_copy_nt(const char *name, rgb_box_proc proc, char *rgb_data)
+{
+    char *dst1;
+    char *dst2;
+    char *s8;
+    int bytes;
+    int index;
+    int jndex;
+    int dst_offset;
+    int dst_stride;
+    int width;
+    int height;
+    int offset;
+    int stime;
+    int etime;
+    int rv;
+
+    bytes = 1920 * 1080 * 4 + 64;
+    dst1 = (char *) malloc(bytes);
+    dst2 = (char *) malloc(bytes);
+    memset(dst2, 0, bytes);
+    stime = get_mstime();
+    for (index = 0; index < 100; index++)
+    {
+        memcpy(dst1, rgb_data, 1920 * 1080 * 4);
+    }
+    etime = get_mstime();
+    printf("memcpy took %d\n", etime - stime);
+    stime = get_mstime();
+    for (index = 0; index < 100; index++)
+    {
+        proc(rgb_data, 1920 * 4, dst2, 1920 * 4, 1920, 1080);
+    }
+    etime = get_mstime();
+    printf("%s took %d\n", name, etime - stime);
+    rv = 0;
+    if (lmemcmp(dst1, dst2, 1920 * 1080 * 4, &offset) != 0)
+    {
+        printf("%s no match at offset %d\n", name, offset);
+        rv = 1;
+    }
+    dst_stride = 512 * 4 + 4;
+    bytes = dst_stride * 64 + 64;
+    for (index = 0; (index < 2000) && (rv == 0); index++)
+    {
+        dst_offset = (rand() % 16) * 4;
+        width = rand() % 300;
+        height = rand() % 64;
+        s8 = rgb_data + (rand() % 1000) * 1920 * 4 + (rand() % 1600) * 4;
+        memset(dst1, 0, bytes);
+        memset(dst2, 0, bytes);
+        for (jndex = 0; jndex < height; jndex++)
+        {
+            memcpy(dst1 + dst_offset + jndex * dst_stride,
+                   s8 + jndex * 1920 * 4, width * 4);
+        }
+        proc(s8, 1920 * 4, dst2 + dst_offset, dst_stride, width, height);
+        if (lmemcmp(dst1, dst2, bytes, &offset) != 0)
+        {
+            printf("%s no match for dst_offset %d width %d height %d "
+                   "at offset %d\n", name, dst_offset, width, height,
+                   offset);
+            rv = 1;
+        }
+    }
+    free(dst1);
+    free(dst2);
+    if (rv == 0)
+    {
+        printf("match\n");
+    }
+    return rv;
+}
+
+int main(int argc, char** argv)
+{
+    int index;
     int fd;
     int data_bytes;
     int stime;
@@ -309,29 +1126,82 @@ int main(int argc, char** argv)
     }
     etime = get_mstime();
     printf("a8r8g8b8_to_nv12_box took %d\n", etime - stime);
-    stime = get_mstime();
-    for (index = 0; index < 100; index++)
+    if (check_nv12("a8r8g8b8_to_nv12_box_accel",
+                   a8r8g8b8_to_nv12_box_accel,
+                   al_rgb_data, al_yuv_data1, al_yuv_data2) != 0)
     {
-        a8r8g8b8_to_nv12_box_accel(al_rgb_data, 1920 * 4,
-                                   al_yuv_data2, 1920,
-                                   al_yuv_data2 + 1920 * 1080, 1920,
-                                   1920, 1080);
+        ret = 1;
     }
-    etime = get_mstime();
-    printf("a8r8g8b8_to_nv12_box_x86_sse2 took %d\n", etime - stime);
-    if (lmemcmp(al_yuv_data1, al_yuv_data2, 1920 * 1080 * 3 / 2, &offset) != 0)
+    if (check_yuvalp("a8r8g8b8_to_yuvalp_box",
+                     a8r8g8b8_to_yuvalp_box, al_rgb_data) != 0)
     {
         ret = 1;
-        printf("no match at offset %d\n", offset);
-        printf("first\n");
-        hexdump(al_yuv_data1 + offset, 16);
-        printf("second\n");
-        hexdump(al_yuv_data2 + offset, 16);
     }
-    else
+    if (check_yuvalp("a8r8g8b8_to_yuvalp_box_accel",
+                     a8r8g8b8_to_yuvalp_box_accel, al_rgb_data) != 0)
     {
-        printf("match\n");
+        ret = 1;
     }
+    if (check_avc444("a8r8g8b8_to_avc444_box_accel",
+                     a8r8g8b8_to_avc444_box_accel, al_rgb_data) != 0)
+    {
+        ret = 1;
+    }
+    if (check_rgb("a8r8g8b8_to_r5g6b5_box_accel",
+                  a8r8g8b8_to_r5g6b5_box_accel,
+                  a8r8g8b8_to_r5g6b5_box, 2, al_rgb_data) != 0)
+    {
+        ret = 1;
+    }
+    if (check_rgb("a8r8g8b8_to_a1r5g5b5_box_accel",
+                  a8r8g8b8_to_a1r5g5b5_box_accel,
+                  a8r8g8b8_to_a1r5g5b5_box, 2, al_rgb_data) != 0)
+    {
+        ret = 1;
+    }
+    if (check_rgb("a8r8g8b8_to_r3g3b2_box_accel",
+                  a8r8g8b8_to_r3g3b2_box_accel,
+                  a8r8g8b8_to_r3g3b2_box, 1, al_rgb_data) != 0)
+    {
+        ret = 1;
+    }
+    if (check_copy_nt("a8r8g8b8_to_a8r8g8b8_box_nt_accel",
+                      a8r8g8b8_to_a8r8g8b8_box_nt_accel, al_rgb_data) != 0)
+    {
+        ret = 1;
+    }
+#if defined(USE_SIMD_AMD64)
+    if (get_simd_level() >= 2)
+    {
+        if (check_yuvalp("a8r8g8b8_to_yuvalp_box_amd64_avx2",
+                         a8r8g8b8_to_yuvalp_box_amd64_avx2,
+                         al_rgb_data) != 0)
+        {
+            ret = 1;
+        }
+        if (check_nv12("a8r8g8b8_to_nv12_box_amd64_avx2",
+                       a8r8g8b8_to_nv12_box_amd64_avx2,
+                       al_rgb_data, al_yuv_data1, al_yuv_data2) != 0)
+        {
+            ret = 1;
+        }
+        if (check_avc444("a8r8g8b8_to_avc444_box_amd64_avx2",
+                         a8r8g8b8_to_avc444_box_amd64_avx2,
+                         al_rgb_data) != 0)
+        {
+            ret = 1;
+        }
+    }
+    if (get_simd_level() >= 3)
+    {
+        if (check_nv12("a8r8g8b8_to_nv12_box_amd64_avx512",
+                       a8r8g8b8_to_nv12_box_amd64_avx512,
+                       al_rgb_data, al_yuv_data1, al_yuv_data2) != 0)
+        {
+            ret = 1;
+        }
+    }
+#endif
     free(rgb_data);
     free(yuv_data1);
     free(yuv_data2);
@@ -87,6 +87,23 @@ Bool g_use_dri3 = TRUE;
   while (0)
 
 static int g_setup_done = 0;
+/* highest simd tier to use, read from xorg.conf SIMDLevel */
+static int g_simd_level_max = RDP_SIMD_AVX512;
+/* read from xorg.conf CaptureThreads and CaptureNUMA */
+static int g_capture_threads = 0;
+static int g_capture_numa = 0;
+/* read from xorg.conf CaptureAsync */
+static int g_capture_async = 1;
+/* read from xorg.conf CaptureNTBytes, -1 is auto */
+static int g_capture_nt_bytes = -1;
+/* read from xorg.conf CaptureFrames */
+static int g_capture_frames = 1;
+/* read from xorg.conf FrameRateMin, FrameRateMax and StatsInterval */
+static int g_frame_rate_min = 5;
+static int g_frame_rate_max = 60;
+static int g_stats_interval_s = 0;
+/* read from xorg.conf FramebufferShared */
+static int g_fb_shared = 0;
 static OsTimerPtr g_randr_timer = 0;
 static OsTimerPtr g_damage_timer = 0;
 
@@ -171,6 +188,17 @@ rdpPreInit(ScrnInfoPtr pScrn, int flags)
     dev = XRDPPTR(pScrn);
 
     dev->glamor = FALSE;
+    dev->simd_level_max = g_simd_level_max;
+    dev->capture_threads = g_capture_threads;
+    dev->capture_numa = g_capture_numa;
+    dev->capture_async = g_capture_async;
+    dev->capture_nt_bytes = g_capture_nt_bytes;
+    dev->fb_shared = g_fb_shared;
+    dev->capture_frames = g_capture_frames;
+    dev->frame_rate_min = g_frame_rate_min;
+    dev->frame_rate_max = g_frame_rate_max;
+    dev->stats_interval_s = g_stats_interval_s;
+    dev->pfbMemory_fd = -1;
 
 #if defined(XORGXRDP_GLAMOR)
     if (getenv("XORGXRDP_DRM_DEVICE") != NULL)
@@ -515,7 +543,10 @@ rdpWakeupHandler1(pointer blockData, int result, pointer pReadmask)
 rdpWakeupHandler1(void *blockData, int result)
 #endif
 {
+#if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1, 18, 5, 0, 0)
+    /* newer servers call the notify procs for the xrdp fds */
     rdpClientConCheck((ScreenPtr)blockData);
+#endif
 }
 
 #if defined(XORGXRDP_GLAMOR)
@@ -615,8 +646,7 @@ rdpScreenInit(ScreenPtr pScreen, int argc, char **argv)
     dev->bitsPerPixel = rdpBitsPerPixel(dev->depth);
     dev->sizeInBytes = dev->paddedWidthInBytes * dev->height;
     LLOGLN(0, ("rdpScreenInit: pfbMemory bytes %d", dev->sizeInBytes));
-    dev->pfbMemory_alloc = g_new0(uint8_t, dev->sizeInBytes + 16);
-    dev->pfbMemory = (uint8_t *) RDPALIGN(dev->pfbMemory_alloc, 16);
+    rdpAllocFramebuffer(dev);
     LLOGLN(0, ("rdpScreenInit: pfbMemory %p", dev->pfbMemory));
     if (!fbScreenInit(pScreen, dev->pfbMemory,
                       pScrn->virtualX, pScrn->virtualY,
@@ -656,6 +686,8 @@ rdpScreenInit(ScreenPtr pScreen, int argc, char **argv)
         if (glamor_init(pScreen, GLAMOR_USE_EGL_SCREEN | GLAMOR_NO_DRI3))
         {
             LLOGLN(0, ("rdpScreenInit: glamor_init ok"));
+            /* the GPU draws, the wrappers would not see all of it */
+            dev->damage_ext = TRUE;
         }
         else
         {
@@ -726,11 +758,21 @@ rdpScreenInit(ScreenPtr pScreen, int argc, char **argv)
     dev->CloseScreen = pScreen->CloseScreen;
     pScreen->CloseScreen = rdpCloseScreen;
 
-    dev->CopyWindow = pScreen->CopyWindow;
-    pScreen->CopyWindow = rdpCopyWindow;
+    /* one damage source, reporting the same damage twice only costs */
+    if (dev->damage_ext)
+    {
+        LLOGLN(0, ("rdpScreenInit: damage from the Damage extension"));
+    }
+    else
+    {
+        LLOGLN(0, ("rdpScreenInit: damage from the GC and picture "
+               "wrappers"));
+        dev->CopyWindow = pScreen->CopyWindow;
+        pScreen->CopyWindow = rdpCopyWindow;
 
-    dev->CreateGC = pScreen->CreateGC;
-    pScreen->CreateGC = rdpCreateGC;
+        dev->CreateGC = pScreen->CreateGC;
+        pScreen->CreateGC = rdpCreateGC;
+    }
 
     dev->CreatePixmap = pScreen->CreatePixmap;
     pScreen->CreatePixmap = rdpCreatePixmap;
@@ -742,7 +784,7 @@ rdpScreenInit(ScreenPtr pScreen, int argc, char **argv)
     pScreen->ModifyPixmapHeader = rdpModifyPixmapHeader;
 
     ps = GetPictureScreenIfSet(pScreen);
-    if (ps != 0)
+    if ((ps != 0) && !dev->damage_ext)
     {
         /* composite */
         dev->Composite = ps->Composite;
@@ -756,6 +798,9 @@ rdpScreenInit(ScreenPtr pScreen, int argc, char **argv)
         /* triangles */
         dev->Triangles = ps->Triangles;
         ps->Triangles = rdpTriangles;
+        /* traps */
+        dev->AddTraps = ps->AddTraps;
+        ps->AddTraps = rdpAddTraps;
         /* composite rects */
         dev->CompositeRects = ps->CompositeRects;
         ps->CompositeRects = rdpCompositeRects;
@@ -767,7 +812,11 @@ rdpScreenInit(ScreenPtr pScreen, int argc, char **argv)
     RegisterBlockAndWakeupHandlers(rdpBlockHandler1, rdpWakeupHandler1, pScreen);
 
     g_randr_timer = TimerSet(g_randr_timer, 0, 10, rdpDeferredRandR, pScreen);
-    g_damage_timer = TimerSet(g_damage_timer, 0, 10, rdpDeferredDamage, pScreen);
+    if (dev->damage_ext)
+    {
+        g_damage_timer = TimerSet(g_damage_timer, 0, 10, rdpDeferredDamage,
+                                  pScreen);
+    }
 
     if (rdpClientConInit(dev) != 0)
     {
@@ -873,6 +922,7 @@ rdpProbe(DriverPtr drv, int flags)
     int num_dev_sections;
     int i;
     int entity;
+    int level;
     GDevPtr *dev_sections;
     Bool found_screen;
     ScrnInfoPtr pscrn;
@@ -936,6 +986,104 @@ rdpProbe(DriverPtr drv, int flags)
             LLOGLN(0, ("rdpProbe: found DRI3 xorg.conf value [%s]", val));
 #endif
         }
+        val = xf86FindOptionValue(dev_sections[i]->options, "SIMDLevel");
+        if (val != NULL)
+        {
+            level = rdpSimdLevelFromString(val);
+            if (level < 0)
+            {
+                LLOGLN(0, ("rdpProbe: WARNING -- unknown SIMDLevel xorg.conf "
+                       "value [%s], using the best available", val));
+            }
+            else
+            {
+                g_simd_level_max = level;
+                LLOGLN(0, ("rdpProbe: found SIMDLevel xorg.conf value [%s], "
+                       "using %s", val, rdpSimdLevelToString(level)));
+            }
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "CaptureThreads");
+        if (val != NULL)
+        {
+            g_capture_threads = atoi(val);
+            LLOGLN(0, ("rdpProbe: found CaptureThreads xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "CaptureNUMA");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_capture_numa = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found CaptureNUMA xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "CaptureAsync");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "0") == 0) ||
+                (strcmp(val, "no") == 0) ||
+                (strcmp(val, "false") == 0))
+            {
+                g_capture_async = 0;
+            }
+            LLOGLN(0, ("rdpProbe: found CaptureAsync xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "CaptureNTBytes");
+        if (val != NULL)
+        {
+            if (strcmp(val, "auto") != 0)
+            {
+                g_capture_nt_bytes = atoi(val);
+            }
+            LLOGLN(0, ("rdpProbe: found CaptureNTBytes xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "CaptureFrames");
+        if (val != NULL)
+        {
+            g_capture_frames = atoi(val);
+            LLOGLN(0, ("rdpProbe: found CaptureFrames xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "FrameRateMin");
+        if (val != NULL)
+        {
+            g_frame_rate_min = atoi(val);
+            LLOGLN(0, ("rdpProbe: found FrameRateMin xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "FrameRateMax");
+        if (val != NULL)
+        {
+            g_frame_rate_max = atoi(val);
+            LLOGLN(0, ("rdpProbe: found FrameRateMax xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "StatsInterval");
+        if (val != NULL)
+        {
+            g_stats_interval_s = atoi(val);
+            LLOGLN(0, ("rdpProbe: found StatsInterval xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options,
+                                  "FramebufferShared");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_fb_shared = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found FramebufferShared xorg.conf value "
+                   "[%s]", val));
+        }
         entity = xf86ClaimFbSlot(drv, 0, dev_sections[i], 1);
         pscrn = xf86ConfigFbEntity(pscrn, 0, entity, 0, 0, 0, 0);
         if (pscrn)